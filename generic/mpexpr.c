@@ -76,29 +76,6 @@ terms specified in this license.
 #include "mpexpr.h"
 
 
-/*
- * The data structure below is used to describe an expression value,
- * which can be either an integer (the usual case), a double-precision
- * floating-point value, or a string.  A given number has only one
- * value at a time.
- */
-
-#define STATIC_STRING_SPACE 150
-
-typedef enum {MP_INT, MP_DOUBLE, MP_EITHER, MP_STRING, MP_UNDEF} Mp_ValueType;
-
-typedef struct {
-    ZVALUE intValue;		/* Integer value, if any. */
-    NUMBER *doubleValue;	/* Floating-point value, if any. */
-    ParseValue pv;		/* Used to hold a string value, if any. */
-    char staticSpace[STATIC_STRING_SPACE];
-				/* Storage for small strings;  large ones
-				 * are malloc-ed. */
-    Mp_ValueType type;		/* Type of value:  MP_INT, MP_DOUBLE,
-				 * or MP_STRING. */
-} Mp_Value;
-
-
 /*
  * The data structure below describes the state of parsing an expression.
  * It's passed among the routines in this module.
@@ -113,6 +90,9 @@ typedef struct {
 				 * expr.  See below for definitions.
 				 * Corresponds to the characters just
 				 * before expr. */
+    struct ExprNode *nodePtr;	/* If token is VALUE, the node built for
+				 * the value.  Owned by the parse until
+				 * ExprParseValue picks it up. */
 } ExprInfo;
 
 /* make defines for easy stuff that is missing or different name */
@@ -120,26 +100,173 @@ typedef struct {
 #define zneg(z)         ((z).sign = (z).sign==0?1:0)
 
 
-typedef int (Mp_MathProc) _ANSI_ARGS_((ClientData clientData,
-	Tcl_Interp *interp, Mp_Value *args, Mp_Data *mdPtr,
-	Mp_Value *resultPtr));
-
-
 /*
  * The data structure below defines a math function (e.g. sin or hypot)
- * for use in Tcl expressions.
+ * for use in Tcl expressions.  The function table of an interpreter and
+ * each EXPR_FUNC node calling the function hold a reference to it, so
+ * a function can be redefined while compiled expressions still use the
+ * old definition.
  */
 
-#define MP_MAX_MATH_ARGS 5
+#define MP_MAX_MATH_ARGS 5	/* Arguments of a call that fit on the
+				 * stack;  calls with more are malloc-ed. */
 typedef struct Mp_MathFunc {
-    int numArgs;                /* Number of arguments for function. */
-    Mp_ValueType argTypes[MP_MAX_MATH_ARGS];
-                                /* Acceptable types for each argument. */
+    int refCount;		/* Number of references to the function. */
+    int numArgs;                /* Number of arguments for function, or
+				 * the least number for a variadic one. */
+    Mp_ValueType *argTypes;	/* Acceptable types for each argument;  a
+				 * variadic function has one type for all
+				 * of them.  Allocated with the structure. */
     Mp_MathProc *proc;         /* Procedure that implements this function. */
+    Mp_VarMathProc *varProc;	/* Procedure that implements a variadic
+				 * function, or NULL. */
     ClientData clientData;      /* Additional argument to pass to the function
                                  * when invoking it. */
+    int flags;			/* OR-ed combination of the MP_FUNC_* bits
+				 * below. */
 } Mp_MathFunc;
 
+/*
+ * Flag bits for math functions:
+ *
+ * MP_FUNC_PURE -		The result depends only on the arguments
+ *				(and the precision), so a call with constant
+ *				arguments can be folded.
+ * MP_FUNC_PRECISION -		The result depends on mp_precision.
+ */
+
+#define MP_FUNC_PURE		1
+#define MP_FUNC_PRECISION	2
+
+
+
+/*
+ * The data structures below hold an expression in compiled form.  An
+ * expression string is parsed once into a tree of ExprNodes; numeric
+ * and constant string literals are converted to values at that time,
+ * while variable references, embedded commands and quoted strings that
+ * contain substitutions are kept as source text and resolved each time
+ * the tree is evaluated.
+ */
+
+#define EXPR_LITERAL	0	/* Constant value. */
+#define EXPR_VARIABLE	1	/* $name or $name(index) reference. */
+#define EXPR_COMMAND	2	/* [command] substitution. */
+#define EXPR_QUOTES	3	/* "string" with substitutions. */
+#define EXPR_UNARY	4	/* Unary operator, one operand. */
+#define EXPR_BINARY	5	/* Binary operator, two operands. */
+#define EXPR_TERNARY	6	/* ?: operator, three operands. */
+#define EXPR_FUNC	7	/* Math function call. */
+
+/*
+ * Whether the value of a node can be folded, i.e. computed once and
+ * kept in the node:
+ */
+
+#define EXPR_FOLD_NONE		0	/* Depends on variables or commands. */
+#define EXPR_FOLD_EXACT		1	/* Constant. */
+#define EXPR_FOLD_PRECISION	2	/* Constant for a given precision. */
+
+/*
+ * Operator value of an EXPR_VARIABLE node that refers to a plain scalar
+ * ($name), which may be bound by mpexpr -map.
+ */
+
+#define EXPR_SCALAR	1
+
+/*
+ * The precision in effect outside an evaluation that was given its own
+ * precision;  see ExprSetPrecision.
+ */
+
+typedef struct PrecisionSave {
+    long precision;		/* Saved mdPtr->precision. */
+    NUMBER *epsilon;		/* Saved mdPtr->epsilon, with its link,
+				 * or NULL if the precision wasn't
+				 * changed. */
+    long precisionSets;		/* mdPtr->precisionSets when the
+				 * precision was changed. */
+} PrecisionSave;
+
+typedef struct ExprNode {
+    int kind;			/* One of the EXPR_* values above. */
+    int operator;		/* Operator token for unary, binary and
+				 * ternary nodes;  EXPR_SCALAR or 0 for
+				 * variables. */
+    Mp_ValueType type;		/* Type of a literal:  MP_INT, MP_DOUBLE
+				 * or MP_STRING. */
+    ZVALUE intValue;		/* Value of an MP_INT literal. */
+    NUMBER *doubleValue;	/* Value of an MP_DOUBLE literal. */
+    int fold;			/* EXPR_FOLD_* value for the node. */
+    long foldPrec;		/* If >= 0, type, intValue and doubleValue
+				 * of a folded node that isn't a literal hold
+				 * its value, computed with this precision.
+				 * -1 means not computed yet. */
+    char *string;		/* Value of an MP_STRING literal, or the
+				 * source text of a variable, command or
+				 * quoted string.  Malloc-ed. */
+    Mp_MathFunc *funcPtr;	/* Function called by an EXPR_FUNC node. */
+    int numArgs;		/* Number of operands or arguments. */
+    struct ExprNode **args;	/* Operands or arguments.  Malloc-ed. */
+} ExprNode;
+
+typedef struct ExprTree {
+    int refCount;		/* Number of users of the tree:  the
+				 * expression cache, Tcl_Objs holding it
+				 * as internal rep and any evaluation
+				 * in progress. */
+    ExprNode *root;		/* Top node of the expression. */
+    Mp_Data *mdPtr;		/* Interpreter data the tree was compiled
+				 * for;  its math functions are referred
+				 * to by EXPR_FUNC nodes. */
+    long epoch;			/* Value of mdPtr->exprEpoch when the tree
+				 * was compiled.  The tree can only be
+				 * used while the two match. */
+} ExprTree;
+
+/*
+ * Tcl_Obj type for expressions given to mpexpr as a single argument.
+ * The internal rep holds a reference to the compiled ExprTree in
+ * twoPtrValue.ptr1, so an expression that is a literal in a procedure
+ * body is only looked up once.
+ */
+
+static void		FreeExprInternalRep _ANSI_ARGS_((Tcl_Obj *objPtr));
+static void		DupExprInternalRep _ANSI_ARGS_((Tcl_Obj *srcPtr,
+			    Tcl_Obj *copyPtr));
+
+static Tcl_ObjType mpExprType = {
+    "mpexpr",				/* name */
+    FreeExprInternalRep,		/* freeIntRepProc */
+    DupExprInternalRep,			/* dupIntRepProc */
+    NULL,				/* updateStringProc */
+    NULL				/* setFromAnyProc */
+};
+
+/*
+ * Tcl_Obj type for numbers, so values passed from one mpexpr to the next
+ * through variables don't have to be converted to decimal and back.
+ * The internal rep is a reference to a NUMBER in ptrAndLongRep.ptr.
+ * ptrAndLongRep.value is MP_NUMBER_INT if the value is an integer (held
+ * in the numerator), else the number of decimal places to print the
+ * floating-point value with.
+ */
+
+#define MP_NUMBER_INT	((unsigned long) -1)
+
+static void		FreeNumberInternalRep _ANSI_ARGS_((Tcl_Obj *objPtr));
+static void		DupNumberInternalRep _ANSI_ARGS_((Tcl_Obj *srcPtr,
+			    Tcl_Obj *copyPtr));
+static void		UpdateStringOfNumber _ANSI_ARGS_((Tcl_Obj *objPtr));
+
+static Tcl_ObjType mpNumberType = {
+    "mpnumber",				/* name */
+    FreeNumberInternalRep,		/* freeIntRepProc */
+    DupNumberInternalRep,		/* dupIntRepProc */
+    UpdateStringOfNumber,		/* updateStringProc */
+    NULL				/* setFromAnyProc */
+};
+
 
 /*
  * The token types are defined below.  In addition, there is a table
@@ -249,38 +376,76 @@ static int		ExprBinaryFunc _ANSI_ARGS_((ClientData clientData,
 static int		ExprBinary2Func _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, Mp_Value *args, Mp_Data *mdPtr,
 			    Mp_Value *resultPtr));
+static int		ExprMinMaxFunc _ANSI_ARGS_((ClientData clientData,
+			    Tcl_Interp *interp, int numArgs, Mp_Value *args,
+			    Mp_Data *mdPtr, Mp_Value *resultPtr));
 static int		ExprBinaryZFunc _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, Mp_Value *args, Mp_Data *mdPtr,
 			    Mp_Value *resultPtr));
+static ExprTree *	ExprCompile _ANSI_ARGS_((Tcl_Interp *interp,
+			    CONST char *string, Mp_Data *mdPtr));
+static char *		ExprCopyText _ANSI_ARGS_((CONST char *start,
+			    CONST char *end));
 static int		ExprDoubleFunc _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, Mp_Value *args, Mp_Data *mdPtr,
 			    Mp_Value *resultPtr));
 static void		ExprConvIntToDouble _ANSI_ARGS_((Mp_Value *valuePtr));
 static void		ExprConvDoubleToInt _ANSI_ARGS_((Mp_Value *valuePtr));
-static int		ExprGetValue _ANSI_ARGS_((Tcl_Interp *interp,
-			    ExprInfo *infoPtr, int prec, Mp_Value *valuePtr,
+static int		ExprGetObjValue _ANSI_ARGS_((Tcl_Interp *interp,
+			    Tcl_Obj *objPtr, Mp_Value *valuePtr));
+static Tcl_Obj *	ExprNewNumberObj _ANSI_ARGS_((NUMBER *q,
+			    unsigned long places));
+static Tcl_Obj *	ExprValueObj _ANSI_ARGS_((Mp_Value *valuePtr,
+			    Mp_Data *mdPtr));
+static void		ExprSetPrecision _ANSI_ARGS_((Mp_Data *mdPtr,
+			    long precision, PrecisionSave *savePtr));
+static void		ExprRestorePrecision _ANSI_ARGS_((Mp_Data *mdPtr,
+			    PrecisionSave *savePtr));
+static int		ExprEvaluate _ANSI_ARGS_((Tcl_Interp *interp,
+			    CONST char *string, Tcl_Obj *objPtr,
+			    long precision, Mp_Data *mdPtr));
+static int		ExprEvalMathFunc _ANSI_ARGS_((Tcl_Interp *interp,
+			    ExprNode *nodePtr, Mp_Value *valuePtr,
 			    Mp_Data *mdPtr));
+static int		ExprEvalNode _ANSI_ARGS_((Tcl_Interp *interp,
+			    ExprNode *nodePtr, Mp_Value *valuePtr,
+			    Mp_Data *mdPtr));
+static void		ExprFreeNode _ANSI_ARGS_((ExprNode *nodePtr));
+static int		ExprMarkFolds _ANSI_ARGS_((ExprNode *nodePtr));
+static void		ExprFreeValue _ANSI_ARGS_((Mp_Value *valuePtr));
+static ExprTree *	ExprGetTree _ANSI_ARGS_((Tcl_Interp *interp,
+			    CONST char *string, Mp_Data *mdPtr));
+static ExprTree *	ExprGetTreeFromObj _ANSI_ARGS_((Tcl_Interp *interp,
+			    Tcl_Obj *objPtr, Mp_Data *mdPtr));
+static void		ExprInitValue _ANSI_ARGS_((Mp_Value *valuePtr));
 static int		ExprIntFunc _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, Mp_Value *args, Mp_Data *mdPtr,
 			    Mp_Value *resultPtr));
 static int		ExprLex _ANSI_ARGS_((Tcl_Interp *interp,
-			    ExprInfo *infoPtr, Mp_Value *valuePtr,
-			    Mp_Data *mdPtr));
+			    ExprInfo *infoPtr, Mp_Data *mdPtr));
+static ExprNode *	ExprLiteralNode _ANSI_ARGS_((Mp_Value *valuePtr));
 static int		ExprLooksLikeInt _ANSI_ARGS_((CONST char *p));
 static void		ExprMakeString _ANSI_ARGS_((long precRequest,
 			    Mp_Value *valuePtr));
-static int		ExprMathFunc _ANSI_ARGS_((Tcl_Interp *interp,
-			    ExprInfo *infoPtr, Mp_Value *valuePtr,
+static ExprNode *	ExprNewNode _ANSI_ARGS_((int kind, int operator,
+			    int numArgs));
+static int		ExprParseVarArgs _ANSI_ARGS_((Tcl_Interp *interp,
+			    ExprInfo *infoPtr, Mp_MathFunc *mathFuncPtr,
 			    Mp_Data *mdPtr));
+static int		ExprParseMathFunc _ANSI_ARGS_((Tcl_Interp *interp,
+			    ExprInfo *infoPtr, Mp_Data *mdPtr));
 static int		ExprParseString _ANSI_ARGS_((Tcl_Interp *interp,
 			    CONST char *string, Mp_Value *valuePtr));
+static ExprNode *	ExprParseValue _ANSI_ARGS_((Tcl_Interp *interp,
+			    ExprInfo *infoPtr, int prec, Mp_Data *mdPtr));
+static void		ExprReleaseTree _ANSI_ARGS_((ExprTree *treePtr));
 static int		ExprRoundFunc _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, Mp_Value *args, Mp_Data *mdPtr,
 			    Mp_Value *resultPtr));
 static void		QZMathDeleteProc _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp));
 static int		ExprTopLevel _ANSI_ARGS_((Tcl_Interp *interp,
-			    CONST char *string, Mp_Value *valuePtr,
+			    ExprTree *treePtr, Mp_Value *valuePtr,
 			    Mp_Data *mdPtr));
 static int		ExprUnaryFunc _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, Mp_Value *args, Mp_Data *mdPtr,
@@ -288,7 +453,8 @@ static int		ExprUnaryFunc _ANSI_ARGS_((ClientData clientData,
 static int		ExprUnaryZFunc _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, Mp_Value *args, Mp_Data *mdPtr,
 			    Mp_Value *resultPtr));
-static void             ExprFreeMathArgs _ANSI_ARGS_ ((Mp_Value *args));
+static void             ExprFreeMathArgs _ANSI_ARGS_ ((Mp_Value *args,
+			    int numArgs));
 /* EFP */
 static int		ExprTertiaryZFunc _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, Mp_Value *args, Mp_Data *mdPtr,
@@ -322,10 +488,21 @@ typedef struct {
     Mp_MathProc *proc;		/* Procedure that implements this function. */
     ClientData clientData;	/* Additional argument to pass to the function
 				 * when invoking it. */
+    Mp_VarMathProc *varProc;	/* Procedure for a variadic function, used
+				 * instead of proc.  numArgs is then the
+				 * least number of arguments, and argTypes[0]
+				 * the type of all of them. */
 } BuiltinFunc;
 
 static void             CreateMathFunc _ANSI_ARGS_ ((Tcl_HashTable *table,
 			    BuiltinFunc *funcPtr));
+static int		DefineMathFunc _ANSI_ARGS_((Tcl_HashTable *table,
+			    CONST char *name, Mp_MathFunc *mathFuncPtr));
+static Tcl_HashTable *	GetFuncTable _ANSI_ARGS_((Mp_Data *mdPtr));
+static Mp_MathFunc *	NewMathFunc _ANSI_ARGS_((int numArgs,
+			    int numTypes));
+static void		ReleaseMathFunc _ANSI_ARGS_((
+			    Mp_MathFunc *mathFuncPtr));
 
 static BuiltinFunc funcTable[] = {
     {"acos", 1, {MP_DOUBLE}, (Mp_MathProc *)ExprUnaryFunc, (ClientData) qacos},
@@ -360,8 +537,8 @@ static BuiltinFunc funcTable[] = {
     {"minv", 2, {MP_DOUBLE, MP_DOUBLE}, (Mp_MathProc *)ExprBinary2Func, (ClientData) qminv},
     {"gcd", 2, {MP_DOUBLE, MP_DOUBLE}, (Mp_MathProc *)ExprBinary2Func, (ClientData) qgcd},
     {"lcm", 2, {MP_DOUBLE, MP_DOUBLE}, (Mp_MathProc *)ExprBinary2Func, (ClientData) qlcm},
-    {"max", 2, {MP_DOUBLE, MP_DOUBLE}, (Mp_MathProc *)ExprBinary2Func, (ClientData) qmax},
-    {"min", 2, {MP_DOUBLE, MP_DOUBLE}, (Mp_MathProc *)ExprBinary2Func, (ClientData) qmin},
+    {"max", 2, {MP_DOUBLE}, NULL, (ClientData) qmax, ExprMinMaxFunc},
+    {"min", 2, {MP_DOUBLE}, NULL, (ClientData) qmin, ExprMinMaxFunc},
 
     {"pi", 0, {MP_EITHER}, (Mp_MathProc *)ExprPiFunc, 0},
 
@@ -498,6 +675,182 @@ ExprParseString(interp, string, valuePtr)
     return TCL_OK;
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprInitValue, ExprFreeValue --
+ *
+ *	Set up an Mp_Value for use as an expression value, and
+ *	release the storage held by one when it is no longer needed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+ExprInitValue(valuePtr)
+    Mp_Value *valuePtr;
+{
+    valuePtr->intValue    = _zero_;
+    valuePtr->doubleValue = qlink(&_qzero_);
+    valuePtr->type        = MP_UNDEF;
+    valuePtr->pv.buffer = valuePtr->pv.next = valuePtr->staticSpace;
+    valuePtr->pv.end = valuePtr->pv.buffer + STATIC_STRING_SPACE - 1;
+    valuePtr->pv.expandProc = MpExpandParseValue;
+    valuePtr->pv.clientData = (ClientData) NULL;
+    valuePtr->pv.noEval = 0;
+}
+
+static void
+ExprFreeValue(valuePtr)
+    Mp_Value *valuePtr;
+{
+    if (valuePtr->pv.buffer != valuePtr->staticSpace) {
+	ckfree(valuePtr->pv.buffer);
+	valuePtr->pv.buffer = valuePtr->staticSpace;
+    }
+    zfree(valuePtr->intValue);
+    Qfree(valuePtr->doubleValue);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprNewNode --
+ *
+ *	Allocate a node of a compiled expression, with room for
+ *	numArgs operands.
+ *
+ * Results:
+ *	The new node, with all operands NULL.
+ *
+ * Side effects:
+ *	Memory is allocated;  free it with ExprFreeNode.
+ *
+ *--------------------------------------------------------------
+ */
+
+static ExprNode *
+ExprNewNode(kind, operator, numArgs)
+    int kind;				/* EXPR_* type of node. */
+    int operator;			/* Operator token, if any. */
+    int numArgs;			/* Number of operand slots. */
+{
+    ExprNode *nodePtr;
+    int i;
+
+    nodePtr = (ExprNode *) ckalloc(sizeof(ExprNode));
+    nodePtr->kind = kind;
+    nodePtr->operator = operator;
+    nodePtr->type = MP_UNDEF;
+    nodePtr->intValue = _zero_;
+    nodePtr->doubleValue = NULL;
+    nodePtr->fold = EXPR_FOLD_NONE;
+    nodePtr->foldPrec = -1;
+    nodePtr->string = NULL;
+    nodePtr->funcPtr = NULL;
+    nodePtr->numArgs = numArgs;
+    nodePtr->args = NULL;
+    if (numArgs > 0) {
+	nodePtr->args = (ExprNode **) ckalloc(numArgs * sizeof(ExprNode *));
+	for (i = 0; i < numArgs; i++) {
+	    nodePtr->args[i] = NULL;
+	}
+    }
+    return nodePtr;
+}
+
+static void
+ExprFreeNode(nodePtr)
+    ExprNode *nodePtr;
+{
+    int i;
+
+    for (i = 0; i < nodePtr->numArgs; i++) {
+	if (nodePtr->args[i] != NULL) {
+	    ExprFreeNode(nodePtr->args[i]);
+	}
+    }
+    if (nodePtr->args != NULL) {
+	ckfree((char *) nodePtr->args);
+    }
+    zfree(nodePtr->intValue);
+    if (nodePtr->doubleValue != NULL) {
+	qfree(nodePtr->doubleValue);
+    }
+    if (nodePtr->string != NULL) {
+	ckfree(nodePtr->string);
+    }
+    if (nodePtr->funcPtr != NULL) {
+	ReleaseMathFunc(nodePtr->funcPtr);
+    }
+    ckfree((char *) nodePtr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprLiteralNode --
+ *
+ *	Make a literal node out of a value parsed from the
+ *	expression string.
+ *
+ * Results:
+ *	The new node.  Integer and floating-point values are moved
+ *	from *valuePtr into the node, leaving *valuePtr holding zero.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static ExprNode *
+ExprLiteralNode(valuePtr)
+    Mp_Value *valuePtr;
+{
+    ExprNode *nodePtr;
+
+    nodePtr = ExprNewNode(EXPR_LITERAL, 0, 0);
+    nodePtr->type = valuePtr->type;
+    if (valuePtr->type == MP_INT) {
+	nodePtr->intValue = valuePtr->intValue;
+	valuePtr->intValue = _zero_;
+    } else if (valuePtr->type == MP_DOUBLE) {
+	nodePtr->doubleValue = valuePtr->doubleValue;
+	valuePtr->doubleValue = qlink(&_qzero_);
+    } else {
+	nodePtr->type = MP_STRING;
+	nodePtr->string = ckalloc(strlen(valuePtr->pv.buffer) + 1);
+	strcpy(nodePtr->string, valuePtr->pv.buffer);
+    }
+    return nodePtr;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprCopyText --
+ *
+ *	Return a malloc-ed, null-terminated copy of the characters
+ *	from start up to (but not including) end.
+ *
+ *--------------------------------------------------------------
+ */
+
+static char *
+ExprCopyText(start, end)
+    CONST char *start;
+    CONST char *end;
+{
+    char *copy;
+    int length = end - start;
+
+    copy = ckalloc(length + 1);
+    strncpy(copy, start, length);
+    copy[length] = '\0';
+    return copy;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -508,13 +861,15 @@ ExprParseString(interp, string, valuePtr)
  *
  * Results:
  *	TCL_OK is returned unless an error occurred while doing lexical
- *	analysis or executing an embedded command.  In that case a
- *	standard Tcl error is returned, using the interpreter result to hold
- *	an error message.  In the event of a successful return, the token
- *	and field in infoPtr is updated to refer to the next symbol in
- *	the expression string, and the expr field is advanced past that
- *	token;  if the token is a value, then the value is stored at
- *	valuePtr.
+ *	analysis.  In that case a standard Tcl error is returned, using
+ *	the interpreter result to hold an error message.  In the event
+ *	of a successful return, the token and field in infoPtr is updated
+ *	to refer to the next symbol in the expression string, and the
+ *	expr field is advanced past that token;  if the token is a value,
+ *	then a node for the value is stored at infoPtr->nodePtr.
+ *	Variables, embedded commands and quoted strings with
+ *	substitutions are not evaluated here;  their nodes keep the
+ *	source text for ExprEvalNode.
  *
  * Side effects:
  *	None.
@@ -523,21 +878,25 @@ ExprParseString(interp, string, valuePtr)
  */
 
 static int
-ExprLex(interp, infoPtr, valuePtr, mdPtr)
+ExprLex(interp, infoPtr, mdPtr)
     Tcl_Interp *interp;			/* Interpreter to use for error
 					 * reporting. */
     register ExprInfo *infoPtr;		/* Describes the state of the parse. */
-    register Mp_Value *valuePtr;	/* Where to store value, if that is
-					 * what's parsed from string.  Caller
-					 * must have initialized pv field
-					 * correctly. */
     Mp_Data *mdPtr;
 {
     register CONST char *p;
     CONST char *var;
     CONST char *term;
+    CONST char *s;
+    NUMBER *q;
+    Mp_Value value;
     int result;
 
+    if (infoPtr->nodePtr != NULL) {
+	ExprFreeNode(infoPtr->nodePtr);
+	infoPtr->nodePtr = NULL;
+    }
+
     p = infoPtr->expr;
     while (isspace(UCHAR(*p))) {
 	p++;
@@ -557,21 +916,23 @@ ExprLex(interp, infoPtr, valuePtr, mdPtr)
 
     if ((*p != '+')  && (*p != '-')) {
 	if (ExprLooksLikeInt(p)) {
-	    zfree(valuePtr->intValue);
-	    Atoz(p, &valuePtr->intValue, &term);
+	    infoPtr->nodePtr = ExprNewNode(EXPR_LITERAL, 0, 0);
+	    infoPtr->nodePtr->type = MP_INT;
+	    Atoz(p, &infoPtr->nodePtr->intValue, &term);
 	    infoPtr->token = VALUE;
 	    infoPtr->expr = term;
-	    valuePtr->type = MP_INT;
 	    return TCL_OK;
 	} else {
-	    Qfree(valuePtr->doubleValue);
-	    valuePtr->doubleValue = Atoq(p, &term);
+	    q = Atoq(p, &term);
 	    if (term != p) {
+		infoPtr->nodePtr = ExprNewNode(EXPR_LITERAL, 0, 0);
+		infoPtr->nodePtr->type = MP_DOUBLE;
+		infoPtr->nodePtr->doubleValue = q;
 	        infoPtr->token = VALUE;
 	        infoPtr->expr = term;
-	        valuePtr->type = MP_DOUBLE;
 	        return TCL_OK;
 	    }
+	    qfree(q);
 	}
     }
 
@@ -579,66 +940,103 @@ ExprLex(interp, infoPtr, valuePtr, mdPtr)
     switch (*p) {
 	case '$':
 	    /*
-	     * Variable.  Fetch its value, then see if it makes sense
-	     * as an integer or floating-point number.
+	     * Variable.  Find the end of its name now, but leave fetching
+	     * the value to evaluation time.
 	     */
 	    infoPtr->token = VALUE;
-	    var = Mp_ParseVar(interp, p, &infoPtr->expr, valuePtr->pv.noEval);
+	    var = Mp_ParseVar(interp, p, &infoPtr->expr, 1);
 	    if (var == NULL) {
 		return TCL_ERROR;
 	    }
 	    Tcl_ResetResult(interp);
-	    if (valuePtr->pv.noEval) {
-		valuePtr->type = MP_INT;
-		zfree(valuePtr->intValue);
-		valuePtr->intValue = _zero_;
+	    if (*var == '$') {
+		/*
+		 * A "$" that isn't followed by a variable name stands
+		 * for itself.
+		 */
+
+		infoPtr->nodePtr = ExprNewNode(EXPR_LITERAL, 0, 0);
+		infoPtr->nodePtr->type = MP_STRING;
+		infoPtr->nodePtr->string = ExprCopyText(p, infoPtr->expr);
 		return TCL_OK;
 	    }
-	    return ExprParseString(interp, var, valuePtr);
+	    infoPtr->nodePtr = ExprNewNode(EXPR_VARIABLE, 0, 0);
+	    infoPtr->nodePtr->string = ExprCopyText(p, infoPtr->expr);
+	    for (s = p+1; s < infoPtr->expr; s++) {
+		if (!isalnum(UCHAR(*s)) && (*s != '_')) {
+		    break;
+		}
+	    }
+	    if (s == infoPtr->expr) {
+		infoPtr->nodePtr->operator = EXPR_SCALAR;
+	    }
+	    return TCL_OK;
 
 	case '[':
 	    infoPtr->token = VALUE;
-	    result= MpParseNestedCmd(interp, p+1, 1, &term, &valuePtr->pv);
+	    ExprInitValue(&value);
+	    value.pv.noEval = 1;
+	    result = MpParseNestedCmd(interp, p+1, 1, &term, &value.pv);
+	    ExprFreeValue(&value);
 	    infoPtr->expr = term;
-	    if (result != TCL_OK) {
-		valuePtr->type = MP_INT;
-		zfree(valuePtr->intValue);
-		valuePtr->intValue = _zero_;
-		return result;
-	    }
-	    if (valuePtr->pv.noEval) {
-		valuePtr->type = MP_INT;
-		zfree(valuePtr->intValue);
-		valuePtr->intValue = _zero_;
-		Tcl_ResetResult(interp);
-		return TCL_OK;
-	    }
-	    result = ExprParseString(interp, valuePtr->pv.buffer, valuePtr);
 	    if (result != TCL_OK) {
 		return result;
 	    }
-	    Tcl_ResetResult(interp);
+	    infoPtr->nodePtr = ExprNewNode(EXPR_COMMAND, 0, 0);
+	    infoPtr->nodePtr->string = ExprCopyText(p+1, term);
 	    return TCL_OK;
 
 	case '"':
+	    /*
+	     * Quoted string.  If it has no variable or command
+	     * substitutions its value is a constant and can be parsed
+	     * once here.
+	     */
 	    infoPtr->token = VALUE;
+	    ExprInitValue(&value);
+	    value.pv.noEval = 1;
 	    result = MpParseQuotes(interp, infoPtr->expr, '"', 1,
-		        &infoPtr->expr, &valuePtr->pv);
+		        &term, &value.pv);
 	    if (result != TCL_OK) {
+		infoPtr->expr = term;
+		ExprFreeValue(&value);
 		return result;
 	    }
 	    Tcl_ResetResult(interp);
-	    return ExprParseString(interp, valuePtr->pv.buffer, valuePtr);
+	    for (s = p+1; s < term; s++) {
+		if ((*s == '$') || (*s == '[')) {
+		    break;
+		}
+	    }
+	    if (s < term) {
+		infoPtr->nodePtr = ExprNewNode(EXPR_QUOTES, 0, 0);
+		infoPtr->nodePtr->string = ExprCopyText(p+1, term);
+		result = TCL_OK;
+	    } else {
+		value.pv.noEval = 0;
+		result = ExprParseString(interp, value.pv.buffer, &value);
+		if (result == TCL_OK) {
+		    infoPtr->nodePtr = ExprLiteralNode(&value);
+		}
+	    }
+	    infoPtr->expr = term;
+	    ExprFreeValue(&value);
+	    return result;
 
 	case '{':
 	    infoPtr->token = VALUE;
+	    ExprInitValue(&value);
 	    result = MpParseBraces(interp, infoPtr->expr, &infoPtr->expr,
-		    &valuePtr->pv);
-	    if (result != TCL_OK) {
-		return result;
+		    &value.pv);
+	    if (result == TCL_OK) {
+		Tcl_ResetResult(interp);
+		result = ExprParseString(interp, value.pv.buffer, &value);
+		if (result == TCL_OK) {
+		    infoPtr->nodePtr = ExprLiteralNode(&value);
+		}
 	    }
-	    Tcl_ResetResult(interp);
-	    return ExprParseString(interp, valuePtr->pv.buffer, valuePtr);
+	    ExprFreeValue(&value);
+	    return result;
 
 	case '(':
 	    infoPtr->token = OPEN_PAREN;
@@ -759,7 +1157,7 @@ ExprLex(interp, infoPtr, valuePtr, mdPtr)
 	default:
 	    if (isalpha(UCHAR(*p))) {
 		infoPtr->expr = p;
-		return ExprMathFunc(interp, infoPtr, valuePtr, mdPtr);
+		return ExprParseMathFunc(interp, infoPtr, mdPtr);
 	    }
 	    infoPtr->expr = p+1;
 	    infoPtr->token = UNKNOWN;
@@ -816,17 +1214,17 @@ ExprConvDoubleToInt(valuePtr)
 /*
  *----------------------------------------------------------------------
  *
- * ExprGetValue --
+ * ExprParseValue --
  *
- *	Parse a "value" from the remainder of the expression in infoPtr.
+ *	Parse a "value" from the remainder of the expression in infoPtr
+ *	and build the tree of nodes that computes it.
  *
  * Results:
- *	Normally TCL_OK is returned.  The value of the expression is
- *	returned in *valuePtr.  If an error occurred, then the interpreter result
- *	contains an error message and TCL_ERROR is returned.
- *	InfoPtr->token will be left pointing to the token AFTER the
- *	expression, and infoPtr->expr will point to the character just
- *	after the terminating token.
+ *	Normally the top node of the value's tree is returned.  If an
+ *	error occurred, then the interpreter result contains an error
+ *	message and NULL is returned.  InfoPtr->token will be left
+ *	pointing to the token AFTER the expression, and infoPtr->expr
+ *	will point to the character just after the terminating token.
  *
  * Side effects:
  *	None.
@@ -834,8 +1232,8 @@ ExprConvDoubleToInt(valuePtr)
  *----------------------------------------------------------------------
  */
 
-static int
-ExprGetValue(interp, infoPtr, prec, valuePtr, mdPtr)
+static ExprNode *
+ExprParseValue(interp, infoPtr, prec, mdPtr)
     Tcl_Interp *interp;			/* Interpreter to use for error
 					 * reporting. */
     register ExprInfo *infoPtr;		/* Describes the state of the parse
@@ -845,49 +1243,22 @@ ExprGetValue(interp, infoPtr, prec, valuePtr, mdPtr)
     int prec;				/* Treat any un-parenthesized operator
 					 * with precedence <= this as the end
 					 * of the expression. */
-    Mp_Value *valuePtr;			/* Where to store the value of the
-					 * expression.   Caller must have
-					 * initialized pv field. */
     Mp_Data *mdPtr;
 {
-    Mp_Value value2;			/* Second operand for current
-					 * operator.  */
+    ExprNode *nodePtr = NULL;		/* Tree built so far. */
+    ExprNode *operandPtr;		/* Operand for current operator. */
+    ExprNode *thirdPtr;			/* Else part of ?: operator. */
+    ExprNode *newPtr;
     int operator;			/* Current operator (either unary
 					 * or binary). */
-    int badType;			/* Type of offending argument;  used
-					 * for error messages. */
-    int gotOp;				/* Non-zero means already lexed the
-					 * operator (while picking up value
-					 * for unary operator).  Don't lex
-					 * again. */
-    int result;
-
-    ZVALUE  z_tmp;
-    ZVALUE  z_div;
-    ZVALUE  z_quot;
-    ZVALUE  z_rem;
-    long    l_shift;
-
-    NUMBER  *q_tmp;
-
-    value2.intValue    = _zero_;
-    value2.doubleValue = qlink(&_qzero_);
-    value2.type        = MP_UNDEF;
 
     /*
      * There are two phases to this procedure.  First, pick off an initial
      * value.  Then, parse (binary operator, value) pairs until done.
      */
 
-    gotOp = 0;
-    value2.pv.buffer = value2.pv.next = value2.staticSpace;
-    value2.pv.end = value2.pv.buffer + STATIC_STRING_SPACE - 1;
-    value2.pv.expandProc = MpExpandParseValue;
-    value2.pv.clientData = (ClientData) NULL;
-    value2.pv.noEval = valuePtr->pv.noEval;
-    result = ExprLex(interp, infoPtr, valuePtr, mdPtr);
-    if (result != TCL_OK) {
-	goto done;
+    if (ExprLex(interp, infoPtr, mdPtr) != TCL_OK) {
+	return NULL;
     }
     if (infoPtr->token == OPEN_PAREN) {
 
@@ -895,15 +1266,17 @@ ExprGetValue(interp, infoPtr, prec, valuePtr, mdPtr)
 	 * Parenthesized sub-expression.
 	 */
 
-	result = ExprGetValue(interp, infoPtr, -1, valuePtr, mdPtr);
-	if (result != TCL_OK) {
-	    goto done;
+	nodePtr = ExprParseValue(interp, infoPtr, -1, mdPtr);
+	if (nodePtr == NULL) {
+	    return NULL;
 	}
 	if (infoPtr->token != CLOSE_PAREN) {
 	    Tcl_AppendResult(interp, "unmatched parentheses in expression \"",
 		    infoPtr->originalExpr, "\"", (char *) NULL);
-	    result = TCL_ERROR;
-	    goto done;
+	    goto error;
+	}
+	if (ExprLex(interp, infoPtr, mdPtr) != TCL_OK) {
+	    goto error;
 	}
     } else {
 	if (infoPtr->token == MINUS) {
@@ -915,74 +1288,25 @@ ExprGetValue(interp, infoPtr, prec, valuePtr, mdPtr)
 	if (infoPtr->token >= UNARY_MINUS) {
 
 	    /*
-	     * Process unary operators.
+	     * Process unary operators.  The operand's parse leaves the
+	     * following operator in infoPtr->token.
 	     */
 
 	    operator = infoPtr->token;
-	    result = ExprGetValue(interp, infoPtr, precTable[infoPtr->token],
-		    valuePtr, mdPtr);
-	    if (result != TCL_OK) {
-		goto done;
+	    operandPtr = ExprParseValue(interp, infoPtr, precTable[operator],
+		    mdPtr);
+	    if (operandPtr == NULL) {
+		return NULL;
 	    }
-	    if (!valuePtr->pv.noEval) {
-		switch (operator) {
-		    case UNARY_MINUS:
-			if (valuePtr->type == MP_INT) {
-			    zneg(valuePtr->intValue);
-			} else if (valuePtr->type == MP_DOUBLE){
-			    q_tmp = qneg(valuePtr->doubleValue);
-			    Qfree(valuePtr->doubleValue);
-			    valuePtr->doubleValue = q_tmp;
-			} else {
-			    badType = valuePtr->type;
-			    goto illegalType;
-			}
-			break;
-		    case UNARY_PLUS:
-			if ((valuePtr->type != MP_INT)
-				&& (valuePtr->type != MP_DOUBLE)) {
-			    badType = valuePtr->type;
-			    goto illegalType;
-			}
-			break;
-		    case NOT:
-			if (valuePtr->type == MP_INT) {
-			    if (ziszero(valuePtr->intValue)) {
-			        zfree(valuePtr->intValue);
-				valuePtr->intValue = _one_;
-			    } else {
-			        zfree(valuePtr->intValue);
-				valuePtr->intValue = _zero_;
-			    }
-			} else if (valuePtr->type == MP_DOUBLE) {
-			    zfree(valuePtr->intValue);
-			    if (qiszero(valuePtr->doubleValue)) {
-				valuePtr->intValue = _one_;
-			    } else {
-				valuePtr->intValue = _zero_;
-			    }
-			    valuePtr->type = MP_INT;
-			} else {
-			    badType = valuePtr->type;
-			    goto illegalType;
-			}
-			break;
-		    case BIT_NOT:
-			if (valuePtr->type == MP_INT) {
-			    zneg(valuePtr->intValue);
-			    zsub(valuePtr->intValue, _one_, &z_tmp);
-			    zfree(valuePtr->intValue);
-			    zcopy(z_tmp, &valuePtr->intValue);
-			    zfree(z_tmp);
-			} else {
-			    badType  = valuePtr->type;
-			    goto illegalType;
-			}
-			break;
-		}
+	    nodePtr = ExprNewNode(EXPR_UNARY, operator, 1);
+	    nodePtr->args[0] = operandPtr;
+	} else if (infoPtr->token == VALUE) {
+	    nodePtr = infoPtr->nodePtr;
+	    infoPtr->nodePtr = NULL;
+	    if (ExprLex(interp, infoPtr, mdPtr) != TCL_OK) {
+		goto error;
 	    }
-	    gotOp = 1;
-	} else if (infoPtr->token != VALUE) {
+	} else {
 	    goto syntaxError;
 	}
     }
@@ -991,1183 +1315,2722 @@ ExprGetValue(interp, infoPtr, prec, valuePtr, mdPtr)
      * Got the first operand.  Now fetch (operator, operand) pairs.
      */
 
-    if (!gotOp) {
-	result = ExprLex(interp, infoPtr, &value2, mdPtr);
-	if (result != TCL_OK) {
-	    goto done;
-	}
-    }
     while (1) {
 	operator = infoPtr->token;
-	value2.pv.next = value2.pv.buffer;
 	if ((operator < MULT) || (operator >= UNARY_MINUS)) {
 	    if ((operator == END) || (operator == CLOSE_PAREN)
 		    || (operator == COMMA)) {
-		result = TCL_OK;
-		goto done;
+		return nodePtr;
 	    } else {
 		goto syntaxError;
 	    }
 	}
 	if (precTable[operator] <= prec) {
-	    result = TCL_OK;
-	    goto done;
+	    return nodePtr;
 	}
 
-	/*
-	 * If we're doing an AND or OR and the first operand already
-	 * determines the result, don't execute anything in the
-	 * second operand:  just parse.  Same style for ?: pairs.
-	 */
+	if (operator == QUESTY) {
+	    /*
+	     * Special note:  ?: operators must associate right to
+	     * left.  To make this happen, use a precedence one lower
+	     * than QUESTY when calling ExprParseValue recursively.
+	     */
 
-	if ((operator == AND) || (operator == OR) || (operator == QUESTY)) {
-	    if (valuePtr->type == MP_DOUBLE) {
-		zfree(valuePtr->intValue);
-		valuePtr->intValue = qiszero(valuePtr->doubleValue) ?
-							_zero_ : _one_;
-		valuePtr->type = MP_INT;
-	    } else if (valuePtr->type == MP_STRING) {
-		if (!valuePtr->pv.noEval) {
-		    badType = MP_STRING;
-		    goto illegalType;
-		}
-
-		/*
-		 * Must set valuePtr->intValue to avoid referencing
-		 * uninitialized memory in the "if" below;  the actual
-		 * value doesn't matter, since it will be ignored.
-		 */
-
-		zfree(valuePtr->intValue);
-		valuePtr->intValue = _zero_;
+	    operandPtr = ExprParseValue(interp, infoPtr,
+		    precTable[QUESTY] - 1, mdPtr);
+	    if (operandPtr == NULL) {
+		goto error;
 	    }
-	    if ( ((operator == AND) && ziszero(valuePtr->intValue))
-		    || ((operator == OR) && !(ziszero(valuePtr->intValue)))) {
-		value2.pv.noEval++;
-		result = ExprGetValue(interp, infoPtr, precTable[operator],
-			&value2, mdPtr);
-		value2.pv.noEval--;
-		if (result != TCL_OK) {
-		    goto done;
-		}
-		if (operator == OR) {
-		    zfree(valuePtr->intValue);
-		    valuePtr->intValue = _one_;
-		}
-		continue;
-	    } else if (operator == QUESTY) {
-		/*
-		 * Special note:  ?: operators must associate right to
-		 * left.  To make this happen, use a precedence one lower
-		 * than QUESTY when calling ExprGetValue recursively.
-		 */
-
-		if (! ziszero(valuePtr->intValue)) {
-		    valuePtr->pv.next = valuePtr->pv.buffer;
-		    result = ExprGetValue(interp, infoPtr,
-			    precTable[QUESTY] - 1, valuePtr, mdPtr);
-		    if (result != TCL_OK) {
-			goto done;
-		    }
-		    if (infoPtr->token != COLON) {
-			goto syntaxError;
-		    }
-		    value2.pv.next = value2.pv.buffer;
-		    value2.pv.noEval++;
-		    result = ExprGetValue(interp, infoPtr,
-			    precTable[QUESTY] - 1, &value2, mdPtr);
-		    value2.pv.noEval--;
-		} else {
-		    value2.pv.noEval++;
-		    result = ExprGetValue(interp, infoPtr,
-			    precTable[QUESTY] - 1, &value2, mdPtr);
-		    value2.pv.noEval--;
-		    if (result != TCL_OK) {
-			goto done;
-		    }
-		    if (infoPtr->token != COLON) {
-			goto syntaxError;
-		    }
-		    valuePtr->pv.next = valuePtr->pv.buffer;
-		    result = ExprGetValue(interp, infoPtr,
-			    precTable[QUESTY] - 1, valuePtr, mdPtr);
-		    if (result != TCL_OK) {
-			goto done;
-		    }
-		}
-		continue;
-	    } else {
-		result = ExprGetValue(interp, infoPtr, precTable[operator],
-			&value2, mdPtr);
+	    if (infoPtr->token != COLON) {
+		ExprFreeNode(operandPtr);
+		goto syntaxError;
 	    }
-	} else {
-	    result = ExprGetValue(interp, infoPtr, precTable[operator],
-		    &value2, mdPtr);
+	    thirdPtr = ExprParseValue(interp, infoPtr,
+		    precTable[QUESTY] - 1, mdPtr);
+	    if (thirdPtr == NULL) {
+		ExprFreeNode(operandPtr);
+		goto error;
+	    }
+	    newPtr = ExprNewNode(EXPR_TERNARY, QUESTY, 3);
+	    newPtr->args[0] = nodePtr;
+	    newPtr->args[1] = operandPtr;
+	    newPtr->args[2] = thirdPtr;
+	    nodePtr = newPtr;
+	    continue;
 	}
-	if (result != TCL_OK) {
-	    goto done;
+
+	operandPtr = ExprParseValue(interp, infoPtr, precTable[operator],
+		mdPtr);
+	if (operandPtr == NULL) {
+	    goto error;
 	}
+	newPtr = ExprNewNode(EXPR_BINARY, operator, 2);
+	newPtr->args[0] = nodePtr;
+	newPtr->args[1] = operandPtr;
+	nodePtr = newPtr;
 	if ((infoPtr->token < MULT) && (infoPtr->token != VALUE)
 		&& (infoPtr->token != END) && (infoPtr->token != COMMA)
 		&& (infoPtr->token != CLOSE_PAREN)) {
 	    goto syntaxError;
 	}
+    }
 
-	if (valuePtr->pv.noEval) {
-	    continue;
-	}
+    syntaxError:
+    Tcl_AppendResult(interp, "syntax error in expression \"",
+	    infoPtr->originalExpr, "\"", (char *) NULL);
 
-	/*
-	 * At this point we've got two values and an operator.  Check
-	 * to make sure that the particular data types are appropriate
-	 * for the particular operator, and perform type conversion
-	 * if necessary.
-	 */
+    error:
+    if (nodePtr != NULL) {
+	ExprFreeNode(nodePtr);
+    }
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExprEvalNode --
+ *
+ *	Compute the value of a node of a compiled expression.
+ *
+ * Results:
+ *	Normally TCL_OK is returned.  The value of the expression is
+ *	returned in *valuePtr.  If an error occurred, then the interpreter
+ *	result contains an error message and TCL_ERROR is returned.
+ *
+ * Side effects:
+ *	Embedded commands could have arbitrary side-effects.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExprEvalNode(interp, nodePtr, valuePtr, mdPtr)
+    Tcl_Interp *interp;			/* Interpreter to use for variables,
+					 * commands and error reporting. */
+    ExprNode *nodePtr;			/* Node to evaluate. */
+    Mp_Value *valuePtr;			/* Where to store the value of the
+					 * expression.   Caller must have
+					 * initialized pv field. */
+    Mp_Data *mdPtr;
+{
+    Mp_Value value2;			/* Second operand for current
+					 * operator.  */
+    int operator;			/* Current operator (either unary
+					 * or binary). */
+    int badType;			/* Type of offending argument;  used
+					 * for error messages. */
+    int result;
+    Tcl_Obj *objPtr;
+    CONST char *term;
+
+    ZVALUE  z_tmp;
+    ZVALUE  z_div;
+    ZVALUE  z_quot;
+    ZVALUE  z_rem;
+    long    l_shift;
+
+    NUMBER  *q_tmp;
+
+    /*
+     * Literals, and folded nodes whose value has already been computed
+     * (with the current precision, if it matters), just copy the value
+     * out of the node.
+     */
 
+    if ((nodePtr->kind == EXPR_LITERAL) || ((nodePtr->foldPrec >= 0)
+	    && ((nodePtr->fold == EXPR_FOLD_EXACT)
+		|| (nodePtr->foldPrec == mdPtr->precision)))) {
+	if (nodePtr->type == MP_INT) {
+	    zfree(valuePtr->intValue);
+	    zcopy(nodePtr->intValue, &valuePtr->intValue);
+	} else if (nodePtr->type == MP_DOUBLE) {
+	    Qfree(valuePtr->doubleValue);
+	    valuePtr->doubleValue = qlink(nodePtr->doubleValue);
+	} else {
+	    int shortfall;
+
+	    valuePtr->pv.next = valuePtr->pv.buffer;
+	    shortfall = strlen(nodePtr->string) -
+		    (valuePtr->pv.end - valuePtr->pv.buffer);
+	    if (shortfall > 0) {
+		(*valuePtr->pv.expandProc)(&valuePtr->pv, shortfall);
+	    }
+	    strcpy(valuePtr->pv.buffer, nodePtr->string);
+	}
+	valuePtr->type = nodePtr->type;
+	return TCL_OK;
+    }
 
-	switch (operator) {
+    ExprInitValue(&value2);
+    operator = nodePtr->operator;
+    result = TCL_OK;
 
+    switch (nodePtr->kind) {
+	case EXPR_VARIABLE:
 	    /*
-	     * For the operators below, no strings are allowed and
-	     * ints get converted to floats if necessary.
+	     * Variable.  Fetch its value, then see if it makes sense
+	     * as an integer or floating-point number.
 	     */
+	    objPtr = NULL;
+	    if ((operator == EXPR_SCALAR) && (mdPtr->numBindings > 0)) {
+		int i;
 
-	    case MULT: case DIVIDE: case PLUS: case MINUS:
-		if ((valuePtr->type == MP_STRING)
-			|| (value2.type == MP_STRING)) {
-		    badType = MP_STRING;
-		    goto illegalType;
-		}
-		if (valuePtr->type == MP_DOUBLE) {
-		    if (value2.type == MP_INT) {
-			ExprConvIntToDouble(&value2);
-		    }
-		} else if (value2.type == MP_DOUBLE) {
-		    if (valuePtr->type == MP_INT) {
-			ExprConvIntToDouble(valuePtr);
+		for (i = 0; i < mdPtr->numBindings; i++) {
+		    if (strcmp(mdPtr->bindNames[i], nodePtr->string+1) == 0) {
+			objPtr = mdPtr->bindValues[i];
+			break;
 		    }
 		}
-		break;
+	    }
+	    if (objPtr == NULL) {
+		objPtr = Mp_ParseVarObj(interp, nodePtr->string);
+		if (objPtr == NULL) {
+		    result = TCL_ERROR;
+		    goto done;
+		}
+		Tcl_ResetResult(interp);
+	    }
+	    result = ExprGetObjValue(interp, objPtr, valuePtr);
+	    goto done;
 
-	    /*
-	     * For the operators below, only integers are allowed.
-	     */
+	case EXPR_COMMAND:
+	    valuePtr->pv.next = valuePtr->pv.buffer;
+	    result = MpParseNestedCmd(interp, nodePtr->string, 1, &term,
+		    &valuePtr->pv);
+	    if (result != TCL_OK) {
+		valuePtr->type = MP_INT;
+		zfree(valuePtr->intValue);
+		valuePtr->intValue = _zero_;
+		goto done;
+	    }
+	    result = ExprParseString(interp, valuePtr->pv.buffer, valuePtr);
+	    if (result == TCL_OK) {
+		Tcl_ResetResult(interp);
+	    }
+	    goto done;
 
-	    case MOD: case LEFT_SHIFT: case RIGHT_SHIFT:
-	    case BIT_AND: case BIT_XOR: case BIT_OR:
-		 if (valuePtr->type != MP_INT) {
-		     badType = valuePtr->type;
-		     goto illegalType;
-		 } else if (value2.type != MP_INT) {
-		     badType = value2.type;
-		     goto illegalType;
-		 }
-		 break;
+	case EXPR_QUOTES:
+	    valuePtr->pv.next = valuePtr->pv.buffer;
+	    result = MpParseQuotes(interp, nodePtr->string, '"', 1, &term,
+		    &valuePtr->pv);
+	    if (result != TCL_OK) {
+		goto done;
+	    }
+	    Tcl_ResetResult(interp);
+	    result = ExprParseString(interp, valuePtr->pv.buffer, valuePtr);
+	    goto done;
 
-	    /*
-	     * For the operators below, any type is allowed but the
-	     * two operands must have the same type.  Convert integers
-	     * to floats and either to strings, if necessary.
-	     */
+	case EXPR_FUNC:
+	    result = ExprEvalMathFunc(interp, nodePtr, valuePtr, mdPtr);
+	    goto done;
 
-	    case LESS: case GREATER: case LEQ: case GEQ:
-	    case EQUAL: case NEQ:
-		if (valuePtr->type == MP_STRING) {
-		    if (value2.type != MP_STRING) {
-			ExprMakeString(mdPtr->precision, &value2);
+	case EXPR_UNARY:
+	    result = ExprEvalNode(interp, nodePtr->args[0], valuePtr, mdPtr);
+	    if (result != TCL_OK) {
+		goto done;
+	    }
+	    switch (operator) {
+		case UNARY_MINUS:
+		    if (valuePtr->type == MP_INT) {
+			zneg(valuePtr->intValue);
+		    } else if (valuePtr->type == MP_DOUBLE){
+			q_tmp = qneg(valuePtr->doubleValue);
+			Qfree(valuePtr->doubleValue);
+			valuePtr->doubleValue = q_tmp;
+		    } else {
+			badType = valuePtr->type;
+			goto illegalType;
 		    }
-		} else if (value2.type == MP_STRING) {
-		    if (valuePtr->type != MP_STRING) {
-			ExprMakeString(mdPtr->precision, valuePtr);
+		    break;
+		case UNARY_PLUS:
+		    if ((valuePtr->type != MP_INT)
+			    && (valuePtr->type != MP_DOUBLE)) {
+			badType = valuePtr->type;
+			goto illegalType;
 		    }
-		} else if (valuePtr->type == MP_DOUBLE) {
-		    if (value2.type == MP_INT) {
-			ExprConvIntToDouble(&value2);
+		    break;
+		case NOT:
+		    if (valuePtr->type == MP_INT) {
+			if (ziszero(valuePtr->intValue)) {
+			    zfree(valuePtr->intValue);
+			    valuePtr->intValue = _one_;
+			} else {
+			    zfree(valuePtr->intValue);
+			    valuePtr->intValue = _zero_;
+			}
+		    } else if (valuePtr->type == MP_DOUBLE) {
+			zfree(valuePtr->intValue);
+			if (qiszero(valuePtr->doubleValue)) {
+			    valuePtr->intValue = _one_;
+			} else {
+			    valuePtr->intValue = _zero_;
+			}
+			valuePtr->type = MP_INT;
+		    } else {
+			badType = valuePtr->type;
+			goto illegalType;
 		    }
-		} else if (value2.type == MP_DOUBLE) {
+		    break;
+		case BIT_NOT:
 		    if (valuePtr->type == MP_INT) {
-		        ExprConvIntToDouble(valuePtr);
+			zneg(valuePtr->intValue);
+			zsub(valuePtr->intValue, _one_, &z_tmp);
+			zfree(valuePtr->intValue);
+			valuePtr->intValue = z_tmp;
+		    } else {
+			badType  = valuePtr->type;
+			goto illegalType;
 		    }
-		}
-		break;
-
-	    /*
-	     * For the operators below, no strings are allowed, but
-	     * no int->double conversions are performed.
-	     */
+		    break;
+	    }
+	    goto done;
 
-	    case AND: case OR:
-		if (valuePtr->type == MP_STRING) {
-		    badType = valuePtr->type;
-		    goto illegalType;
-		}
-		if (value2.type == MP_STRING) {
-		    badType = value2.type;
-		    goto illegalType;
-		}
-		break;
+	case EXPR_TERNARY:
+	case EXPR_BINARY:
+	    result = ExprEvalNode(interp, nodePtr->args[0], valuePtr, mdPtr);
+	    if (result != TCL_OK) {
+		goto done;
+	    }
+	    break;
+    }
 
-	    /*
-	     * For the operators below, type and conversions are
-	     * irrelevant:  they're handled elsewhere.
-	     */
+    /*
+     * If we're doing an AND or OR and the first operand already
+     * determines the result, don't evaluate the second operand.
+     * Same style for ?: triples.
+     */
 
-	    case QUESTY: case COLON:
-		break;
+    if ((operator == AND) || (operator == OR) || (operator == QUESTY)) {
+	if (valuePtr->type == MP_DOUBLE) {
+	    zfree(valuePtr->intValue);
+	    valuePtr->intValue = qiszero(valuePtr->doubleValue) ?
+							_zero_ : _one_;
+	    valuePtr->type = MP_INT;
+	} else if (valuePtr->type == MP_STRING) {
+	    badType = MP_STRING;
+	    goto illegalType;
+	}
+	if ( ((operator == AND) && ziszero(valuePtr->intValue))
+		|| ((operator == OR) && !(ziszero(valuePtr->intValue)))) {
+	    if (operator == OR) {
+		zfree(valuePtr->intValue);
+		valuePtr->intValue = _one_;
+	    }
+	    goto done;
+	} else if (operator == QUESTY) {
+	    valuePtr->pv.next = valuePtr->pv.buffer;
+	    result = ExprEvalNode(interp,
+		    nodePtr->args[ziszero(valuePtr->intValue) ? 2 : 1],
+		    valuePtr, mdPtr);
+	    goto done;
+	}
+    }
 
-	    /*
-	     * Any other operator is an error.
-	     */
+    result = ExprEvalNode(interp, nodePtr->args[1], &value2, mdPtr);
+    if (result != TCL_OK) {
+	goto done;
+    }
+    /*
+     * At this point we've got two values and an operator.  Check
+     * to make sure that the particular data types are appropriate
+     * for the particular operator, and perform type conversion
+     * if necessary.
+     */
 
-	    default:
-		Tcl_SetResult(interp, "unknown operator in expression", TCL_STATIC);
-		result = TCL_ERROR;
-		goto done;
-	}
 
+    switch (operator) {
 
 	/*
-	 * Carry out the function of the specified operator.
+	 * For the operators below, no strings are allowed and
+	 * ints get converted to floats if necessary.
 	 */
 
-	switch (operator) {
-	    case MULT:
-		if (valuePtr->type == MP_INT) {
-		    zmul(valuePtr->intValue, value2.intValue, &z_tmp);
-		    zfree(valuePtr->intValue);
-		    zcopy(z_tmp, &valuePtr->intValue);
-		    zfree(z_tmp);
-		} else {
-		    q_tmp = qmul(valuePtr->doubleValue, value2.doubleValue);
-		    Qfree(valuePtr->doubleValue);
-		    valuePtr->doubleValue = q_tmp;
+	case MULT: case DIVIDE: case PLUS: case MINUS:
+	    if ((valuePtr->type == MP_STRING)
+		    || (value2.type == MP_STRING)) {
+		badType = MP_STRING;
+		goto illegalType;
+	    }
+	    if (valuePtr->type == MP_DOUBLE) {
+		if (value2.type == MP_INT) {
+		    ExprConvIntToDouble(&value2);
 		}
-		break;
-	    case DIVIDE:
-	    case MOD:
+	    } else if (value2.type == MP_DOUBLE) {
 		if (valuePtr->type == MP_INT) {
-		    int negative1, negative2;
-
-		    if (ziszero(value2.intValue)) {
-			divideByZero:
-			Tcl_SetResult(interp, "divide by zero", TCL_STATIC);
-			Tcl_SetErrorCode(interp, "ARITH", "DIVZERO",
-				Tcl_GetStringResult(interp), (char *) NULL);
-			result = TCL_ERROR;
-			goto done;
-		    }
+		    ExprConvIntToDouble(valuePtr);
+		}
+	    }
+	    break;
 
-		    /* follow Tcl conventions: remainder is always a smaller
-		     * absolute value and same sign as divisor
-		     */
+	/*
+	 * For the operators below, only integers are allowed.
+	 */
 
-		    if (ziszero(valuePtr->intValue)) {
-  			zfree(valuePtr->intValue);
-			valuePtr->intValue = _zero_;
-			break;
-		    }
+	case MOD: case LEFT_SHIFT: case RIGHT_SHIFT:
+	case BIT_AND: case BIT_XOR: case BIT_OR:
+	     if (valuePtr->type != MP_INT) {
+		 badType = valuePtr->type;
+		 goto illegalType;
+	     } else if (value2.type != MP_INT) {
+		 badType = value2.type;
+		 goto illegalType;
+	     }
+	     break;
 
-		    negative1 = 0;
-		    if (zisneg(valuePtr->intValue)) {
-		        zneg(valuePtr->intValue);
-			negative1 = 1;
-		    }
+	/*
+	 * For the operators below, any type is allowed but the
+	 * two operands must have the same type.  Convert integers
+	 * to floats and either to strings, if necessary.
+	 */
 
-		    zcopy(value2.intValue, &z_div);
-		    negative2 = 0;
-		    if (zisneg(z_div)) {
-			zneg(z_div);
-			negative2 = 1;
-		    }
-		    zdiv(valuePtr->intValue, z_div, &z_quot, &z_rem);
-		    if (operator == DIVIDE) {
-		        if ((negative1 != negative2) && !ziszero(z_rem) ) {
-                            if (!zisneg(z_quot)) {
-			        zneg(z_quot);
-			    }
-			    zsub(z_quot, _one_, &z_tmp);
-			    zfree(z_quot);
-			    zcopy(z_tmp, &z_quot);
-			    zfree(z_tmp);
-			} else {
-		            if ((negative1 != negative2)) {
-                                if (!zisneg(z_quot)) {
-			            zneg(z_quot);
-			        }
-			    }
-			}
-		        zfree(valuePtr->intValue);
-		        zcopy(z_quot, &valuePtr->intValue);
-		    } else {
-			if ((negative1 != negative2) && !ziszero(z_rem)) {
-                            if (ziszero(z_rem)) {
-                                zneg(z_rem);
-                            }
-			    zsub(z_div, z_rem, &z_tmp);
-			    zfree(z_rem);
-			    zcopy(z_tmp, &z_rem);
-			    zfree(z_tmp);
-		        }
-			if (negative2 && !ziszero(z_rem)) {
-			    zneg(z_rem);
-			}
-		        zfree(valuePtr->intValue);
-		        zcopy(z_rem,  &valuePtr->intValue);
-		    }
-		    zfree(z_quot);
-		    zfree(z_rem);
-		    zfree(z_div);
-		} else {
-		    if (qiszero(value2.doubleValue)) {
-			goto divideByZero;
-		    }
-		    q_tmp = qdiv(valuePtr->doubleValue, value2.doubleValue);
-		    Qfree(valuePtr->doubleValue);
-		    valuePtr->doubleValue = q_tmp;
-		}
-		break;
-	    case PLUS:
-		if (valuePtr->type == MP_INT) {
-		    zadd(valuePtr->intValue, value2.intValue, &z_tmp);
-		    zfree(valuePtr->intValue);
-		    zcopy(z_tmp, &valuePtr->intValue);
-		    zfree(z_tmp);
-		} else {
-		    q_tmp = qadd(valuePtr->doubleValue, value2.doubleValue);
-		    Qfree(valuePtr->doubleValue);
-		    valuePtr->doubleValue = q_tmp;
+	case LESS: case GREATER: case LEQ: case GEQ:
+	case EQUAL: case NEQ:
+	    if (valuePtr->type == MP_STRING) {
+		if (value2.type != MP_STRING) {
+		    ExprMakeString(mdPtr->precision, &value2);
 		}
-		break;
-	    case MINUS:
-		if (valuePtr->type == MP_INT) {
-		    zsub(valuePtr->intValue, value2.intValue, &z_tmp);
-		    zfree(valuePtr->intValue);
-		    zcopy(z_tmp, &valuePtr->intValue);
-		    zfree(z_tmp);
-		} else {
-		    q_tmp = qsub(valuePtr->doubleValue, value2.doubleValue);
-		    Qfree(valuePtr->doubleValue);
-		    valuePtr->doubleValue = q_tmp;
+	    } else if (value2.type == MP_STRING) {
+		if (valuePtr->type != MP_STRING) {
+		    ExprMakeString(mdPtr->precision, valuePtr);
 		}
-		break;
-	    case LEFT_SHIFT:
-		l_shift = ztoi(value2.intValue);
-		zshift(valuePtr->intValue, l_shift, &z_tmp);
-		zfree(valuePtr->intValue);
-		zcopy(z_tmp, &valuePtr->intValue);
-		zfree(z_tmp);
-		break;
-	    case RIGHT_SHIFT:
-		l_shift = ztoi(value2.intValue);
-		zshift(valuePtr->intValue, (-l_shift), &z_tmp);
-		zfree(valuePtr->intValue);
-		zcopy(z_tmp, &valuePtr->intValue);
-		zfree(z_tmp);
-		break;
-	    case LESS:
-		if (valuePtr->type == MP_INT) {
-		    if (zrel(valuePtr->intValue,value2.intValue) == -1) {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _zero_;
-		    }
-		} else if (valuePtr->type == MP_DOUBLE) {
-		    if (qrel(valuePtr->doubleValue, value2.doubleValue) == -1) {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _zero_;
-		    }
-		} else {
-		    if (strcmp(valuePtr->pv.buffer, value2.pv.buffer) < 0) {
-		        zfree(valuePtr->intValue);
-		        valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-		        valuePtr->intValue = _zero_;
-		    }
+	    } else if (valuePtr->type == MP_DOUBLE) {
+		if (value2.type == MP_INT) {
+		    ExprConvIntToDouble(&value2);
 		}
-		valuePtr->type = MP_INT;
-		break;
-	    case GREATER:
+	    } else if (value2.type == MP_DOUBLE) {
 		if (valuePtr->type == MP_INT) {
-		    if (zrel(valuePtr->intValue,value2.intValue) == 1) {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _zero_;
-		    }
-		} else if (valuePtr->type == MP_DOUBLE) {
-		    if (qrel(valuePtr->doubleValue, value2.doubleValue) == 1) {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _zero_;
-		    }
-		} else {
-		    if (strcmp(valuePtr->pv.buffer, value2.pv.buffer) > 0) {
-		        zfree(valuePtr->intValue);
-		        valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-		        valuePtr->intValue = _zero_;
-		    }
+		    ExprConvIntToDouble(valuePtr);
 		}
-		valuePtr->type = MP_INT;
-		break;
-	    case LEQ:
-		if (valuePtr->type == MP_INT) {
-		    if (zrel(valuePtr->intValue,value2.intValue) == -1 ||
-			zcmp(valuePtr->intValue,value2.intValue) ==  0) {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _zero_;
-		    }
-		} else if (valuePtr->type == MP_DOUBLE) {
-		    if (qrel(valuePtr->doubleValue, value2.doubleValue) == -1 ||
-		        qcmp(valuePtr->doubleValue, value2.doubleValue) ==  0) {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _zero_;
-		    }
-		} else {
-		    if (strcmp(valuePtr->pv.buffer, value2.pv.buffer) <= 0) {
-		        zfree(valuePtr->intValue);
-		        valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-		        valuePtr->intValue = _zero_;
-		    }
+	    }
+	    break;
+
+	/*
+	 * For the operators below, no strings are allowed, but
+	 * no int->double conversions are performed.
+	 */
+
+	case AND: case OR:
+	    if (valuePtr->type == MP_STRING) {
+		badType = valuePtr->type;
+		goto illegalType;
+	    }
+	    if (value2.type == MP_STRING) {
+		badType = value2.type;
+		goto illegalType;
+	    }
+	    break;
+
+	/*
+	 * For the operators below, type and conversions are
+	 * irrelevant:  they're handled elsewhere.
+	 */
+
+	case QUESTY: case COLON:
+	    break;
+
+	/*
+	 * Any other operator is an error.
+	 */
+
+	default:
+	    Tcl_SetResult(interp, "unknown operator in expression", TCL_STATIC);
+	    result = TCL_ERROR;
+	    goto done;
+    }
+
+
+    /*
+     * Carry out the function of the specified operator.
+     */
+
+    switch (operator) {
+	case MULT:
+	    if (valuePtr->type == MP_INT) {
+		zmul(valuePtr->intValue, value2.intValue, &z_tmp);
+		zfree(valuePtr->intValue);
+		valuePtr->intValue = z_tmp;
+	    } else {
+		q_tmp = qmul(valuePtr->doubleValue, value2.doubleValue);
+		Qfree(valuePtr->doubleValue);
+		valuePtr->doubleValue = q_tmp;
+	    }
+	    break;
+	case DIVIDE:
+	case MOD:
+	    if (valuePtr->type == MP_INT) {
+		int negative1, negative2;
+
+		if (ziszero(value2.intValue)) {
+		    divideByZero:
+		    Tcl_SetResult(interp, "divide by zero", TCL_STATIC);
+		    Tcl_SetErrorCode(interp, "ARITH", "DIVZERO",
+			    Tcl_GetStringResult(interp), (char *) NULL);
+		    result = TCL_ERROR;
+		    goto done;
 		}
-		valuePtr->type = MP_INT;
-		break;
-	    case GEQ:
-		if (valuePtr->type == MP_INT) {
-		    if (zrel(valuePtr->intValue,value2.intValue) ==  1 ||
-			zcmp(valuePtr->intValue,value2.intValue) ==  0) {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _zero_;
-		    }
-		} else if (valuePtr->type == MP_DOUBLE) {
-		    if (qrel(valuePtr->doubleValue, value2.doubleValue) == 1 ||
-		        qcmp(valuePtr->doubleValue, value2.doubleValue) ==  0) {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _zero_;
-		    }
-		} else {
-		    if (strcmp(valuePtr->pv.buffer, value2.pv.buffer) >= 0) {
-		        zfree(valuePtr->intValue);
-		        valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-		        valuePtr->intValue = _zero_;
-		    }
+
+		/* follow Tcl conventions: remainder is always a smaller
+		 * absolute value and same sign as divisor
+		 */
+
+		if (ziszero(valuePtr->intValue)) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
+		    break;
 		}
-		valuePtr->type = MP_INT;
-		break;
-	    case EQUAL:
-		if (valuePtr->type == MP_INT) {
-		    if (zcmp(valuePtr->intValue,value2.intValue) ==  0) {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _zero_;
-		    }
-		} else if (valuePtr->type == MP_DOUBLE) {
-		    if (qcmp(valuePtr->doubleValue, value2.doubleValue) ==  0) {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _zero_;
-		    }
-		} else {
-		    if (strcmp(valuePtr->pv.buffer, value2.pv.buffer) == 0) {
-		        zfree(valuePtr->intValue);
-		        valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-		        valuePtr->intValue = _zero_;
-		    }
+
+		negative1 = 0;
+		if (zisneg(valuePtr->intValue)) {
+		    zneg(valuePtr->intValue);
+		    negative1 = 1;
 		}
-		valuePtr->type = MP_INT;
-		break;
-	    case NEQ:
-		if (valuePtr->type == MP_INT) {
-		    if (zcmp(valuePtr->intValue,value2.intValue) !=  0) {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _zero_;
-		    }
-		} else if (valuePtr->type == MP_DOUBLE) {
-		    if (qcmp(valuePtr->doubleValue, value2.doubleValue) !=  0) {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _one_;
+
+		zcopy(value2.intValue, &z_div);
+		negative2 = 0;
+		if (zisneg(z_div)) {
+		    zneg(z_div);
+		    negative2 = 1;
+		}
+		zdiv(valuePtr->intValue, z_div, &z_quot, &z_rem);
+		if (operator == DIVIDE) {
+		    if ((negative1 != negative2) && !ziszero(z_rem) ) {
+			if (!zisneg(z_quot)) {
+			    zneg(z_quot);
+			}
+			zsub(z_quot, _one_, &z_tmp);
+			zfree(z_quot);
+			z_quot = z_tmp;
 		    } else {
-		        zfree(valuePtr->intValue);
-			valuePtr->intValue = _zero_;
+			if ((negative1 != negative2)) {
+			    if (!zisneg(z_quot)) {
+				zneg(z_quot);
+			    }
+			}
 		    }
+		    zfree(valuePtr->intValue);
+		    zcopy(z_quot, &valuePtr->intValue);
 		} else {
-		    if (strcmp(valuePtr->pv.buffer, value2.pv.buffer) != 0) {
-		        zfree(valuePtr->intValue);
-		        valuePtr->intValue = _one_;
-		    } else {
-		        zfree(valuePtr->intValue);
-		        valuePtr->intValue = _zero_;
+		    if ((negative1 != negative2) && !ziszero(z_rem)) {
+			if (ziszero(z_rem)) {
+			    zneg(z_rem);
+			}
+			zsub(z_div, z_rem, &z_tmp);
+			zfree(z_rem);
+			z_rem = z_tmp;
+		    }
+		    if (negative2 && !ziszero(z_rem)) {
+			zneg(z_rem);
 		    }
+		    zfree(valuePtr->intValue);
+		    zcopy(z_rem,  &valuePtr->intValue);
 		}
-		valuePtr->type = MP_INT;
-		break;
-	    case BIT_AND:
-		zand(valuePtr->intValue, value2.intValue, &z_tmp);
-		zfree(valuePtr->intValue);
-		zcopy(z_tmp, &valuePtr->intValue);
-		zfree(z_tmp);
-		break;
-	    case BIT_XOR:
-		zxor(valuePtr->intValue, value2.intValue, &z_tmp);
+		zfree(z_quot);
+		zfree(z_rem);
+		zfree(z_div);
+	    } else {
+		if (qiszero(value2.doubleValue)) {
+		    goto divideByZero;
+		}
+		q_tmp = qdiv(valuePtr->doubleValue, value2.doubleValue);
+		Qfree(valuePtr->doubleValue);
+		valuePtr->doubleValue = q_tmp;
+	    }
+	    break;
+	case PLUS:
+	    if (valuePtr->type == MP_INT) {
+		zadd(valuePtr->intValue, value2.intValue, &z_tmp);
 		zfree(valuePtr->intValue);
-		zcopy(z_tmp, &valuePtr->intValue);
-		zfree(z_tmp);
-		break;
-	    case BIT_OR:
-		zor(valuePtr->intValue, value2.intValue, &z_tmp);
+		valuePtr->intValue = z_tmp;
+	    } else {
+		q_tmp = qadd(valuePtr->doubleValue, value2.doubleValue);
+		Qfree(valuePtr->doubleValue);
+		valuePtr->doubleValue = q_tmp;
+	    }
+	    break;
+	case MINUS:
+	    if (valuePtr->type == MP_INT) {
+		zsub(valuePtr->intValue, value2.intValue, &z_tmp);
 		zfree(valuePtr->intValue);
-		zcopy(z_tmp, &valuePtr->intValue);
-		zfree(z_tmp);
-		break;
-
-	    /*
-	     * For AND and OR, we know that the first value has already
-	     * been converted to an integer.  Thus we need only consider
-	     * the possibility of int vs. double for the second value.
-	     */
-
-	    case AND:
-		if (value2.type == MP_DOUBLE) {
-		    if (!qiszero(value2.doubleValue)) {
-		        zfree(value2.intValue);
-			value2.intValue = _one_;
-		    } else {
-		        zfree(value2.intValue);
-			value2.intValue = _zero_;
-		    }
-		    zand(valuePtr->intValue, value2.intValue, &z_tmp);
+		valuePtr->intValue = z_tmp;
+	    } else {
+		q_tmp = qsub(valuePtr->doubleValue, value2.doubleValue);
+		Qfree(valuePtr->doubleValue);
+		valuePtr->doubleValue = q_tmp;
+	    }
+	    break;
+	case LEFT_SHIFT:
+	    l_shift = ztoi(value2.intValue);
+	    zshift(valuePtr->intValue, l_shift, &z_tmp);
+	    zfree(valuePtr->intValue);
+	    valuePtr->intValue = z_tmp;
+	    break;
+	case RIGHT_SHIFT:
+	    l_shift = ztoi(value2.intValue);
+	    zshift(valuePtr->intValue, (-l_shift), &z_tmp);
+	    zfree(valuePtr->intValue);
+	    valuePtr->intValue = z_tmp;
+	    break;
+	case LESS:
+	    if (valuePtr->type == MP_INT) {
+		if (zrel(valuePtr->intValue,value2.intValue) == -1) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
+		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
+		}
+	    } else if (valuePtr->type == MP_DOUBLE) {
+		if (qrel(valuePtr->doubleValue, value2.doubleValue) == -1) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
+		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
+		}
+	    } else {
+		if (strcmp(valuePtr->pv.buffer, value2.pv.buffer) < 0) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
+		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
+		}
+	    }
+	    valuePtr->type = MP_INT;
+	    break;
+	case GREATER:
+	    if (valuePtr->type == MP_INT) {
+		if (zrel(valuePtr->intValue,value2.intValue) == 1) {
 		    zfree(valuePtr->intValue);
-		    zcopy(z_tmp, &valuePtr->intValue);
-		    zfree(z_tmp);
-		    value2.type = MP_INT;
+		    valuePtr->intValue = _one_;
+		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
 		}
-		if (ziszero(valuePtr->intValue) || ziszero(value2.intValue)) {
+	    } else if (valuePtr->type == MP_DOUBLE) {
+		if (qrel(valuePtr->doubleValue, value2.doubleValue) == 1) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
+		} else {
 		    zfree(valuePtr->intValue);
 		    valuePtr->intValue = _zero_;
+		}
+	    } else {
+		if (strcmp(valuePtr->pv.buffer, value2.pv.buffer) > 0) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
 		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
+		}
+	    }
+	    valuePtr->type = MP_INT;
+	    break;
+	case LEQ:
+	    if (valuePtr->type == MP_INT) {
+		if (zrel(valuePtr->intValue,value2.intValue) == -1 ||
+		    zcmp(valuePtr->intValue,value2.intValue) ==  0) {
 		    zfree(valuePtr->intValue);
 		    valuePtr->intValue = _one_;
+		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
 		}
-		break;
-	    case OR:
-		if (value2.type == MP_DOUBLE) {
-		    if (!qiszero(value2.doubleValue)) {
-		        zfree(value2.intValue);
-			value2.intValue = _one_;
-		    } else {
-		        zfree(value2.intValue);
-			value2.intValue = _zero_;
-		    }
-		    value2.type = MP_INT;
+	    } else if (valuePtr->type == MP_DOUBLE) {
+		if (qrel(valuePtr->doubleValue, value2.doubleValue) == -1 ||
+		    qcmp(valuePtr->doubleValue, value2.doubleValue) ==  0) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
+		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
+		}
+	    } else {
+		if (strcmp(valuePtr->pv.buffer, value2.pv.buffer) <= 0) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
+		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
 		}
-		if (ziszero(valuePtr->intValue) && ziszero(value2.intValue)) {
+	    }
+	    valuePtr->type = MP_INT;
+	    break;
+	case GEQ:
+	    if (valuePtr->type == MP_INT) {
+		if (zrel(valuePtr->intValue,value2.intValue) ==  1 ||
+		    zcmp(valuePtr->intValue,value2.intValue) ==  0) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
+		} else {
 		    zfree(valuePtr->intValue);
 		    valuePtr->intValue = _zero_;
+		}
+	    } else if (valuePtr->type == MP_DOUBLE) {
+		if (qrel(valuePtr->doubleValue, value2.doubleValue) == 1 ||
+		    qcmp(valuePtr->doubleValue, value2.doubleValue) ==  0) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
 		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
+		}
+	    } else {
+		if (strcmp(valuePtr->pv.buffer, value2.pv.buffer) >= 0) {
 		    zfree(valuePtr->intValue);
 		    valuePtr->intValue = _one_;
+		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
 		}
-		break;
+	    }
+	    valuePtr->type = MP_INT;
+	    break;
+	case EQUAL:
+	    if (valuePtr->type == MP_INT) {
+		if (zcmp(valuePtr->intValue,value2.intValue) ==  0) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
+		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
+		}
+	    } else if (valuePtr->type == MP_DOUBLE) {
+		if (qcmp(valuePtr->doubleValue, value2.doubleValue) ==  0) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
+		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
+		}
+	    } else {
+		if (strcmp(valuePtr->pv.buffer, value2.pv.buffer) == 0) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
+		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
+		}
+	    }
+	    valuePtr->type = MP_INT;
+	    break;
+	case NEQ:
+	    if (valuePtr->type == MP_INT) {
+		if (zcmp(valuePtr->intValue,value2.intValue) !=  0) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
+		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
+		}
+	    } else if (valuePtr->type == MP_DOUBLE) {
+		if (qcmp(valuePtr->doubleValue, value2.doubleValue) !=  0) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
+		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
+		}
+	    } else {
+		if (strcmp(valuePtr->pv.buffer, value2.pv.buffer) != 0) {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _one_;
+		} else {
+		    zfree(valuePtr->intValue);
+		    valuePtr->intValue = _zero_;
+		}
+	    }
+	    valuePtr->type = MP_INT;
+	    break;
+	case BIT_AND:
+	    zand(valuePtr->intValue, value2.intValue, &z_tmp);
+	    zfree(valuePtr->intValue);
+	    valuePtr->intValue = z_tmp;
+	    break;
+	case BIT_XOR:
+	    zxor(valuePtr->intValue, value2.intValue, &z_tmp);
+	    zfree(valuePtr->intValue);
+	    valuePtr->intValue = z_tmp;
+	    break;
+	case BIT_OR:
+	    zor(valuePtr->intValue, value2.intValue, &z_tmp);
+	    zfree(valuePtr->intValue);
+	    valuePtr->intValue = z_tmp;
+	    break;
+
+	/*
+	 * For AND and OR, we know that the first value has already
+	 * been converted to an integer.  Thus we need only consider
+	 * the possibility of int vs. double for the second value.
+	 */
+
+	case AND:
+	    if (value2.type == MP_DOUBLE) {
+		if (!qiszero(value2.doubleValue)) {
+		    zfree(value2.intValue);
+		    value2.intValue = _one_;
+		} else {
+		    zfree(value2.intValue);
+		    value2.intValue = _zero_;
+		}
+		zand(valuePtr->intValue, value2.intValue, &z_tmp);
+		zfree(valuePtr->intValue);
+		valuePtr->intValue = z_tmp;
+		value2.type = MP_INT;
+	    }
+	    if (ziszero(valuePtr->intValue) || ziszero(value2.intValue)) {
+		zfree(valuePtr->intValue);
+		valuePtr->intValue = _zero_;
+	    } else {
+		zfree(valuePtr->intValue);
+		valuePtr->intValue = _one_;
+	    }
+	    break;
+	case OR:
+	    if (value2.type == MP_DOUBLE) {
+		if (!qiszero(value2.doubleValue)) {
+		    zfree(value2.intValue);
+		    value2.intValue = _one_;
+		} else {
+		    zfree(value2.intValue);
+		    value2.intValue = _zero_;
+		}
+		value2.type = MP_INT;
+	    }
+	    if (ziszero(valuePtr->intValue) && ziszero(value2.intValue)) {
+		zfree(valuePtr->intValue);
+		valuePtr->intValue = _zero_;
+	    } else {
+		zfree(valuePtr->intValue);
+		valuePtr->intValue = _one_;
+	    }
+	    break;
+
+	case COLON:
+	    Tcl_SetResult(interp, "can't have : operator without ? first", TCL_STATIC);
+	    result = TCL_ERROR;
+	    goto done;
+    }
+
+    done:
+    /* avoid return -0 */
+    if (valuePtr->type == MP_INT) {
+	if (ziszero(valuePtr->intValue) && zisneg(valuePtr->intValue)) {
+	    zneg(valuePtr->intValue);
+	}
+    }
+    ExprFreeValue(&value2);
+
+    /*
+     * Keep the value of a constant subexpression in its node, so it
+     * isn't computed again.  This is done the first time the node is
+     * evaluated rather than at compile time, so errors such as divide
+     * by zero are reported as usual.
+     */
+
+    if ((result == TCL_OK) && (nodePtr->fold != EXPR_FOLD_NONE)) {
+	if (valuePtr->type == MP_INT) {
+	    zfree(nodePtr->intValue);
+	    zcopy(valuePtr->intValue, &nodePtr->intValue);
+	    zkeep(nodePtr->intValue);
+	} else if (valuePtr->type == MP_DOUBLE) {
+	    if (nodePtr->doubleValue != NULL) {
+		qfree(nodePtr->doubleValue);
+	    }
+	    nodePtr->doubleValue = qlink(valuePtr->doubleValue);
+	    qkeep(nodePtr->doubleValue);
+	}
+	if ((valuePtr->type == MP_INT) || (valuePtr->type == MP_DOUBLE)) {
+	    nodePtr->type = valuePtr->type;
+	    nodePtr->foldPrec = mdPtr->precision;
+	}
+    }
+    return result;
+
+    illegalType:
+    Tcl_AppendResult(interp, "can't use ", (badType == MP_DOUBLE) ?
+	    "floating-point value" : "non-numeric string",
+	    " as operand of \"", operatorStrings[operator], "\"",
+	    (char *) NULL);
+    result = TCL_ERROR;
+    goto done;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprMakeString --
+ *
+ *	Convert a value from int or double representation to
+ *	a string.
+ *
+ * Results:
+ *	The information at *valuePtr gets converted to string
+ *	format, if it wasn't that way already.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+ExprMakeString(precRequest, valuePtr)
+    long precRequest;
+    register Mp_Value *valuePtr;	/* Value to be converted. */
+{
+    int shortfall;
+    int total;
+    long precision;
+    char *math_io;
+
+    if (valuePtr->type == MP_INT) {
+        shortfall = zdigits(valuePtr->intValue) -
+		   (valuePtr->pv.end - valuePtr->pv.buffer);
+	total = zdigits(valuePtr->intValue) +
+		   (valuePtr->pv.end - valuePtr->pv.buffer);
+    } else {
+	precision = DeterminePrecision(valuePtr, precRequest);
+	
+        shortfall = (qdigits(valuePtr->doubleValue) + precision) -
+		   (valuePtr->pv.end - valuePtr->pv.buffer);
+	total = (qdigits(valuePtr->doubleValue) + precision) +
+		   (valuePtr->pv.end - valuePtr->pv.buffer);
+    }
+    total += 4;
+    shortfall += 4;
+    if (shortfall > 0) {
+	(*valuePtr->pv.expandProc)(&valuePtr->pv, shortfall);
+    }
+    math_divertio();
+    if (valuePtr->type == MP_INT) {
+	Zprintval(valuePtr->intValue, 0L, 0L);
+	math_io = math_getdivertedio();
+	math_cleardiversions();
+	strncpy(valuePtr->pv.buffer, math_io, total);
+    } else if (valuePtr->type == MP_DOUBLE) {
+	Qprintff(valuePtr->doubleValue, 0L, precision);
+	math_io = math_getdivertedio();
+	math_cleardiversions();
+	strncpy(valuePtr->pv.buffer, math_io, total);
+    }
+    ckfree(math_io);
+    valuePtr->type = MP_STRING;
+}
+
+static long
+DeterminePrecision(valuePtr, precRequest)
+    Mp_Value *valuePtr;
+    long precRequest;
+{
+    long precision;
+    NUMBER *q_rounded = qround(valuePtr->doubleValue, precRequest);
+
+    Qfree(valuePtr->doubleValue);
+    valuePtr->doubleValue = q_rounded;
+    precision = qplaces(valuePtr->doubleValue);
+    if (precision < 0) {
+	precision = precRequest;
+    } else {
+	precision  = (precision > precRequest) ? precRequest:
+		 (precision == 0) ? 1 : precision;
+    }
+    return precision;
+}
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprTopLevel --
+ *
+ *	This procedure provides top-level functionality shared by
+ *	procedures like Mp_ExprInt, Mp_ExprDouble, etc.
+ *
+ * Results:
+ *	The result is a standard Tcl return value.  If an error
+ *	occurs then an error message is left in the interpreter result.
+ *	The value of the expression is returned in *valuePtr, in
+ *	whatever form it ends up in (could be string or integer
+ *	or double).  Caller may need to convert result.  Caller
+ *	is also responsible for freeing string memory in *valuePtr,
+ *	if any was allocated.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+ExprTopLevel(interp, treePtr, valuePtr, mdPtr)
+    Tcl_Interp *interp;			/* Context in which to evaluate the
+					 * expression. */
+    ExprTree *treePtr;			/* Compiled expression to evaluate. */
+    Mp_Value *valuePtr;			/* Where to store result.  Must
+					 * have been set up with
+					 * ExprInitValue. */
+    Mp_Data *mdPtr;
+{
+    valuePtr->pv.next = valuePtr->pv.buffer;
+    return ExprEvalNode(interp, treePtr->root, valuePtr, mdPtr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprSetPrecision, ExprRestorePrecision --
+ *
+ *	Switch the precision and epsilon used by the math functions
+ *	for one evaluation, without going through mp_precision and
+ *	its trace, and switch them back afterwards.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	If precision isn't negative, ExprSetPrecision saves the current
+ *	precision in *savePtr and makes precision the current one, with
+ *	its epsilon from the interpreter's epsilon cache.  If
+ *	mp_precision is set while it is in effect, ExprRestorePrecision
+ *	leaves the new value in place.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+ExprSetPrecision(mdPtr, precision, savePtr)
+    Mp_Data *mdPtr;
+    long precision;			/* New precision, or -1 to keep the
+					 * current one. */
+    PrecisionSave *savePtr;		/* Where to save the old one. */
+{
+    savePtr->epsilon = NULL;
+    if ((precision >= 0) && (precision != mdPtr->precision)) {
+	savePtr->precision = mdPtr->precision;
+	savePtr->epsilon = mdPtr->epsilon;
+	mdPtr->precision = precision;
+	mdPtr->epsilon = qlink(MpGetEpsilon(mdPtr, precision));
+	savePtr->precisionSets = mdPtr->precisionSets;
+    }
+}
+
+static void
+ExprRestorePrecision(mdPtr, savePtr)
+    Mp_Data *mdPtr;
+    PrecisionSave *savePtr;		/* Saved by ExprSetPrecision. */
+{
+    if (savePtr->epsilon == NULL) {
+	return;
+    }
+
+    /*
+     * If mp_precision was set during the evaluation, its new value
+     * stays in effect.
+     */
+
+    if (mdPtr->precisionSets != savePtr->precisionSets) {
+	qfree(savePtr->epsilon);
+	return;
+    }
+    qfree(mdPtr->epsilon);
+    mdPtr->epsilon = savePtr->epsilon;
+    mdPtr->precision = savePtr->precision;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Mp_ExprString, Mp_ExprObj --
+ *
+ *	Evaluate an expression and return its value in string form.
+ *	Mp_ExprObj takes the expression as a Tcl_Obj and keeps the
+ *	compiled form in the object's internal representation.
+ *
+ * Results:
+ *	A standard Tcl result.  If the result is TCL_OK, then the
+ *	interpreter's result is set to the value of the expression.
+ *	A numeric value is an "mpnumber" object whose decimal string
+ *	is only built if it is asked for.  If the result is TCL_ERROR,
+ *	then the interpreter result contains an error message.
+ *
+ * Side effects:
+ *	The compiled form of the expression is kept in the
+ *	interpreter's expression cache.
+ *
+ *--------------------------------------------------------------
+ */
+
+int
+Mp_ExprString(interp, string, precision, mdPtr)
+    Tcl_Interp *interp;			/* Context in which to evaluate the
+					 * expression. */
+    CONST char *string;		/* Expression to evaluate. */
+    long precision;			/* Digits of precision to use, or -1
+					 * for the value of mp_precision. */
+    Mp_Data *mdPtr;
+{
+    return ExprEvaluate(interp, string, (Tcl_Obj *) NULL, precision, mdPtr);
+}
+
+int
+Mp_ExprObj(interp, objPtr, precision, mdPtr)
+    Tcl_Interp *interp;			/* Context in which to evaluate the
+					 * expression. */
+    Tcl_Obj *objPtr;			/* Expression to evaluate. */
+    long precision;			/* Digits of precision to use, or -1
+					 * for the value of mp_precision. */
+    Mp_Data *mdPtr;
+{
+    return ExprEvaluate(interp, (CONST char *) NULL, objPtr, precision,
+	    mdPtr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprEvaluate --
+ *
+ *	Common code for Mp_ExprString and Mp_ExprObj:  find the
+ *	compiled form of the expression given either as a string or
+ *	as an object, evaluate it and leave its value in the
+ *	interpreter result.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Embedded commands could have arbitrary side-effects.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+ExprEvaluate(interp, string, objPtr, precision, mdPtr)
+    Tcl_Interp *interp;			/* Context in which to evaluate the
+					 * expression. */
+    CONST char *string;			/* Expression to evaluate, or NULL
+					 * to use objPtr. */
+    Tcl_Obj *objPtr;			/* Expression to evaluate, if string
+					 * is NULL. */
+    long precision;			/* Precision for this evaluation, or
+					 * -1. */
+    Mp_Data *mdPtr;
+{
+    Mp_Value value;
+    ExprTree * volatile treePtr = NULL;
+    PrecisionSave prec;
+    int numBindings;
+    int result;
+    ZSCOPE scope;
+    int abandoned = 0;
+    JumpData jd;
+    JumpData **jdPtrPtr = Tcl_GetThreadData(&mp_jdKey, sizeof(JumpData *));
+    JumpData *savePtr = *jdPtrPtr;
+
+    jd.interp = interp;
+    *jdPtrPtr = &jd;
+
+    /*
+     * Variables bound by an mpexpr -map that is running (e.g. one whose
+     * expression called this one through a command) aren't visible.
+     */
+
+    numBindings = mdPtr->numBindings;
+    mdPtr->numBindings = 0;
+
+    ExprSetPrecision(mdPtr, precision, &prec);
+    ExprInitValue(&value);
+    zbeginscope(&scope);
+
+    if (setjmp(jd.jb) == 1) {
+	abandoned = 1;
+	result = TCL_ERROR;
+	goto done;
+    }
+
+    if (string != NULL) {
+	treePtr = ExprGetTree(interp, string, mdPtr);
+    } else {
+	treePtr = ExprGetTreeFromObj(interp, objPtr, mdPtr);
+    }
+    if (treePtr == NULL) {
+	result = TCL_ERROR;
+    } else {
+	result = ExprTopLevel(interp, treePtr, &value, mdPtr);
+    }
+
+    if (result == TCL_OK) {
+	if (value.type == MP_STRING) {
+	    if (value.pv.buffer != value.staticSpace) {
+		Tcl_SetResult(interp, value.pv.buffer, TCL_DYNAMIC);
+		value.pv.buffer = value.staticSpace;
+	    } else {
+		Tcl_SetResult(interp, value.pv.buffer, TCL_VOLATILE);
+	    }
+	} else {
+	    Tcl_SetObjResult(interp, ExprValueObj(&value, mdPtr));
+	}
+    }
+
+    math_cleardiversions();
+
+  done:
+    if (treePtr != NULL) {
+	ExprReleaseTree(treePtr);
+    }
+    ExprFreeValue(&value);
+    qendscope(&scope, abandoned);
+    ExprRestorePrecision(mdPtr, &prec);
+    mdPtr->numBindings = numBindings;
+    *jdPtrPtr = savePtr;
+    return result;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Mp_ExprMap --
+ *
+ *	Evaluate one expression for each row of a list, with the
+ *	variables named in varsPtr bound to the values in the row.
+ *	The expression is compiled once, and its references to the
+ *	bound variables ($name only) read the row directly instead
+ *	of Tcl variables.
+ *
+ * Results:
+ *	A standard Tcl result.  If the result is TCL_OK, then the
+ *	interpreter's result is set to the list of values of the
+ *	expression, one for each row.
+ *
+ * Side effects:
+ *	Embedded commands could have arbitrary side-effects.
+ *
+ *--------------------------------------------------------------
+ */
+
+int
+Mp_ExprMap(interp, varsPtr, rowsPtr, exprPtr, precision, mdPtr)
+    Tcl_Interp *interp;			/* Context in which to evaluate the
+					 * expression. */
+    Tcl_Obj *varsPtr;			/* List of variable names. */
+    Tcl_Obj *rowsPtr;			/* List of rows, each a list of values
+					 * for the variables. */
+    Tcl_Obj *exprPtr;			/* Expression to evaluate. */
+    long precision;			/* Digits of precision to use, or -1
+					 * for the value of mp_precision. */
+    Mp_Data *mdPtr;
+{
+    Mp_Value value;
+    PrecisionSave prec;
+    ExprTree * volatile treePtr = NULL;
+    Tcl_Obj * volatile listPtr = NULL;
+    Tcl_Obj **volatile bindValues = NULL;
+    CONST char **volatile bindNames = NULL;
+    volatile int numVars = 0;
+    Tcl_Obj *rowPtr, **objv;
+    CONST char **saveNames;
+    Tcl_Obj **saveValues;
+    int saveNumBindings;
+    int numRows, objc, i, j, result;
+    char msg[60];
+    ZSCOPE scope;
+    int abandoned = 0;
+    JumpData jd;
+    JumpData **jdPtrPtr = Tcl_GetThreadData(&mp_jdKey, sizeof(JumpData *));
+    JumpData *savePtr = *jdPtrPtr;
+
+    if ((Tcl_ListObjGetElements(interp, varsPtr, &objc, &objv) != TCL_OK)
+	    || (Tcl_ListObjLength(interp, rowsPtr, &numRows) != TCL_OK)) {
+	return TCL_ERROR;
+    }
+
+    /*
+     * Hold on to the lists and the values bound for the current row,
+     * in case commands in the expression change the objects.
+     */
+
+    Tcl_IncrRefCount(varsPtr);
+    Tcl_IncrRefCount(rowsPtr);
+    numVars = objc;
+    if (numVars > 0) {
+	bindNames = (CONST char **) ckalloc(numVars * sizeof(char *));
+	bindValues = (Tcl_Obj **) ckalloc(numVars * sizeof(Tcl_Obj *));
+    }
+    for (j = 0; j < numVars; j++) {
+	bindNames[j] = Tcl_GetString(objv[j]);
+	bindValues[j] = NULL;
+    }
+
+    saveNames = mdPtr->bindNames;
+    saveValues = mdPtr->bindValues;
+    saveNumBindings = mdPtr->numBindings;
+
+    jd.interp = interp;
+    *jdPtrPtr = &jd;
+
+    ExprSetPrecision(mdPtr, precision, &prec);
+    ExprInitValue(&value);
+    zbeginscope(&scope);
+
+    if (setjmp(jd.jb) == 1) {
+	abandoned = 1;
+	result = TCL_ERROR;
+	goto done;
+    }
+
+    treePtr = ExprGetTreeFromObj(interp, exprPtr, mdPtr);
+    if (treePtr == NULL) {
+	result = TCL_ERROR;
+	goto done;
+    }
+    listPtr = Tcl_NewListObj(0, (Tcl_Obj **) NULL);
+    Tcl_IncrRefCount(listPtr);
+
+    result = TCL_OK;
+    for (i = 0; i < numRows; i++) {
+	if ((Tcl_ListObjIndex(interp, rowsPtr, i, &rowPtr) != TCL_OK)
+		|| (Tcl_ListObjGetElements(interp, rowPtr, &objc, &objv)
+		    != TCL_OK)) {
+	    result = TCL_ERROR;
+	    break;
+	}
+	if (objc != numVars) {
+	    sprintf(msg, "%d", i);
+	    Tcl_AppendResult(interp, "wrong # values in row ", msg,
+		    " of -map list", (char *) NULL);
+	    result = TCL_ERROR;
+	    break;
+	}
+	for (j = 0; j < numVars; j++) {
+	    Tcl_IncrRefCount(objv[j]);
+	    if (bindValues[j] != NULL) {
+		Tcl_DecrRefCount(bindValues[j]);
+	    }
+	    bindValues[j] = objv[j];
+	}
+
+	mdPtr->bindNames = bindNames;
+	mdPtr->bindValues = bindValues;
+	mdPtr->numBindings = numVars;
+	result = ExprTopLevel(interp, treePtr, &value, mdPtr);
+	mdPtr->bindNames = saveNames;
+	mdPtr->bindValues = saveValues;
+	mdPtr->numBindings = saveNumBindings;
+	if (result != TCL_OK) {
+	    sprintf(msg, "\n    (evaluating row %d of -map list)", i);
+	    Tcl_AddErrorInfo(interp, msg);
+	    break;
+	}
+	Tcl_ListObjAppendElement((Tcl_Interp *) NULL, listPtr,
+		ExprValueObj(&value, mdPtr));
+    }
+    if (result == TCL_OK) {
+	Tcl_SetObjResult(interp, listPtr);
+    }
+
+    math_cleardiversions();
+
+  done:
+    mdPtr->bindNames = saveNames;
+    mdPtr->bindValues = saveValues;
+    mdPtr->numBindings = saveNumBindings;
+    if (treePtr != NULL) {
+	ExprReleaseTree(treePtr);
+    }
+    if (listPtr != NULL) {
+	Tcl_DecrRefCount(listPtr);
+    }
+    for (j = 0; j < numVars; j++) {
+	if (bindValues[j] != NULL) {
+	    Tcl_DecrRefCount(bindValues[j]);
+	}
+    }
+    if (numVars > 0) {
+	ckfree((char *) bindNames);
+	ckfree((char *) bindValues);
+    }
+    Tcl_DecrRefCount(varsPtr);
+    Tcl_DecrRefCount(rowsPtr);
+    ExprFreeValue(&value);
+    qendscope(&scope, abandoned);
+    ExprRestorePrecision(mdPtr, &prec);
+    *jdPtrPtr = savePtr;
+    return result;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Mp_ExprReduce --
+ *
+ *	Reduce a list of numbers to one value:  their sum, product,
+ *	minimum, maximum or mean.  Sums and products are accumulated
+ *	as unreduced fractions (see qsum and qprod) and normalized
+ *	once, instead of once per element as a chain of "+" would.
+ *
+ * Results:
+ *	A standard Tcl result.  If the result is TCL_OK, then the
+ *	interpreter's result is the value of the reduction.  The sum
+ *	and product of integers are integers;  the mean, and any
+ *	reduction involving a floating-point value, is floating-point.
+ *	The minimum and maximum are elements of the list.
+ *
+ * Side effects:
+ *	The list elements are converted to "mpnumber" objects.
+ *
+ *--------------------------------------------------------------
+ */
+
+int
+Mp_ExprReduce(interp, opPtr, listPtr, precision, mdPtr)
+    Tcl_Interp *interp;			/* Where to store result. */
+    Tcl_Obj *opPtr;			/* Name of the reduction. */
+    Tcl_Obj *listPtr;			/* List of numbers to reduce. */
+    long precision;			/* Digits of precision for a
+					 * floating-point result, or -1 for
+					 * the value of mp_precision. */
+    Mp_Data *mdPtr;
+{
+    PrecisionSave prec;
+    static CONST char *reductions[] = {
+	"sum", "product", "min", "max", "mean", (char *) NULL
+    };
+    enum reductions {
+	REDUCE_SUM, REDUCE_PRODUCT, REDUCE_MIN, REDUCE_MAX, REDUCE_MEAN
+    };
+    Mp_Value value;
+    NUMBER ** volatile qv = NULL;
+    NUMBER *q, *r;
+    Tcl_Obj **objv;
+    int objc, index, i, best, isDouble, result;
+    ZSCOPE scope;
+    int abandoned = 0;
+    JumpData jd;
+    JumpData **jdPtrPtr = Tcl_GetThreadData(&mp_jdKey, sizeof(JumpData *));
+    JumpData *savePtr = *jdPtrPtr;
+
+    if ((Tcl_GetIndexFromObj(interp, opPtr, reductions, "reduction", 0,
+	    &index) != TCL_OK)
+	    || (Tcl_ListObjGetElements(interp, listPtr, &objc, &objv)
+		!= TCL_OK)) {
+	return TCL_ERROR;
+    }
+    if ((objc == 0) && (index != REDUCE_SUM) && (index != REDUCE_PRODUCT)) {
+	Tcl_AppendResult(interp, "can't compute \"", reductions[index],
+		"\" of an empty list", (char *) NULL);
+	return TCL_ERROR;
+    }
+
+    Tcl_IncrRefCount(listPtr);
+    if (objc > 0) {
+	qv = (NUMBER **) ckalloc(objc * sizeof(NUMBER *));
+    }
+
+    jd.interp = interp;
+    *jdPtrPtr = &jd;
+
+    ExprSetPrecision(mdPtr, precision, &prec);
+    ExprInitValue(&value);
+    zbeginscope(&scope);
+
+    if (setjmp(jd.jb) == 1) {
+	abandoned = 1;
+	result = TCL_ERROR;
+	goto done;
+    }
+
+    /*
+     * The numbers are used straight out of the elements' internal
+     * reps;  nothing can run during the reduction to change them.
+     */
+
+    result = TCL_OK;
+    isDouble = (index == REDUCE_MEAN);
+    for (i = 0; i < objc; i++) {
+	if (objv[i]->typePtr != &mpNumberType) {
+	    result = ExprGetObjValue(interp, objv[i], &value);
+	    if (result != TCL_OK) {
+		goto done;
+	    }
+	    if (value.type == MP_STRING) {
+		Tcl_AppendResult(interp, "can't use non-numeric string ",
+			"as operand of \"", reductions[index], "\"",
+			(char *) NULL);
+		result = TCL_ERROR;
+		goto done;
+	    }
+	}
+	qv[i] = (NUMBER *) objv[i]->internalRep.ptrAndLongRep.ptr;
+	if (objv[i]->internalRep.ptrAndLongRep.value != MP_NUMBER_INT) {
+	    isDouble = 1;
+	}
+    }
+
+    switch ((enum reductions) index) {
+	case REDUCE_SUM:
+	case REDUCE_MEAN:
+	    q = qsum(qv, (long) objc);
+	    if (index == REDUCE_MEAN) {
+		r = qdivi(q, (long) objc);
+		qfree(q);
+		q = r;
+	    }
+	    break;
+	case REDUCE_PRODUCT:
+	    q = qprod(qv, (long) objc);
+	    break;
+	default:
+	    best = 0;
+	    for (i = 1; i < objc; i++) {
+		if ((index == REDUCE_MIN) ? (qrel(qv[i], qv[best]) < 0)
+			: (qrel(qv[i], qv[best]) > 0)) {
+		    best = i;
+		}
+	    }
+	    Tcl_SetObjResult(interp, objv[best]);
+	    goto done;
+    }
+
+    if (!isDouble) {
+	Tcl_SetObjResult(interp, ExprNewNumberObj(q, MP_NUMBER_INT));
+    } else {
+	Qfree(value.doubleValue);
+	value.doubleValue = q;
+	value.type = MP_DOUBLE;
+	Tcl_SetObjResult(interp, ExprValueObj(&value, mdPtr));
+    }
+
+  done:
+    if (qv != NULL) {
+	ckfree((char *) qv);
+    }
+    Tcl_DecrRefCount(listPtr);
+    ExprFreeValue(&value);
+    qendscope(&scope, abandoned);
+    ExprRestorePrecision(mdPtr, &prec);
+    *jdPtrPtr = savePtr;
+    return result;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprValueObj --
+ *
+ *	Make an object holding the value of an expression.
+ *
+ * Results:
+ *	A new object.  Integer and floating-point values are "mpnumber"
+ *	objects without a string rep;  a floating-point value is rounded
+ *	to the interpreter's precision first, as it would be printed.
+ *
+ * Side effects:
+ *	The integer in *valuePtr is moved into the object.
+ *
+ *--------------------------------------------------------------
+ */
+
+static Tcl_Obj *
+ExprValueObj(valuePtr, mdPtr)
+    Mp_Value *valuePtr;
+    Mp_Data *mdPtr;
+{
+    NUMBER *q;
+    long precision;
+
+    if (valuePtr->type == MP_INT) {
+	q = qalloc();
+	q->num = valuePtr->intValue;
+	valuePtr->intValue = _zero_;
+	return ExprNewNumberObj(q, MP_NUMBER_INT);
+    } else if (valuePtr->type == MP_DOUBLE) {
+	precision = DeterminePrecision(valuePtr, mdPtr->precision);
+	return ExprNewNumberObj(qlink(valuePtr->doubleValue),
+		(unsigned long) precision);
+    }
+    return Tcl_NewStringObj(valuePtr->pv.buffer, -1);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CreateMathFunc --
+ *
+ *	Creates a new math function for expressions in a given
+ *	interpreter.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The function defined by "name" is created;  if such a function
+ *	already existed then its definition is overriden.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CreateMathFunc(table, funcPtr)
+    Tcl_HashTable *table;
+    BuiltinFunc *funcPtr;
+{
+    Mp_MathFunc *mathFuncPtr;
+    int i;
+    int numTypes = (funcPtr->varProc != NULL) ? 1 : funcPtr->numArgs;
+
+    mathFuncPtr = NewMathFunc(funcPtr->numArgs, numTypes);
+    for (i = 0; i < numTypes; i++) {
+	mathFuncPtr->argTypes[i] = funcPtr->argTypes[i];
+    }
+    mathFuncPtr->proc = funcPtr->proc;
+    mathFuncPtr->varProc = funcPtr->varProc;
+    mathFuncPtr->clientData = funcPtr->clientData;
+
+    /*
+     * All the built-in functions are pure;  the ones that use mp_epsilon
+     * depend on the precision.
+     */
+
+    mathFuncPtr->flags = MP_FUNC_PURE;
+    if ((funcPtr->proc == (Mp_MathProc *) ExprUnaryFunc)
+	    || (funcPtr->proc == (Mp_MathProc *) ExprBinaryFunc)
+	    || (funcPtr->proc == (Mp_MathProc *) ExprPiFunc)) {
+	mathFuncPtr->flags |= MP_FUNC_PRECISION;
+    }
+    DefineMathFunc(table, funcPtr->name, mathFuncPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewMathFunc --
+ *
+ *	Allocate a math function with room for numTypes argument types.
+ *
+ * Results:
+ *	The new function, with one reference and no procedure.
+ *
+ * Side effects:
+ *	Memory is allocated;  release it with ReleaseMathFunc.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Mp_MathFunc *
+NewMathFunc(numArgs, numTypes)
+    int numArgs;			/* Number of arguments, or least
+					 * number for a variadic function. */
+    int numTypes;			/* Number of argument types. */
+{
+    Mp_MathFunc *mathFuncPtr;
+
+    mathFuncPtr = (Mp_MathFunc *) ckalloc(sizeof(Mp_MathFunc)
+	    + numTypes * sizeof(Mp_ValueType));
+    mathFuncPtr->refCount = 1;
+    mathFuncPtr->numArgs = numArgs;
+    mathFuncPtr->argTypes = (Mp_ValueType *) (mathFuncPtr + 1);
+    mathFuncPtr->proc = NULL;
+    mathFuncPtr->varProc = NULL;
+    mathFuncPtr->clientData = (ClientData) NULL;
+    mathFuncPtr->flags = 0;
+    return mathFuncPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReleaseMathFunc --
+ *
+ *	Drop a reference to a math function, freeing it when the last
+ *	one is gone.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ReleaseMathFunc(mathFuncPtr)
+    Mp_MathFunc *mathFuncPtr;
+{
+    if (--mathFuncPtr->refCount <= 0) {
+	ckfree((char *) mathFuncPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DefineMathFunc --
+ *
+ *	Enter a math function in a function table, replacing any
+ *	function of the same name.
+ *
+ * Results:
+ *	1 if a function was replaced, 0 otherwise.  Compiled expressions
+ *	may call a replaced function, so the caller has to make them
+ *	stale.
+ *
+ * Side effects:
+ *	The table takes over the caller's reference to mathFuncPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+DefineMathFunc(table, name, mathFuncPtr)
+    Tcl_HashTable *table;
+    CONST char *name;
+    Mp_MathFunc *mathFuncPtr;
+{
+    Tcl_HashEntry *hPtr;
+    int new;
+
+    hPtr = Tcl_CreateHashEntry(table, name, &new);
+    if (!new) {
+	ReleaseMathFunc((Mp_MathFunc *) Tcl_GetHashValue(hPtr));
+    }
+    Tcl_SetHashValue(hPtr, (ClientData) mathFuncPtr);
+    return !new;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetFuncTable --
+ *
+ *	Return an interpreter's table of math functions, creating it
+ *	with the built-in functions the first time.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_HashTable *
+GetFuncTable(mdPtr)
+    Mp_Data *mdPtr;
+{
+    BuiltinFunc *funcPtr;
+
+    if (mdPtr->funcTable == NULL) {
+	mdPtr->funcTable = (Tcl_HashTable *) ckalloc(sizeof(Tcl_HashTable));
+	Tcl_InitHashTable(mdPtr->funcTable, TCL_STRING_KEYS);
+
+	for (funcPtr = funcTable; funcPtr->name != NULL; funcPtr++) {
+	    CreateMathFunc(mdPtr->funcTable, funcPtr);
+	}
+    }
+    return mdPtr->funcTable;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MpFreeMathFuncs --
+ *
+ *	Free an interpreter's table of math functions.  Functions still
+ *	used by compiled expressions are freed along with those.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+MpFreeMathFuncs(mdPtr)
+    Mp_Data *mdPtr;
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+
+    if (mdPtr->funcTable == NULL) {
+	return;
+    }
+    for (hPtr = Tcl_FirstHashEntry(mdPtr->funcTable, &search); hPtr;
+	    hPtr = Tcl_NextHashEntry(&search)) {
+	ReleaseMathFunc((Mp_MathFunc *) Tcl_GetHashValue(hPtr));
+    }
+    Tcl_DeleteHashTable(mdPtr->funcTable);
+    ckfree((char *) mdPtr->funcTable);
+    mdPtr->funcTable = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Mp_CreateMathFunc, Mp_CreateVarMathFunc --
+ *
+ *	Create a math function for mpexpr in an interpreter, implemented
+ *	by a C procedure.  Mp_CreateMathFunc makes a function taking
+ *	exactly numArgs arguments of the types in argTypes;
+ *	Mp_CreateVarMathFunc makes one taking minArgs or more arguments,
+ *	all of type argType.  The functions are called directly from the
+ *	evaluator.  Unlike the built-in functions, they are not assumed
+ *	to be pure, so calls with constant arguments are not folded.
+ *
+ * Results:
+ *	A standard Tcl result;  TCL_ERROR if mpexpr isn't loaded in the
+ *	interpreter.
+ *
+ * Side effects:
+ *	Any function with the same name is replaced, and expressions
+ *	compiled with it are recompiled when next used.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Mp_CreateMathFunc(interp, name, numArgs, argTypes, proc, clientData)
+    Tcl_Interp *interp;			/* Interpreter to create the
+					 * function in. */
+    CONST char *name;			/* Name of the function. */
+    int numArgs;			/* Number of arguments. */
+    Mp_ValueType *argTypes;		/* Type of each argument:  MP_INT,
+					 * MP_DOUBLE or MP_EITHER. */
+    Mp_MathProc *proc;			/* Procedure implementing it. */
+    ClientData clientData;		/* Passed to proc. */
+{
+    Mp_Data *mdPtr;
+    Mp_MathFunc *mathFuncPtr;
+    int i;
+
+    mdPtr = (Mp_Data *) Tcl_GetAssocData(interp, MP_ASSOC_KEY, NULL);
+    if ((mdPtr == NULL) || (mdPtr->exprCmd == NULL)) {
+	Tcl_SetResult(interp, "mpexpr isn't loaded in this interpreter",
+		TCL_STATIC);
+	return TCL_ERROR;
+    }
+    if (numArgs < 0) {
+	numArgs = 0;
+    }
+    mathFuncPtr = NewMathFunc(numArgs, numArgs);
+    for (i = 0; i < numArgs; i++) {
+	mathFuncPtr->argTypes[i] = argTypes[i];
+    }
+    mathFuncPtr->proc = proc;
+    mathFuncPtr->clientData = clientData;
+    if (DefineMathFunc(GetFuncTable(mdPtr), name, mathFuncPtr)) {
+	MpNewExprEpoch(mdPtr);
+    }
+    return TCL_OK;
+}
+
+int
+Mp_CreateVarMathFunc(interp, name, minArgs, argType, proc, clientData)
+    Tcl_Interp *interp;			/* Interpreter to create the
+					 * function in. */
+    CONST char *name;			/* Name of the function. */
+    int minArgs;			/* Least number of arguments. */
+    Mp_ValueType argType;		/* Type of all the arguments. */
+    Mp_VarMathProc *proc;		/* Procedure implementing it. */
+    ClientData clientData;		/* Passed to proc. */
+{
+    Mp_Data *mdPtr;
+    Mp_MathFunc *mathFuncPtr;
+
+    mdPtr = (Mp_Data *) Tcl_GetAssocData(interp, MP_ASSOC_KEY, NULL);
+    if ((mdPtr == NULL) || (mdPtr->exprCmd == NULL)) {
+	Tcl_SetResult(interp, "mpexpr isn't loaded in this interpreter",
+		TCL_STATIC);
+	return TCL_ERROR;
+    }
+    if (minArgs < 0) {
+	minArgs = 0;
+    }
+    mathFuncPtr = NewMathFunc(minArgs, 1);
+    mathFuncPtr->argTypes[0] = argType;
+    mathFuncPtr->varProc = proc;
+    mathFuncPtr->clientData = clientData;
+    if (DefineMathFunc(GetFuncTable(mdPtr), name, mathFuncPtr)) {
+	MpNewExprEpoch(mdPtr);
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExprFreeMathArgs
+ *
+ *	Free the first numArgs arguments of a math function call.
+ *
+ */
+
+static void
+ExprFreeMathArgs (args, numArgs)
+    Mp_Value *args;
+    int numArgs;
+{
+    int i;
+    for (i = 0; i < numArgs; i++) {
+	zfree(args[i].intValue);
+	Qfree(args[i].doubleValue);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExprParseMathFunc --
+ *
+ *	This procedure is invoked to parse a math function call from an
+ *	expression string and build the node that will carry it out.
+ *
+ * Results:
+ *	TCL_OK is returned if all went well.  If an error occurred,
+ *	TCL_ERROR is returned and an error message is left in the
+ *	interpreter result.  After a successful return infoPtr has been
+ *	updated to refer to the character just after the function call,
+ *	the token is set to VALUE, and the node for the call is stored
+ *	at infoPtr->nodePtr.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExprParseMathFunc(interp, infoPtr, mdPtr)
+    Tcl_Interp *interp;			/* Interpreter to use for error
+					 * reporting. */
+    register ExprInfo *infoPtr;		/* Describes the state of the parse.
+					 * infoPtr->expr must point to the
+					 * first character of the function's
+					 * name. */
+    Mp_Data *mdPtr;
+{
+    Mp_MathFunc *mathFuncPtr;		/* Info about math function. */
+    ExprNode *nodePtr;			/* Node for the function call. */
+    Tcl_HashEntry *hPtr;
+    CONST char *p;
+    CONST char *funcName;
+    char *funcNameCopy;
+    int i, result;
+
+    /*
+     * Find the end of the math function's name and lookup the MathFunc
+     * record for the function.
+     */
+
+    p = funcName = infoPtr->expr;
+    while (isalnum(UCHAR(*p)) || (*p == '_')) {
+	p++;
+    }
+    infoPtr->expr = p;
+    result = ExprLex(interp, infoPtr, mdPtr);
+    if (result != TCL_OK) {
+	return TCL_ERROR;
+    }
+    if (infoPtr->token != OPEN_PAREN) {
+	goto syntaxError;
+    }
+    funcNameCopy = ExprCopyText(funcName, p);
+    hPtr = Tcl_FindHashEntry(mdPtr->funcTable, funcNameCopy);
+    if (hPtr == NULL) {
+	Tcl_AppendResult(interp, "unknown math function \"", funcNameCopy,
+                         "\"", (char *) NULL);
+        ckfree(funcNameCopy);
+	return TCL_ERROR;
+    }
+    ckfree(funcNameCopy);
+    mathFuncPtr = (Mp_MathFunc *) Tcl_GetHashValue(hPtr);
+    if (mathFuncPtr->varProc != NULL) {
+	return ExprParseVarArgs(interp, infoPtr, mathFuncPtr, mdPtr);
+    }
+    nodePtr = ExprNewNode(EXPR_FUNC, 0, mathFuncPtr->numArgs);
+    nodePtr->funcPtr = mathFuncPtr;
+    mathFuncPtr->refCount++;
+
+    /*
+     * Scan off the arguments for the function, if there are any.
+     */
+
+    if (mathFuncPtr->numArgs == 0) {
+	result = ExprLex(interp, infoPtr, mdPtr);
+	if ((result != TCL_OK) || (infoPtr->token != CLOSE_PAREN)) {
+	    ExprFreeNode(nodePtr);
+	    goto syntaxError;
+	}
+    } else {
+	for (i = 0; ; i++) {
+	    nodePtr->args[i] = ExprParseValue(interp, infoPtr, -1, mdPtr);
+	    if (nodePtr->args[i] == NULL) {
+		ExprFreeNode(nodePtr);
+		return TCL_ERROR;
+	    }
+
+	    /*
+	     * Check for a comma separator between arguments or a close-paren
+	     * to end the argument list.
+	     */
+
+	    if (i == (mathFuncPtr->numArgs-1)) {
+		if (infoPtr->token == CLOSE_PAREN) {
+		    break;
+		}
+		ExprFreeNode(nodePtr);
+		if (infoPtr->token == COMMA) {
+		    Tcl_SetResult(interp, "too many arguments for math function", TCL_STATIC);
+		    return TCL_ERROR;
+		} else {
+		    goto syntaxError;
+		}
+	    }
+	    if (infoPtr->token != COMMA) {
+		ExprFreeNode(nodePtr);
+		if (infoPtr->token == CLOSE_PAREN) {
+		    Tcl_SetResult(interp, "too few arguments for math function", TCL_STATIC);
+		    return TCL_ERROR;
+		} else {
+		    goto syntaxError;
+		}
+	    }
+	}
+    }
+    infoPtr->token = VALUE;
+    infoPtr->nodePtr = nodePtr;
+    return TCL_OK;
+
+    syntaxError:
+    Tcl_AppendResult(interp, "syntax error in expression \"",
+	    infoPtr->originalExpr, "\"", (char *) NULL);
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExprParseVarArgs --
+ *
+ *	Parse the arguments of a call to a variadic math function, any
+ *	number of them from the function's minimum up, and build the
+ *	node for the call.
+ *
+ * Results:
+ *	As for ExprParseMathFunc, which this finishes:  infoPtr->expr
+ *	must point just after the open parenthesis.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExprParseVarArgs(interp, infoPtr, mathFuncPtr, mdPtr)
+    Tcl_Interp *interp;			/* Interpreter to use for error
+					 * reporting. */
+    register ExprInfo *infoPtr;		/* Describes the state of the parse. */
+    Mp_MathFunc *mathFuncPtr;		/* Function being called. */
+    Mp_Data *mdPtr;
+{
+    ExprNode *nodePtr, *argPtr;
+    CONST char *p;
+    int space = 0;
+
+    nodePtr = ExprNewNode(EXPR_FUNC, 0, 0);
+    nodePtr->funcPtr = mathFuncPtr;
+    mathFuncPtr->refCount++;
+
+    p = infoPtr->expr;
+    while (isspace(UCHAR(*p))) {
+	p++;
+    }
+    if (*p == ')') {
+	infoPtr->expr = p+1;
+    } else {
+	while (1) {
+	    argPtr = ExprParseValue(interp, infoPtr, -1, mdPtr);
+	    if (argPtr == NULL) {
+		ExprFreeNode(nodePtr);
+		return TCL_ERROR;
+	    }
+	    if (nodePtr->numArgs == space) {
+		ExprNode **newArgs;
+
+		space = (space == 0) ? MP_MAX_MATH_ARGS : 2*space;
+		newArgs = (ExprNode **) ckalloc(space * sizeof(ExprNode *));
+		if (nodePtr->args != NULL) {
+		    memcpy((VOID *) newArgs, (VOID *) nodePtr->args,
+			    nodePtr->numArgs * sizeof(ExprNode *));
+		    ckfree((char *) nodePtr->args);
+		}
+		nodePtr->args = newArgs;
+	    }
+	    nodePtr->args[nodePtr->numArgs++] = argPtr;
+	    if (infoPtr->token == CLOSE_PAREN) {
+		break;
+	    }
+	    if (infoPtr->token != COMMA) {
+		ExprFreeNode(nodePtr);
+		Tcl_AppendResult(interp, "syntax error in expression \"",
+			infoPtr->originalExpr, "\"", (char *) NULL);
+		return TCL_ERROR;
+	    }
+	}
+    }
+    if (nodePtr->numArgs < mathFuncPtr->numArgs) {
+	ExprFreeNode(nodePtr);
+	Tcl_SetResult(interp, "too few arguments for math function", TCL_STATIC);
+	return TCL_ERROR;
+    }
+    infoPtr->token = VALUE;
+    infoPtr->nodePtr = nodePtr;
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExprEvalMathFunc --
+ *
+ *	Evaluate the arguments of a math function node, carry out the
+ *	function, and return the value computed.
+ *
+ * Results:
+ *	TCL_OK is returned if all went well and the function's value
+ *	was computed successfully.  If an error occurred, TCL_ERROR
+ *	is returned and an error message is left in the interpreter result.
+ *	After a successful return the value is stored in valuePtr.
+ *
+ * Side effects:
+ *	Embedded commands could have arbitrary side-effects.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExprEvalMathFunc(interp, nodePtr, valuePtr, mdPtr)
+    Tcl_Interp *interp;			/* Interpreter to use for error
+					 * reporting. */
+    ExprNode *nodePtr;			/* EXPR_FUNC node to evaluate. */
+    register Mp_Value *valuePtr;	/* Where to store the value.
+					 * Caller must have initialized pv
+					 * field correctly. */
+    Mp_Data *mdPtr;
+{
+    Mp_MathFunc *mathFuncPtr = nodePtr->funcPtr;
+    Mp_Value argSpace[MP_MAX_MATH_ARGS];
+    Mp_Value *args = argSpace;		/* Arguments for function call. */
+    Mp_Value funcResult;		/* Result of function call. */
+    Mp_ValueType argType;
+    int i, result;
+
+    if (nodePtr->numArgs > MP_MAX_MATH_ARGS) {
+	args = (Mp_Value *) ckalloc(nodePtr->numArgs * sizeof(Mp_Value));
+    }
+
+    /*
+     * Only the slots for the function's own arguments are filled in,
+     * and the values are moved or linked into them rather than copied:
+     * the math procedures never modify their arguments.
+     */
+
+    for (i = 0; i < nodePtr->numArgs; i++) {
+	valuePtr->pv.next = valuePtr->pv.buffer;
+	result = ExprEvalNode(interp, nodePtr->args[i], valuePtr, mdPtr);
+	if (result != TCL_OK) {
+	    goto argError;
+	}
+	if (valuePtr->type == MP_STRING) {
+	    Tcl_SetResult(interp, "argument to math function didn't have numeric value", TCL_STATIC);
+	    result = TCL_ERROR;
+	    goto argError;
+	}
+	argType = mathFuncPtr->argTypes[(mathFuncPtr->varProc != NULL) ? 0 : i];
+
+	/*
+	 * Move the value to the argument record, converting it if
+	 * necessary.
+	 */
 
-	    case COLON:
-		Tcl_SetResult(interp, "can't have : operator without ? first", TCL_STATIC);
-		result = TCL_ERROR;
-		goto done;
+	if (valuePtr->type == MP_INT) {
+	    args[i].intValue = valuePtr->intValue;
+	    valuePtr->intValue = _zero_;
+	    args[i].doubleValue = qlink(&_qzero_);
+	    args[i].type = MP_INT;
+	    if (argType == MP_DOUBLE) {
+		ExprConvIntToDouble(&args[i]);
+	    }
+	} else {
+	    args[i].intValue = _zero_;
+	    args[i].doubleValue = qlink(valuePtr->doubleValue);
+	    args[i].type = MP_DOUBLE;
+	    if (argType == MP_INT) {
+		ExprConvDoubleToInt(&args[i]);
+	    }
 	}
     }
 
-    done:
-    if (value2.pv.buffer != value2.staticSpace) {
-	ckfree(value2.pv.buffer);
+    /*
+     * Invoke the function and move its result into valuePtr.
+     */
+
+    funcResult.intValue    = _zero_;
+    funcResult.doubleValue = qlink(&_qzero_);
+    funcResult.type        = MP_UNDEF;
+
+    if (mathFuncPtr->varProc != NULL) {
+	result = (*mathFuncPtr->varProc)(mathFuncPtr->clientData, interp,
+		nodePtr->numArgs, args, mdPtr, &funcResult);
+    } else {
+	result = (*mathFuncPtr->proc)(mathFuncPtr->clientData, interp, args,
+		mdPtr, &funcResult);
     }
-    /* avoid return -0 */
-    if (valuePtr->type == MP_INT) {
-	if (ziszero(valuePtr->intValue) && zisneg(valuePtr->intValue)) {
-	    zneg(valuePtr->intValue);
-	}
+
+    ExprFreeMathArgs(args, nodePtr->numArgs);
+    if (args != argSpace) {
+	ckfree((char *) args);
     }
-    zfree(value2.intValue);
-    Qfree(value2.doubleValue);
-    return result;
 
-    syntaxError:
-    Tcl_AppendResult(interp, "syntax error in expression \"",
-	    infoPtr->originalExpr, "\"", (char *) NULL);
-    result = TCL_ERROR;
-    goto done;
+    if (result != TCL_OK) {
+        zfree(funcResult.intValue);
+        Qfree(funcResult.doubleValue);
+	return result;
+    }
+    if (funcResult.type == MP_INT) {
+	valuePtr->type = MP_INT;
+	zfree(valuePtr->intValue);
+	valuePtr->intValue = funcResult.intValue;
+	Qfree(funcResult.doubleValue);
+    } else {
+	valuePtr->type = MP_DOUBLE;
+	Qfree(valuePtr->doubleValue);
+	valuePtr->doubleValue = funcResult.doubleValue;
+	zfree(funcResult.intValue);
+    }
+    return TCL_OK;
 
-    illegalType:
-    Tcl_AppendResult(interp, "can't use ", (badType == MP_DOUBLE) ?
-	    "floating-point value" : "non-numeric string",
-	    " as operand of \"", operatorStrings[operator], "\"",
-	    (char *) NULL);
-    result = TCL_ERROR;
-    goto done;
+    argError:
+    ExprFreeMathArgs(args, i);
+    if (args != argSpace) {
+	ckfree((char *) args);
+    }
+    return result;
 }
-
+
 /*
- *--------------------------------------------------------------
+ *----------------------------------------------------------------------
  *
- * ExprMakeString --
+ * ExprCompile --
  *
- *	Convert a value from int or double representation to
- *	a string.
+ *	Parse an expression string into a tree of nodes that can be
+ *	evaluated any number of times with ExprEvalNode.
  *
  * Results:
- *	The information at *valuePtr gets converted to string
- *	format, if it wasn't that way already.
+ *	The compiled expression, with a reference count of zero, or
+ *	NULL if the expression has a syntax error.  In that case an
+ *	error message is left in the interpreter result.
  *
  * Side effects:
  *	None.
  *
- *--------------------------------------------------------------
+ *----------------------------------------------------------------------
  */
 
-static void
-ExprMakeString(precRequest, valuePtr)
-    long precRequest;
-    register Mp_Value *valuePtr;	/* Value to be converted. */
+static ExprTree *
+ExprCompile(interp, string, mdPtr)
+    Tcl_Interp *interp;			/* Interpreter to use for error
+					 * reporting. */
+    CONST char *string;			/* Expression to compile. */
+    Mp_Data *mdPtr;
 {
-    int shortfall;
-    int total;
-    long precision;
-    char *math_io;
+    ExprInfo info;
+    ExprNode *rootPtr;
+    ExprTree *treePtr;
+    ZSCOPE *scopePtr;
 
-    if (valuePtr->type == MP_INT) {
-        shortfall = zdigits(valuePtr->intValue) -
-		   (valuePtr->pv.end - valuePtr->pv.buffer);
-	total = zdigits(valuePtr->intValue) +
-		   (valuePtr->pv.end - valuePtr->pv.buffer);
-    } else {
-	precision = DeterminePrecision(valuePtr, precRequest);
-	
-        shortfall = (qdigits(valuePtr->doubleValue) + precision) -
-		   (valuePtr->pv.end - valuePtr->pv.buffer);
-	total = (qdigits(valuePtr->doubleValue) + precision) +
-		   (valuePtr->pv.end - valuePtr->pv.buffer);
+    info.originalExpr = string;
+    info.expr = string;
+    info.nodePtr = NULL;
+
+    /*
+     * The literals of the tree outlive the evaluation it is compiled
+     * for, so they are made outside of its scope.  An error in the
+     * parse ends that scope anyway.
+     */
+
+    scopePtr = zsetscope(NULL);
+    rootPtr = ExprParseValue(interp, &info, -1, mdPtr);
+    zsetscope(scopePtr);
+    if (info.nodePtr != NULL) {
+	ExprFreeNode(info.nodePtr);
     }
-    total += 4;
-    shortfall += 4;
-    if (shortfall > 0) {
-	(*valuePtr->pv.expandProc)(&valuePtr->pv, shortfall);
+    if (rootPtr == NULL) {
+	return NULL;
     }
-    math_divertio();
-    if (valuePtr->type == MP_INT) {
-	Zprintval(valuePtr->intValue, 0L, 0L);
-	math_io = math_getdivertedio();
-	math_cleardiversions();
-	strncpy(valuePtr->pv.buffer, math_io, total);
-    } else if (valuePtr->type == MP_DOUBLE) {
-	Qprintff(valuePtr->doubleValue, 0L, precision);
-	math_io = math_getdivertedio();
-	math_cleardiversions();
-	strncpy(valuePtr->pv.buffer, math_io, total);
+    if (info.token != END) {
+	ExprFreeNode(rootPtr);
+	Tcl_AppendResult(interp, "syntax error in expression \"",
+		string, "\"", (char *) NULL);
+	return NULL;
     }
-    ckfree(math_io);
-    valuePtr->type = MP_STRING;
+    ExprMarkFolds(rootPtr);
+
+    treePtr = (ExprTree *) ckalloc(sizeof(ExprTree));
+    treePtr->refCount = 0;
+    treePtr->root = rootPtr;
+    treePtr->mdPtr = mdPtr;
+    treePtr->epoch = mdPtr->exprEpoch;
+    return treePtr;
 }
 
-static long
-DeterminePrecision(valuePtr, precRequest)
-    Mp_Value *valuePtr;
-    long precRequest;
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExprMarkFolds --
+ *
+ *	Work out which nodes of a compiled expression are constant, so
+ *	ExprEvalNode can keep their values.  Operators and pure math
+ *	functions whose operands are all constant are constant too.
+ *	Comparisons may convert numbers to strings, and some functions
+ *	use mp_epsilon, so those are only constant for one precision.
+ *
+ * Results:
+ *	The EXPR_FOLD_* value for the node.
+ *
+ * Side effects:
+ *	Sets the fold field of the node and the nodes below it.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExprMarkFolds(nodePtr)
+    ExprNode *nodePtr;
 {
-    long precision;
-    NUMBER *q_rounded = qround(valuePtr->doubleValue, precRequest);
+    int i, fold, argFold;
 
-    Qfree(valuePtr->doubleValue);
-    valuePtr->doubleValue = q_rounded;
-    precision = qplaces(valuePtr->doubleValue);
-    if (precision < 0) {
-	precision = precRequest;
-    } else {
-	precision  = (precision > precRequest) ? precRequest:
-		 (precision == 0) ? 1 : precision;
+    switch (nodePtr->kind) {
+	case EXPR_LITERAL:
+	    fold = EXPR_FOLD_EXACT;
+	    break;
+	case EXPR_UNARY:
+	case EXPR_BINARY:
+	case EXPR_TERNARY:
+	case EXPR_FUNC:
+	    fold = EXPR_FOLD_EXACT;
+	    if ((nodePtr->operator >= LESS) && (nodePtr->operator <= NEQ)) {
+		fold = EXPR_FOLD_PRECISION;
+	    }
+	    if (nodePtr->kind == EXPR_FUNC) {
+		if (!(nodePtr->funcPtr->flags & MP_FUNC_PURE)) {
+		    fold = EXPR_FOLD_NONE;
+		} else if (nodePtr->funcPtr->flags & MP_FUNC_PRECISION) {
+		    fold = EXPR_FOLD_PRECISION;
+		}
+	    }
+	    for (i = 0; i < nodePtr->numArgs; i++) {
+		argFold = ExprMarkFolds(nodePtr->args[i]);
+		if (argFold == EXPR_FOLD_NONE) {
+		    fold = EXPR_FOLD_NONE;
+		} else if ((argFold == EXPR_FOLD_PRECISION)
+			&& (fold == EXPR_FOLD_EXACT)) {
+		    fold = EXPR_FOLD_PRECISION;
+		}
+	    }
+	    break;
+	default:
+	    fold = EXPR_FOLD_NONE;
+	    break;
     }
-    return precision;
+    nodePtr->fold = fold;
+    return fold;
 }
 
-
 /*
- *--------------------------------------------------------------
+ *----------------------------------------------------------------------
  *
- * ExprTopLevel --
+ * ExprGetTree --
  *
- *	This procedure provides top-level functionality shared by
- *	procedures like Mp_ExprInt, Mp_ExprDouble, etc.
+ *	Find the compiled form of an expression in the interpreter's
+ *	expression cache, compiling and caching it if it isn't there.
  *
  * Results:
- *	The result is a standard Tcl return value.  If an error
- *	occurs then an error message is left in the interpreter result.
- *	The value of the expression is returned in *valuePtr, in
- *	whatever form it ends up in (could be string or integer
- *	or double).  Caller may need to convert result.  Caller
- *	is also responsible for freeing string memory in *valuePtr,
- *	if any was allocated.
+ *	The compiled expression, with its reference count incremented
+ *	for the caller, who must release it with ExprReleaseTree.  NULL
+ *	is returned if the expression doesn't compile, and an error
+ *	message is left in the interpreter result.
  *
  * Side effects:
- *	None.
+ *	The math function table and the expression cache are created
+ *	the first time an expression is evaluated.  The cache is
+ *	emptied when it holds MP_EXPR_CACHE_MAX expressions.
  *
- *--------------------------------------------------------------
+ *----------------------------------------------------------------------
  */
 
-static int
-ExprTopLevel(interp, string, valuePtr, mdPtr)
-    Tcl_Interp *interp;			/* Context in which to evaluate the
-					 * expression. */
-    CONST char *string;		/* Expression to evaluate. */
-    Mp_Value *valuePtr;			/* Where to store result.  Should
-					 * not be initialized by caller. */
+static ExprTree *
+ExprGetTree(interp, string, mdPtr)
+    Tcl_Interp *interp;			/* Interpreter to use for error
+					 * reporting. */
+    CONST char *string;			/* Expression to look up. */
     Mp_Data *mdPtr;
 {
-    ExprInfo info;
-    int result;
+    Tcl_HashEntry *hPtr;
+    ExprTree *treePtr;
+    int new;
 
     /*
      * Create the math functions the first time an expression is
      * evaluated.
      */
 
-    if (mdPtr->funcTable == NULL) {
-	BuiltinFunc *funcPtr;
+    GetFuncTable(mdPtr);
 
-	mdPtr->funcTable = (Tcl_HashTable *) ckalloc(sizeof(Tcl_HashTable));
-	Tcl_InitHashTable(mdPtr->funcTable, TCL_STRING_KEYS);
+    if (mdPtr->exprCache == NULL) {
+	mdPtr->exprCache = (Tcl_HashTable *) ckalloc(sizeof(Tcl_HashTable));
+	Tcl_InitHashTable(mdPtr->exprCache, TCL_STRING_KEYS);
+    }
 
-	for (funcPtr = funcTable; funcPtr->name != NULL; funcPtr++) {
-	    CreateMathFunc(mdPtr->funcTable, funcPtr);
-	}
+    hPtr = Tcl_FindHashEntry(mdPtr->exprCache, string);
+    if (hPtr != NULL) {
+	treePtr = (ExprTree *) Tcl_GetHashValue(hPtr);
+	treePtr->refCount++;
+	return treePtr;
     }
 
-    info.originalExpr = string;
-    info.expr = string;
-    valuePtr->pv.buffer = valuePtr->pv.next = valuePtr->staticSpace;
-    valuePtr->pv.end = valuePtr->pv.buffer + STATIC_STRING_SPACE - 1;
-    valuePtr->pv.expandProc = MpExpandParseValue;
-    valuePtr->pv.clientData = (ClientData) NULL;
-    valuePtr->pv.noEval = 0;
+    treePtr = ExprCompile(interp, string, mdPtr);
+    if (treePtr == NULL) {
+	return NULL;
+    }
 
-    result = ExprGetValue(interp, &info, -1, valuePtr, mdPtr);
+    /*
+     * Expressions built on the fly (e.g. with substituted values) would
+     * otherwise grow the cache without bound;  start over when it
+     * gets too big.
+     */
 
-    if (result != TCL_OK) {
-	return result;
-    }
-    if (info.token != END) {
-	Tcl_AppendResult(interp, "syntax error in expression \"",
-		string, "\"", (char *) NULL);
-	return TCL_ERROR;
+    if (mdPtr->exprCache->numEntries >= MP_EXPR_CACHE_MAX) {
+	MpFreeExprCache(mdPtr);
+	mdPtr->exprCache = (Tcl_HashTable *) ckalloc(sizeof(Tcl_HashTable));
+	Tcl_InitHashTable(mdPtr->exprCache, TCL_STRING_KEYS);
     }
+    hPtr = Tcl_CreateHashEntry(mdPtr->exprCache, string, &new);
+    Tcl_SetHashValue(hPtr, (ClientData) treePtr);
+    treePtr->refCount = 2;		/* One for the cache, one for the
+					 * caller. */
+    return treePtr;
+}
 
-    return TCL_OK;
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExprReleaseTree --
+ *
+ *	Drop a reference to a compiled expression, freeing it when
+ *	the last reference goes away.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ExprReleaseTree(treePtr)
+    ExprTree *treePtr;
+{
+    if (--treePtr->refCount <= 0) {
+	ExprFreeNode(treePtr->root);
+	ckfree((char *) treePtr);
+    }
 }
-
+
 /*
- *--------------------------------------------------------------
+ *----------------------------------------------------------------------
  *
- * Mp_ExprString --
+ * ExprGetTreeFromObj --
  *
- *	Evaluate an expression and return its value in string form.
+ *	Get the compiled form of the expression held in objPtr, using
+ *	the object's internal representation if it was compiled for the
+ *	same interpreter and is still current.
  *
  * Results:
- *	A standard Tcl result.  If the result is TCL_OK, then the
- *	interpreter's result is set to the string value of the
- *	expression.  If the result is TCL_OK, then the interpreter result
- *	contains an error message.
+ *	As for ExprGetTree:  the compiled expression with a reference
+ *	held for the caller, or NULL with an error message left in the
+ *	interpreter result.
  *
  * Side effects:
- *	None.
+ *	The object is converted to the "mpexpr" type.
  *
- *--------------------------------------------------------------
+ *----------------------------------------------------------------------
  */
 
-int
-Mp_ExprString(interp, string, mdPtr)
-    Tcl_Interp *interp;			/* Context in which to evaluate the
-					 * expression. */
-    CONST char *string;		/* Expression to evaluate. */
+static ExprTree *
+ExprGetTreeFromObj(interp, objPtr, mdPtr)
+    Tcl_Interp *interp;			/* Interpreter to use for error
+					 * reporting. */
+    Tcl_Obj *objPtr;			/* Expression to look up. */
     Mp_Data *mdPtr;
 {
-    Mp_Value value;
-    int result;
-    long precision;
-    char *math_io;
-    JumpData jd;
-    JumpData **jdPtrPtr = Tcl_GetThreadData(&mp_jdKey, sizeof(JumpData *));
-    JumpData *savePtr = *jdPtrPtr;
-
-    jd.interp = interp;
-    *jdPtrPtr = &jd;
-
-    value.intValue    = _zero_;
-    value.doubleValue = qlink(&_qzero_);
-    value.type        = MP_UNDEF;
-
-    if (setjmp(jd.jb) == 1) {
-	result = TCL_ERROR;
-	goto done;
+    ExprTree *treePtr;
+
+    if (objPtr->typePtr == &mpExprType) {
+	treePtr = (ExprTree *) objPtr->internalRep.twoPtrValue.ptr1;
+	if ((treePtr->mdPtr == mdPtr)
+		&& (treePtr->epoch == mdPtr->exprEpoch)) {
+	    treePtr->refCount++;
+	    return treePtr;
+	}
     }
 
-    result = ExprTopLevel(interp, string, &value, mdPtr);
-
-    if (result == TCL_OK) {
-	if (value.type == MP_INT) {
-    	    math_divertio();
-	    Zprintval(value.intValue, 0L, 0L);
-	    math_io = math_getdivertedio();
-	    math_cleardiversions();
-	    Tcl_SetResult(interp, math_io, TCL_VOLATILE);
-	    ckfree(math_io);
-	} else if (value.type == MP_DOUBLE) {
-	    precision = DeterminePrecision(&value, mdPtr->precision);
-            math_divertio();
-	    Qprintff(value.doubleValue, 0L, precision);
-	    math_io = math_getdivertedio();
-	    math_cleardiversions();
-	    Tcl_SetResult(interp, math_io, TCL_VOLATILE);
-	    ckfree(math_io);
-	} else {
-	    if (value.pv.buffer != value.staticSpace) {
-		Tcl_SetResult(interp, value.pv.buffer, TCL_DYNAMIC);
-		value.pv.buffer = value.staticSpace;
-	    } else {
-		Tcl_SetResult(interp, value.pv.buffer, TCL_VOLATILE);
-	    }
-	}
+    treePtr = ExprGetTree(interp, Tcl_GetString(objPtr), mdPtr);
+    if (treePtr == NULL) {
+	return NULL;
     }
-    if (value.pv.buffer != value.staticSpace) {
-	ckfree(value.pv.buffer);
+    if ((objPtr->typePtr != NULL)
+	    && (objPtr->typePtr->freeIntRepProc != NULL)) {
+	(*objPtr->typePtr->freeIntRepProc)(objPtr);
     }
-
-    math_cleardiversions();
-
-  done:
-    zfree(value.intValue);
-    Qfree(value.doubleValue);
-    *jdPtrPtr = savePtr;
-    return result;
+    treePtr->refCount++;
+    objPtr->internalRep.twoPtrValue.ptr1 = (VOID *) treePtr;
+    objPtr->internalRep.twoPtrValue.ptr2 = NULL;
+    objPtr->typePtr = &mpExprType;
+    return treePtr;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * CreateMathFunc --
- *
- *	Creates a new math function for expressions in a given
- *	interpreter.
- *
- * Results:
- *	None.
+ * FreeExprInternalRep, DupExprInternalRep --
  *
- * Side effects:
- *	The function defined by "name" is created;  if such a function
- *	already existed then its definition is overriden.
+ *	Release or share the compiled expression held by an "mpexpr"
+ *	object.
  *
  *----------------------------------------------------------------------
  */
 
 static void
-CreateMathFunc(table, funcPtr)
-    Tcl_HashTable *table;
-    BuiltinFunc *funcPtr;
+FreeExprInternalRep(objPtr)
+    Tcl_Obj *objPtr;
 {
-    Tcl_HashEntry *hPtr;
-    Mp_MathFunc *mathFuncPtr;
-    int new, i;
-    int numArgs = funcPtr->numArgs;
+    ExprReleaseTree((ExprTree *) objPtr->internalRep.twoPtrValue.ptr1);
+    objPtr->typePtr = NULL;
+}
 
-    hPtr = Tcl_CreateHashEntry(table, funcPtr->name, &new);
+static void
+DupExprInternalRep(srcPtr, copyPtr)
+    Tcl_Obj *srcPtr;
+    Tcl_Obj *copyPtr;
+{
+    ExprTree *treePtr = (ExprTree *) srcPtr->internalRep.twoPtrValue.ptr1;
 
-    if (new) {
-	Tcl_SetHashValue(hPtr, ckalloc(sizeof(Mp_MathFunc)));
-    }
-    mathFuncPtr = (Mp_MathFunc *) Tcl_GetHashValue(hPtr);
-    if (numArgs > MP_MAX_MATH_ARGS) {
-	numArgs = MP_MAX_MATH_ARGS;
-    }
-    mathFuncPtr->numArgs = numArgs;
-    for (i = 0; i < numArgs; i++) {
-	mathFuncPtr->argTypes[i] = funcPtr->argTypes[i];
-    }
-    mathFuncPtr->proc = funcPtr->proc;
-    mathFuncPtr->clientData = funcPtr->clientData;
+    treePtr->refCount++;
+    copyPtr->internalRep.twoPtrValue.ptr1 = (VOID *) treePtr;
+    copyPtr->internalRep.twoPtrValue.ptr2 = NULL;
+    copyPtr->typePtr = &mpExprType;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * ExprFreeMathArgs
+ * ExprNewNumberObj --
  *
+ *	Make an "mpnumber" object without a string representation.
+ *
+ * Results:
+ *	The new object.  The caller's reference to q passes to it.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
  */
 
-static void
-ExprFreeMathArgs (args)
-    Mp_Value *args;
+static Tcl_Obj *
+ExprNewNumberObj(q, places)
+    NUMBER *q;				/* Value of the object. */
+    unsigned long places;		/* MP_NUMBER_INT, or the number of
+					 * places to print q with. */
 {
-    int i;
-    for (i = 0; i < MP_MAX_MATH_ARGS; i++) {
-	zfree(args[i].intValue);
-	Qfree(args[i].doubleValue);
-    }
+    Tcl_Obj *objPtr = Tcl_NewObj();
+
+    qkeep(q);
+    Tcl_InvalidateStringRep(objPtr);
+    objPtr->internalRep.ptrAndLongRep.ptr = (VOID *) q;
+    objPtr->internalRep.ptrAndLongRep.value = places;
+    objPtr->typePtr = &mpNumberType;
+    return objPtr;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * ExprMathFunc --
+ * ExprGetObjValue --
  *
- *	This procedure is invoked to parse a math function from an
- *	expression string, carry out the function, and return the
- *	value computed.
+ *	Make a Value out of an object, such as the value of a variable.
+ *	This is ExprParseString for objects:  "mpnumber" objects are
+ *	used without looking at their string, and other objects that
+ *	hold a number are converted to "mpnumber" so they are only
+ *	parsed once.
  *
  * Results:
- *	TCL_OK is returned if all went well and the function's value
- *	was computed successfully.  If an error occurred, TCL_ERROR
- *	is returned and an error message is left in the interpreter result.
- *	After a successful return infoPtr has been updated to refer
- *	to the character just after the function call, the token is
- *	set to VALUE, and the value is stored in valuePtr.
+ *	Always TCL_OK.
  *
  * Side effects:
- *	Embedded commands could have arbitrary side-effects.
+ *	The object may be converted to the "mpnumber" type.
  *
  *----------------------------------------------------------------------
  */
 
 static int
-ExprMathFunc(interp, infoPtr, valuePtr, mdPtr)
-    Tcl_Interp *interp;			/* Interpreter to use for error
-					 * reporting. */
-    register ExprInfo *infoPtr;		/* Describes the state of the parse.
-					 * infoPtr->expr must point to the
-					 * first character of the function's
-					 * name. */
-    register Mp_Value *valuePtr;	/* Where to store value, if that is
-					 * what's parsed from string.  Caller
-					 * must have initialized pv field
-					 * correctly. */
-    Mp_Data *mdPtr;
+ExprGetObjValue(interp, objPtr, valuePtr)
+    Tcl_Interp *interp;			/* Where to store error message. */
+    Tcl_Obj *objPtr;			/* Object to turn into value. */
+    Mp_Value *valuePtr;			/* Where to store value information.
+					 * Caller must have initialized pv
+					 * field. */
 {
-    Mp_MathFunc *mathFuncPtr;		/* Info about math function. */
-    Mp_Value args[MP_MAX_MATH_ARGS];	/* Arguments for function call. */
-    Mp_Value funcResult;		/* Result of function call. */
-    Tcl_HashEntry *hPtr;
-    CONST char *p;
-    CONST char *funcName;
-    char *funcNameCopy;
-    int i, result;
-
-    funcResult.intValue    = _zero_;
-    funcResult.doubleValue = qlink(&_qzero_);
-    funcResult.type        = MP_UNDEF;
+    NUMBER *q;
+    int result;
 
-    for (i = 0; i < MP_MAX_MATH_ARGS; i++) {
-	args[i].type = MP_UNDEF;
-	args[i].intValue = _zero_;
-	args[i].doubleValue = qlink(&_qzero_);
+    if (objPtr->typePtr != &mpNumberType) {
+	result = ExprParseString(interp, Tcl_GetString(objPtr), valuePtr);
+	if ((result != TCL_OK) || (valuePtr->type == MP_STRING)) {
+	    return result;
+	}
+	if (valuePtr->type == MP_INT) {
+	    q = qalloc();
+	    zcopy(valuePtr->intValue, &q->num);
+	} else {
+	    q = qlink(valuePtr->doubleValue);
+	}
+	qkeep(q);
+	if ((objPtr->typePtr != NULL)
+		&& (objPtr->typePtr->freeIntRepProc != NULL)) {
+	    (*objPtr->typePtr->freeIntRepProc)(objPtr);
+	}
+	objPtr->internalRep.ptrAndLongRep.ptr = (VOID *) q;
+	objPtr->internalRep.ptrAndLongRep.value =
+		(valuePtr->type == MP_INT) ? MP_NUMBER_INT : 0;
+	objPtr->typePtr = &mpNumberType;
+	return TCL_OK;
     }
 
-    /*
-     * Find the end of the math function's name and lookup the MathFunc
-     * record for the function.
-     */
-
-    p = funcName = infoPtr->expr;
-    while (isalnum(UCHAR(*p)) || (*p == '_')) {
-	p++;
-    }
-    infoPtr->expr = p;
-    result = ExprLex(interp, infoPtr, valuePtr, mdPtr);
-    if (result != TCL_OK) {
-	return TCL_ERROR;
-    }
-    if (infoPtr->token != OPEN_PAREN) {
-	goto syntaxError;
-    }
-    i = (p - funcName) + 1;
-    funcNameCopy = ckalloc(i);
-    funcNameCopy[--i] = '\0';
-    while(i>0) {
-        --i;
-        funcNameCopy[i] = funcName[i];
-    }
-    hPtr = Tcl_FindHashEntry(mdPtr->funcTable, funcNameCopy);
-    if (hPtr == NULL) {
-	Tcl_AppendResult(interp, "unknown math function \"", funcNameCopy,
-                         "\"", (char *) NULL);
-        ckfree(funcNameCopy);
-	return TCL_ERROR;
+    q = (NUMBER *) objPtr->internalRep.ptrAndLongRep.ptr;
+    if (objPtr->internalRep.ptrAndLongRep.value == MP_NUMBER_INT) {
+	valuePtr->type = MP_INT;
+	zfree(valuePtr->intValue);
+	zcopy(q->num, &valuePtr->intValue);
+    } else {
+	valuePtr->type = MP_DOUBLE;
+	Qfree(valuePtr->doubleValue);
+	valuePtr->doubleValue = qlink(q);
     }
-    ckfree(funcNameCopy);
-    mathFuncPtr = (Mp_MathFunc *) Tcl_GetHashValue(hPtr);
-
-    /*
-     * Scan off the arguments for the function, if there are any.
-     */
+    return TCL_OK;
+}
 
-    if (mathFuncPtr->numArgs == 0) {
-	result = ExprLex(interp, infoPtr, valuePtr, mdPtr);
-	if ((result != TCL_OK) || (infoPtr->token != CLOSE_PAREN)) {
-	    goto syntaxError;
-	}
-    } else {
-	for (i = 0; ; i++) {
-	    valuePtr->pv.next = valuePtr->pv.buffer;
-	    result = ExprGetValue(interp, infoPtr, -1, valuePtr, mdPtr);
-	    if (result != TCL_OK) {
-		ExprFreeMathArgs(args);
-        	zfree(funcResult.intValue);
-        	Qfree(funcResult.doubleValue);
-		return result;
-	    }
-	    if (valuePtr->type == MP_STRING) {
-		ExprFreeMathArgs(args);
-        	zfree(funcResult.intValue);
-        	Qfree(funcResult.doubleValue);
-		Tcl_SetResult(interp, "argument to math function didn't have numeric value", TCL_STATIC);
-		return TCL_ERROR;
-	    }
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeNumberInternalRep, DupNumberInternalRep, UpdateStringOfNumber --
+ *
+ *	Procedures for the "mpnumber" object type.  The string of an
+ *	integer is printed as by Zprintval;  a floating-point value is
+ *	printed as by Qprintff with the places saved in the object.
+ *
+ *----------------------------------------------------------------------
+ */
 
-	    /*
-	     * Copy the value to the argument record, converting it if
-	     * necessary.
-	     */
+static void
+FreeNumberInternalRep(objPtr)
+    Tcl_Obj *objPtr;
+{
+    qfree((NUMBER *) objPtr->internalRep.ptrAndLongRep.ptr);
+    objPtr->typePtr = NULL;
+}
 
-	    if (valuePtr->type == MP_INT) {
-		if (mathFuncPtr->argTypes[i] == MP_DOUBLE) {
-		    args[i].type = MP_DOUBLE;
-		    zcopy(valuePtr->intValue, &(args[i].intValue));
-		    args[i].doubleValue = qlink(&_qzero_);
-		    ExprConvIntToDouble(&args[i]);
-		} else {
-		    args[i].type = MP_INT;
-		    zcopy(valuePtr->intValue, &(args[i].intValue));
-		    args[i].doubleValue = qlink(&_qzero_);
-		}
-	    } else {
-		if (mathFuncPtr->argTypes[i] == MP_INT) {
-		    args[i].type = MP_INT;
-		    args[i].doubleValue = qcopy(valuePtr->doubleValue);
-		    args[i].intValue = _zero_;
-		    ExprConvDoubleToInt(&args[i]);
-		} else {
-		    args[i].type = MP_DOUBLE;
-		    args[i].intValue = _zero_;
-		    args[i].doubleValue = qcopy(valuePtr->doubleValue);
-		}
-	    }
+static void
+DupNumberInternalRep(srcPtr, copyPtr)
+    Tcl_Obj *srcPtr;
+    Tcl_Obj *copyPtr;
+{
+    copyPtr->internalRep.ptrAndLongRep.ptr =
+	    (VOID *) qlink((NUMBER *) srcPtr->internalRep.ptrAndLongRep.ptr);
+    copyPtr->internalRep.ptrAndLongRep.value =
+	    srcPtr->internalRep.ptrAndLongRep.value;
+    copyPtr->typePtr = &mpNumberType;
+}
 
-	    /*
-	     * Check for a comma separator between arguments or a close-paren
-	     * to end the argument list.
-	     */
+static void
+UpdateStringOfNumber(objPtr)
+    Tcl_Obj *objPtr;
+{
+    NUMBER *q = (NUMBER *) objPtr->internalRep.ptrAndLongRep.ptr;
+    unsigned long places = objPtr->internalRep.ptrAndLongRep.value;
 
-	    if (i == (mathFuncPtr->numArgs-1)) {
-		if (infoPtr->token == CLOSE_PAREN) {
-		    break;
-		}
-		if (infoPtr->token == COMMA) {
-		    Tcl_SetResult(interp, "too many arguments for math function", TCL_STATIC);
-		    ExprFreeMathArgs(args);
-        	    zfree(funcResult.intValue);
-        	    Qfree(funcResult.doubleValue);
-		    return TCL_ERROR;
-		} else {
-		    goto syntaxError;
-		}
-	    }
-	    if (infoPtr->token != COMMA) {
-		if (infoPtr->token == CLOSE_PAREN) {
-		    Tcl_SetResult(interp, "too few arguments for math function", TCL_STATIC);
-		    ExprFreeMathArgs(args);
-        	    zfree(funcResult.intValue);
-        	    Qfree(funcResult.doubleValue);
-		    return TCL_ERROR;
-		} else {
-		    goto syntaxError;
-		}
-	    }
-	}
-    }
-    if (valuePtr->pv.noEval) {
-	ExprFreeMathArgs(args);
-        zfree(funcResult.intValue);
-        Qfree(funcResult.doubleValue);
-	valuePtr->type = MP_INT;
-	zfree(valuePtr->intValue);
-	valuePtr->intValue = _zero_;
-	infoPtr->token = VALUE;
-	return TCL_OK;
+    math_divertio();
+    if (places == MP_NUMBER_INT) {
+	Zprintval(q->num, 0L, 0L);
+    } else {
+	Qprintff(q, 0L, (long) places);
     }
+    objPtr->bytes = math_getdivertedio();
+    objPtr->length = strlen(objPtr->bytes);
+}
 
-    /*
-     * Invoke the function and copy its result back into valuePtr.
-     */
-
-    result = (*mathFuncPtr->proc)(mathFuncPtr->clientData, interp, args,
-	    mdPtr, &funcResult);
+/*
+ *----------------------------------------------------------------------
+ *
+ * MpFreeExprCache --
+ *
+ *	Release all the compiled expressions cached for an
+ *	interpreter.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Expressions being evaluated when the cache is emptied stay
+ *	alive until their evaluation finishes.
+ *
+ *----------------------------------------------------------------------
+ */
 
-    ExprFreeMathArgs(args);
+void
+MpFreeExprCache(mdPtr)
+    Mp_Data *mdPtr;
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
 
-    if (result != TCL_OK) {
-        zfree(funcResult.intValue);
-        Qfree(funcResult.doubleValue);
-	return result;
+    if (mdPtr->exprCache == NULL) {
+	return;
     }
-    if (funcResult.type == MP_INT) {
-	valuePtr->type = MP_INT;
-	zfree(valuePtr->intValue);
-	zcopy(funcResult.intValue, &valuePtr->intValue);
-    } else {
-	valuePtr->type = MP_DOUBLE;
-	Qfree(valuePtr->doubleValue);
-	valuePtr->doubleValue = qcopy(funcResult.doubleValue);
+    for (hPtr = Tcl_FirstHashEntry(mdPtr->exprCache, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	ExprReleaseTree((ExprTree *) Tcl_GetHashValue(hPtr));
     }
-    infoPtr->token = VALUE;
-    zfree(funcResult.intValue);
-    Qfree(funcResult.doubleValue);
-    return TCL_OK;
+    Tcl_DeleteHashTable(mdPtr->exprCache);
+    ckfree((char *) mdPtr->exprCache);
+    mdPtr->exprCache = NULL;
+}
 
-    syntaxError:
-    zfree(funcResult.intValue);
-    Qfree(funcResult.doubleValue);
-    Tcl_AppendResult(interp, "syntax error in expression \"",
-	    infoPtr->originalExpr, "\"", (char *) NULL);
-    return TCL_ERROR;
+/*
+ *----------------------------------------------------------------------
+ *
+ * MpNewExprEpoch --
+ *
+ *	Invalidate every expression compiled for an interpreter, e.g.
+ *	because its math functions have been deleted.  Each call hands
+ *	out an epoch number never used before in the process, so trees
+ *	held by Tcl_Objs can't match Mp_Data allocated later at the
+ *	same address.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The expression cache is emptied.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+MpNewExprEpoch(mdPtr)
+    Mp_Data *mdPtr;
+{
+    static long lastEpoch = 0;
+    TCL_DECLARE_MUTEX(epochMutex)
+
+    MpFreeExprCache(mdPtr);
+    Tcl_MutexLock(&epochMutex);
+    mdPtr->exprEpoch = ++lastEpoch;
+    Tcl_MutexUnlock(&epochMutex);
 }
 
 /*
@@ -2273,6 +4136,33 @@ ExprBinary2Func(clientData, interp, args, mdPtr, resultPtr)
     return TCL_OK;
 }
 
+static int
+ExprMinMaxFunc(clientData, interp, numArgs, args, mdPtr, resultPtr)
+    ClientData clientData;		/* Contains address of qmin or
+					 * qmax. */
+    Tcl_Interp *interp;
+    int numArgs;
+    Mp_Value *args;
+    Mp_Data *mdPtr;
+    Mp_Value *resultPtr;
+{
+    NUMBER *(*func) _ANSI_ARGS_((NUMBER *, NUMBER *))
+	= (NUMBER *(*)_ANSI_ARGS_((NUMBER *, NUMBER *))) clientData;
+    NUMBER *q, *q_tmp;
+    int i;
+
+    q = qlink(args[0].doubleValue);
+    for (i = 1; i < numArgs; i++) {
+	q_tmp = (*func)(q, args[i].doubleValue);
+	qfree(q);
+	q = q_tmp;
+    }
+    resultPtr->type = MP_DOUBLE;
+    Qfree(resultPtr->doubleValue);
+    resultPtr->doubleValue = q;
+    return TCL_OK;
+}
+
 static int
 ExprBinaryZFunc(clientData, interp, args, mdPtr, resultPtr)
     ClientData clientData;		/* Contains address of procedure that
@@ -2567,7 +4457,7 @@ Atoz (s, res, term)
     ZVALUE *res;
     CONST char **term;
 {
-    ZVALUE z, ztmp, digit;
+    ZVALUE z, digit;
     HALF digval;
     BOOL minus;
     long shift;
@@ -2644,12 +4534,10 @@ Atoz (s, res, term)
 	    else
 		    break;
 	    if (shift)
-		    zshift(z, shift, &ztmp);
+		    zshiftby(&z, shift);
 	    else
-		    zmuli(z, 10L, &ztmp);
-	    zfree(z);
-	    zadd(ztmp, digit, &z);
-	    zfree(ztmp);
+		    zmuliby(&z, 10L);
+	    zaddto(&z, digit);
 	    s++;
     }
 
@@ -2933,6 +4821,3 @@ Zrelprime(z1, z2, res)
 	*res = _zero_;
     }
 }
-
-
-
@@ -61,6 +61,8 @@ typedef void * Tcl_ThreadDataKey;
     ? *(keyPtr) = ckalloc(size), memset((*keyPtr), 0, (size)), (*keyPtr) \
     : *(keyPtr)
 
+#define Tcl_CreateThreadExitHandler(proc, clientData)
+
 #define TCL_DECLARE_MUTEX(name)
 #define Tcl_MutexLock(mutexPtr)
 #define Tcl_MutexUnlock(mutexPtr)
@@ -82,18 +84,52 @@ typedef void * Tcl_ThreadDataKey;
 #define MP_PRECISION_VAR      "mp_precision"
 #define MP_PRECISION_MAX      10000
 
+#define MP_EXPR_CACHE_MAX     1000	/* compiled expressions kept per
+					 * interpreter */
+
+#define MP_EPSILON_CACHE_MAX  64	/* epsilons kept per interpreter */
+
+#define MP_ASSOC_KEY	      "Mpexpr"	/* Tcl_GetAssocData key for the
+					 * interpreter's Mp_Data */
+
 typedef struct Mp_Data {
     Tcl_Interp *interp;
     char *precVarName;
     long precision;
+    long precisionSets;		/* Number of times mp_precision has been
+				 * set or unset. */
     NUMBER *epsilon;
+    Tcl_HashTable *epsilonCache;	/* Epsilon for each precision used,
+					 * keyed by precision. */
     Tcl_Command exprCmd;
     Tcl_HashTable *funcTable;
     Tcl_Command fmtCmd;
+    Tcl_HashTable *exprCache;	/* Compiled expressions, keyed by
+				 * expression string. */
+    long exprEpoch;		/* Compiled expressions from another
+				 * epoch are stale;  see MpNewExprEpoch. */
+    int numBindings;		/* Number of variables bound by the
+				 * running mpexpr -map, or 0. */
+    CONST char **bindNames;	/* Names of the bound variables. */
+    Tcl_Obj **bindValues;	/* Their values for the current row. */
 } Mp_Data;
 
 EXTERN int		Mp_ExprString _ANSI_ARGS_((Tcl_Interp *interp,
-			    CONST char *string, Mp_Data *mdPtr));
+			    CONST char *string, long precision,
+			    Mp_Data *mdPtr));
+EXTERN int		Mp_ExprObj _ANSI_ARGS_((Tcl_Interp *interp,
+			    Tcl_Obj *objPtr, long precision, Mp_Data *mdPtr));
+EXTERN int		Mp_ExprMap _ANSI_ARGS_((Tcl_Interp *interp,
+			    Tcl_Obj *varsPtr, Tcl_Obj *rowsPtr,
+			    Tcl_Obj *exprPtr, long precision,
+			    Mp_Data *mdPtr));
+EXTERN int		Mp_ExprReduce _ANSI_ARGS_((Tcl_Interp *interp,
+			    Tcl_Obj *opPtr, Tcl_Obj *listPtr,
+			    long precision, Mp_Data *mdPtr));
+EXTERN NUMBER *		MpGetEpsilon _ANSI_ARGS_((Mp_Data *mdPtr,
+			    long precision));
+EXTERN void		MpFreeExprCache _ANSI_ARGS_((Mp_Data *mdPtr));
+EXTERN void		MpNewExprEpoch _ANSI_ARGS_((Mp_Data *mdPtr));
 EXTERN int              Mp_FormatString _ANSI_ARGS_((Tcl_Interp *interp,
 			    int argc, CONST84 char **argv));
 
@@ -126,6 +162,59 @@ EXTERN int              MpParseNestedCmd _ANSI_ARGS_((Tcl_Interp *interp,
                             ParseValue *pvPtr));
 EXTERN CONST char *     Mp_ParseVar _ANSI_ARGS_((Tcl_Interp *interp,
                             CONST char *string, CONST char **termPtr, int noEval));
+EXTERN Tcl_Obj *	Mp_ParseVarObj _ANSI_ARGS_((Tcl_Interp *interp,
+                            CONST char *string));
+
+/*
+ * The data structure below is used to describe an expression value,
+ * which can be either an integer (the usual case), a double-precision
+ * floating-point value, or a string.  A given number has only one
+ * value at a time.
+ */
+
+#define STATIC_STRING_SPACE 150
+
+typedef enum {MP_INT, MP_DOUBLE, MP_EITHER, MP_STRING, MP_UNDEF} Mp_ValueType;
+
+typedef struct {
+    ZVALUE intValue;		/* Integer value, if any. */
+    NUMBER *doubleValue;	/* Floating-point value, if any. */
+    ParseValue pv;		/* Used to hold a string value, if any. */
+    char staticSpace[STATIC_STRING_SPACE];
+				/* Storage for small strings;  large ones
+				 * are malloc-ed. */
+    Mp_ValueType type;		/* Type of value:  MP_INT, MP_DOUBLE,
+				 * or MP_STRING. */
+} Mp_Value;
+
+/*
+ * Procedures implementing math functions.  The arguments have been
+ * converted to the types given when the function was created (MP_EITHER
+ * leaves them as they are) and must not be modified.  The procedure
+ * sets resultPtr->type to MP_INT or MP_DOUBLE and replaces the matching
+ * intValue or doubleValue, freeing the old one.  A variadic procedure
+ * is also told how many arguments were given.  Numbers and integers made
+ * during an evaluation are freed if it is abandoned by an error, so a
+ * value a procedure keeps beyond its call, such as a constant built on
+ * first use, must be taken out of the evaluation with qkeep or zkeep.
+ */
+
+typedef int (Mp_MathProc) _ANSI_ARGS_((ClientData clientData,
+	Tcl_Interp *interp, Mp_Value *args, Mp_Data *mdPtr,
+	Mp_Value *resultPtr));
+typedef int (Mp_VarMathProc) _ANSI_ARGS_((ClientData clientData,
+	Tcl_Interp *interp, int numArgs, Mp_Value *args, Mp_Data *mdPtr,
+	Mp_Value *resultPtr));
+
+EXTERN int		Mp_CreateMathFunc _ANSI_ARGS_((Tcl_Interp *interp,
+			    CONST char *name, int numArgs,
+			    Mp_ValueType *argTypes, Mp_MathProc *proc,
+			    ClientData clientData));
+EXTERN int		Mp_CreateVarMathFunc _ANSI_ARGS_((Tcl_Interp *interp,
+			    CONST char *name, int minArgs,
+			    Mp_ValueType argType, Mp_VarMathProc *proc,
+			    ClientData clientData));
+EXTERN void		MpFreeMathFuncs _ANSI_ARGS_((Mp_Data *mdPtr));
 
 EXTERN NUMBER *		Atoq _ANSI_ARGS_((CONST char *, CONST char **));
 #define Qfree(q)  qfree(q); (q)=NULL
@@ -47,14 +47,20 @@ LPVOID reserved;            /* Not used. */
 
 #endif
 
-static Tcl_CmdProc ExprCmd;
-static Tcl_CmdProc FormatCmd;
+static Tcl_ObjCmdProc ExprObjCmd;
+static Tcl_ObjCmdProc FormatObjCmd;
+static Tcl_ObjCmdProc TuneObjCmd;
+static Tcl_ObjCmdProc StatsObjCmd;
 static Tcl_VarTraceProc PrecTrace;
 static Tcl_CmdDeleteProc ExprDelete;
 static Tcl_CmdDeleteProc FormatDelete;
 
 static void DestroyMeData(Mp_Data *mdPtr);
 static void UpdateEpsilon(Mp_Data *mdPtr);
+static void FreeEpsilonCache(Mp_Data *mdPtr);
+static int GetPrecisionFromObj(Tcl_Interp *interp, Tcl_Obj *objPtr,
+	long *precisionPtr);
+static void AppendStat(Tcl_Obj *listPtr, CONST char *name, long value);
 
 /*
  *----------------------------------------------------------------------
@@ -95,12 +101,24 @@ Mpexpr_Init (interp)
     mdPtr->interp = interp;
     mdPtr->precVarName = MP_PRECISION_VAR;
     mdPtr->precision = 0;
+    mdPtr->precisionSets = 0;
     mdPtr->epsilon = NULL;
-    mdPtr->exprCmd = Tcl_CreateCommand (interp, "mpexpr", ExprCmd,
+    mdPtr->epsilonCache = NULL;
+    mdPtr->exprCmd = Tcl_CreateObjCommand (interp, "mpexpr", ExprObjCmd,
 	    (ClientData) mdPtr, ExprDelete);
     mdPtr->funcTable = NULL;
-    mdPtr->fmtCmd = Tcl_CreateCommand (interp, "mpformat", FormatCmd,
+    mdPtr->exprCache = NULL;
+    MpNewExprEpoch(mdPtr);
+    mdPtr->numBindings = 0;
+    mdPtr->bindNames = NULL;
+    mdPtr->bindValues = NULL;
+    mdPtr->fmtCmd = Tcl_CreateObjCommand (interp, "mpformat", FormatObjCmd,
 	    (ClientData) mdPtr, FormatDelete);
+    Tcl_SetAssocData(interp, MP_ASSOC_KEY, NULL, (ClientData) mdPtr);
+    Tcl_CreateObjCommand (interp, "mptune", TuneObjCmd, (ClientData) NULL,
+	    (Tcl_CmdDeleteProc *) NULL);
+    Tcl_CreateObjCommand (interp, "mpstats", StatsObjCmd, (ClientData) NULL,
+	    (Tcl_CmdDeleteProc *) NULL);
 
     /* set up trace on mp_precision */
     Tcl_TraceVar(interp, mdPtr->precVarName,
@@ -120,65 +138,118 @@ Mpexpr_Init (interp)
 /*
  *----------------------------------------------------------------------
  *
- * ExprCmd --
+ * ExprObjCmd --
  *
- * interface to Mp_ExprString
+ * interface to Mp_ExprObj
  *
  *----------------------------------------------------------------------
  */
 
 	
 static int
-ExprCmd(clientData, interp, argc, argv)
+ExprObjCmd(clientData, interp, objc, objv)
     ClientData clientData;		/* Client Data. */
     Tcl_Interp *interp;			/* Current interpreter. */
-    int argc;				/* Number of arguments. */
-    CONST84 char **argv;		/* Argument strings. */
+    int objc;				/* Number of arguments. */
+    Tcl_Obj *CONST objv[];		/* Argument objects. */
 {
-    Tcl_DString buffer;
-    int i, result;
+    Tcl_Obj *objPtr;
+    long precision = -1;
+    int result;
     Mp_Data *mdPtr = (Mp_Data *) clientData;
 
-    if (argc < 2) {
-	Tcl_AppendResult(interp, "wrong # args: should be \"", argv[0],
-		" arg ?arg ...?\"", (char *) NULL);
+    if (objc < 2) {
+	Tcl_WrongNumArgs(interp, 1, objv, "?-precision digits? arg ?arg ...?");
 	return TCL_ERROR;
     }
 
-    if (argc == 2) {
-        result = Mp_ExprString(interp, argv[1], mdPtr);
-	return result;
+    /*
+     * mpexpr -precision digits ...
+     */
+
+    if (strcmp(Tcl_GetString(objv[1]), "-precision") == 0) {
+	if (objc < 4) {
+	    Tcl_WrongNumArgs(interp, 1, objv,
+		    "?-precision digits? arg ?arg ...?");
+	    return TCL_ERROR;
+	}
+	if (GetPrecisionFromObj(interp, objv[2], &precision) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	objc -= 2;
+	objv += 2;
     }
-    Tcl_DStringInit(&buffer);
-    Tcl_DStringAppend(&buffer, argv[1], -1);
-    for (i = 2; i < argc; i++) {
-	Tcl_DStringAppend(&buffer, " ", 1);
-	Tcl_DStringAppend(&buffer, argv[i], -1);
+
+    if (objc == 2) {
+	return Mp_ExprObj(interp, objv[1], precision, mdPtr);
     }
-    result = Mp_ExprString(interp, buffer.string, mdPtr);
-    Tcl_DStringFree(&buffer);
+
+    /*
+     * mpexpr -map varList rowList expression
+     */
+
+    if ((objc == 5) && (strcmp(Tcl_GetString(objv[1]), "-map") == 0)) {
+	return Mp_ExprMap(interp, objv[2], objv[3], objv[4], precision,
+		mdPtr);
+    }
+
+    /*
+     * mpexpr -reduce reduction list
+     */
+
+    if ((objc == 4) && (strcmp(Tcl_GetString(objv[1]), "-reduce") == 0)) {
+	return Mp_ExprReduce(interp, objv[2], objv[3], precision, mdPtr);
+    }
+    objPtr = Tcl_ConcatObj(objc-1, objv+1);
+    Tcl_IncrRefCount(objPtr);
+    result = Mp_ExprObj(interp, objPtr, precision, mdPtr);
+    Tcl_DecrRefCount(objPtr);
     return result;
 
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetPrecisionFromObj --
+ *
+ *	Get the value of a -precision option, checked the way values
+ *	of mp_precision are.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+GetPrecisionFromObj(interp, objPtr, precisionPtr)
+    Tcl_Interp *interp;
+    Tcl_Obj *objPtr;
+    long *precisionPtr;
+{
+    CONST char *sVal = Tcl_GetString(objPtr);
+    int iVal;
+
+    /* Avoid Octal problem */
+    while (*sVal == '0' && sVal[1] != '\0') {
+	sVal++;
+    }
+    if ((Tcl_GetInt((Tcl_Interp *) NULL, sVal, &iVal) != TCL_OK)
+	    || (iVal < 0) || (iVal > MP_PRECISION_MAX)) {
+	Tcl_AppendResult(interp, "improper precision value \"",
+		Tcl_GetString(objPtr), "\"", (char *) NULL);
+	return TCL_ERROR;
+    }
+    *precisionPtr = iVal;
+    return TCL_OK;
+}
+
 static void
 ExprDelete(clientData)
     ClientData clientData;
 {
     Mp_Data *mdPtr = (Mp_Data *)clientData;
 
-    if (mdPtr->funcTable) {
-	Tcl_HashEntry *hPtr;
-	Tcl_HashSearch search;
-
-	for (hPtr = Tcl_FirstHashEntry(mdPtr->funcTable, &search); hPtr;
-		hPtr = Tcl_NextHashEntry(&search)) {
-	    ckfree((char *) Tcl_GetHashValue(hPtr));
-	}
-	Tcl_DeleteHashTable(mdPtr->funcTable);
-	ckfree((char *)mdPtr->funcTable);
-	mdPtr->funcTable = NULL;
-    }
+    MpFreeMathFuncs(mdPtr);
+    MpNewExprEpoch(mdPtr);
     mdPtr->exprCmd = NULL;
     if (mdPtr->fmtCmd == NULL) {
 	DestroyMeData(mdPtr);
@@ -188,7 +259,7 @@ ExprDelete(clientData)
 /*
  *----------------------------------------------------------------------
  *
- * FormatCmd --
+ * FormatObjCmd --
  *
  * interface to Qformat
  *
@@ -196,19 +267,32 @@ ExprDelete(clientData)
  */
 	
 static int
-FormatCmd(dummy, interp, argc, argv)
+FormatObjCmd(dummy, interp, objc, objv)
     ClientData dummy;			/* Not used. */
     Tcl_Interp *interp;			/* Current interpreter. */
-    int argc;				/* Number of arguments. */
-    CONST84 char **argv;		/* Argument strings. */
+    int objc;				/* Number of arguments. */
+    Tcl_Obj *CONST objv[];		/* Argument objects. */
 {
-    if (argc < 2) {
-	Tcl_AppendResult(interp, "wrong # args: should be \"", argv[0],
-		" arg ?arg ...?\"", (char *) NULL);
+    CONST char *staticArgv[10];
+    CONST char **argv = staticArgv;
+    int i, result;
+
+    if (objc < 2) {
+	Tcl_WrongNumArgs(interp, 1, objv, "arg ?arg ...?");
 	return TCL_ERROR;
     }
 
-    return (Mp_FormatString(interp, argc, argv));
+    if (objc > 10) {
+	argv = (CONST char **) ckalloc(objc * sizeof(char *));
+    }
+    for (i = 0; i < objc; i++) {
+	argv[i] = Tcl_GetString(objv[i]);
+    }
+    result = Mp_FormatString(interp, objc, (CONST84 char **) argv);
+    if (argv != staticArgv) {
+	ckfree((char *) argv);
+    }
+    return result;
 }
 
 static void
@@ -223,6 +307,176 @@ FormatDelete(clientData)
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * TuneObjCmd --
+ *
+ *	mptune ?name ?size??
+ *
+ *	Query or change the sizes in words where the faster multiply,
+ *	square and modulo algorithms take over.  With no arguments, a
+ *	list of names and sizes is returned.  The sizes are shared by
+ *	every interpreter in the process.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TuneObjCmd(dummy, interp, objc, objv)
+    ClientData dummy;			/* Not used. */
+    Tcl_Interp *interp;			/* Current interpreter. */
+    int objc;				/* Number of arguments. */
+    Tcl_Obj *CONST objv[];		/* Argument objects. */
+{
+    TUNE *tp;
+    Tcl_Obj *listPtr;
+    int index;
+    long size;
+    char buf[40];
+
+    if (objc > 3) {
+	Tcl_WrongNumArgs(interp, 1, objv, "?name ?size??");
+	return TCL_ERROR;
+    }
+    if (objc == 1) {
+	listPtr = Tcl_NewListObj(0, (Tcl_Obj **) NULL);
+	for (tp = _tunes_; tp->name != NULL; tp++) {
+	    Tcl_ListObjAppendElement((Tcl_Interp *) NULL, listPtr,
+		    Tcl_NewStringObj(tp->name, -1));
+	    Tcl_ListObjAppendElement((Tcl_Interp *) NULL, listPtr,
+		    Tcl_NewLongObj((long) *tp->size));
+	}
+	Tcl_SetObjResult(interp, listPtr);
+	return TCL_OK;
+    }
+    if (Tcl_GetIndexFromObjStruct(interp, objv[1], (CONST VOID *) _tunes_,
+	    sizeof(TUNE), "name", 0, &index) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    tp = &_tunes_[index];
+    if (objc == 3) {
+	if (Tcl_GetLongFromObj(interp, objv[2], &size) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	if (size < tp->least) {
+	    sprintf(buf, "%ld", (long) tp->least);
+	    Tcl_AppendResult(interp, "size for ", tp->name,
+		    " must be at least ", buf, (char *) NULL);
+	    return TCL_ERROR;
+	}
+	*tp->size = size;
+    }
+    Tcl_SetObjResult(interp, Tcl_NewLongObj((long) *tp->size));
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StatsObjCmd --
+ *
+ *	mpstats
+ *
+ *	Return a list of names and values describing the memory used
+ *	by the current thread for numbers:  the arrays of words in use
+ *	and kept for reuse, in total and for each size class, the
+ *	temporary buffer of the multiply routines, and the number
+ *	nodes.  The table of powers of ten is shared by every thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+StatsObjCmd(dummy, interp, objc, objv)
+    ClientData dummy;			/* Not used. */
+    Tcl_Interp *interp;			/* Current interpreter. */
+    int objc;				/* Number of arguments. */
+    Tcl_Obj *CONST objv[];		/* Argument objects. */
+{
+    Tcl_Obj *listPtr, *classesPtr, *classPtr;
+    ZSTAT st;
+    long allocs, frees, bytes, pooled, pooledBytes, total, count;
+    long arrays;
+    int class;
+
+    if (objc != 1) {
+	Tcl_WrongNumArgs(interp, 1, objv, NULL);
+	return TCL_ERROR;
+    }
+    allocs = frees = bytes = pooled = pooledBytes = 0;
+    classesPtr = Tcl_NewListObj(0, (Tcl_Obj **) NULL);
+    for (class = 0; zallocstat(class, &st); class++) {
+	arrays = st.allocs - st.frees;
+	classPtr = Tcl_NewListObj(0, (Tcl_Obj **) NULL);
+	AppendStat(classPtr, "allocs", st.allocs);
+	AppendStat(classPtr, "frees", st.frees);
+	AppendStat(classPtr, "bytes",
+		arrays * sizeof(ZHEAD) + st.words * sizeof(HALF));
+	AppendStat(classPtr, "pooled", st.pooled);
+	if (st.size != 0) {
+	    Tcl_ListObjAppendElement((Tcl_Interp *) NULL, classesPtr,
+		    Tcl_NewLongObj((long) st.size));
+	} else {
+	    Tcl_ListObjAppendElement((Tcl_Interp *) NULL, classesPtr,
+		    Tcl_NewStringObj("large", -1));
+	}
+	Tcl_ListObjAppendElement((Tcl_Interp *) NULL, classesPtr, classPtr);
+	allocs += st.allocs;
+	frees += st.frees;
+	bytes += arrays * sizeof(ZHEAD) + st.words * sizeof(HALF);
+	pooled += st.pooled;
+	pooledBytes += st.pooled * (sizeof(ZHEAD) + st.size * sizeof(HALF));
+    }
+    qnodestat(&total, &count);
+
+    listPtr = Tcl_NewListObj(0, (Tcl_Obj **) NULL);
+    AppendStat(listPtr, "allocs", allocs);
+    AppendStat(listPtr, "frees", frees);
+    AppendStat(listPtr, "arrays", allocs - frees);
+    AppendStat(listPtr, "bytes", bytes);
+    AppendStat(listPtr, "pooled", pooled);
+    AppendStat(listPtr, "pooledbytes", pooledBytes);
+    Tcl_ListObjAppendElement((Tcl_Interp *) NULL, listPtr,
+	    Tcl_NewStringObj("classes", -1));
+    Tcl_ListObjAppendElement((Tcl_Interp *) NULL, listPtr, classesPtr);
+    AppendStat(listPtr, "tempbytes", (long) (ztempsize() * sizeof(HALF)));
+    AppendStat(listPtr, "numbers", total - count);
+    AppendStat(listPtr, "freenumbers", count);
+    AppendStat(listPtr, "numberbytes", (long) (total * sizeof(NUMBER)));
+    AppendStat(listPtr, "tenpowerbytes", ztenpowsize());
+    Tcl_SetObjResult(interp, listPtr);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AppendStat --
+ *
+ *	Append a name and value to a list for StatsObjCmd.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The list object is changed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+AppendStat(listPtr, name, value)
+    Tcl_Obj *listPtr;			/* List to append to. */
+    CONST char *name;			/* Name of the value. */
+    long value;				/* Value to append. */
+{
+    Tcl_ListObjAppendElement((Tcl_Interp *) NULL, listPtr,
+	    Tcl_NewStringObj(name, -1));
+    Tcl_ListObjAppendElement((Tcl_Interp *) NULL, listPtr,
+	    Tcl_NewLongObj(value));
+}
+
 static void
 DestroyMeData(mdPtr)
     Mp_Data *mdPtr;
@@ -230,6 +484,14 @@ DestroyMeData(mdPtr)
     Tcl_UntraceVar(mdPtr->interp, mdPtr->precVarName,
             TCL_GLOBAL_ONLY|TCL_TRACE_WRITES|TCL_TRACE_UNSETS|TCL_TRACE_READS,
             PrecTrace, (ClientData) mdPtr);
+    if (Tcl_GetAssocData(mdPtr->interp, MP_ASSOC_KEY, NULL)
+	    == (ClientData) mdPtr) {
+	Tcl_DeleteAssocData(mdPtr->interp, MP_ASSOC_KEY);
+    }
+    if (mdPtr->epsilon) {
+	qfree(mdPtr->epsilon);
+    }
+    FreeEpsilonCache(mdPtr);
     ckfree((char *)mdPtr);
 }
 
@@ -281,6 +543,7 @@ PrecTrace(clientData, interp, name1, name2, flags)
 		TCL_TRACE_WRITES|TCL_TRACE_UNSETS|TCL_TRACE_READS,
 		PrecTrace, clientData);
 	mdPtr->precision = MP_PRECISION_DEF;
+	mdPtr->precisionSets++;
 	UpdateEpsilon(mdPtr);
     } else if (flags & TCL_TRACE_WRITES) {
 	CONST84 char *sVal;
@@ -298,6 +561,7 @@ PrecTrace(clientData, interp, name1, name2, flags)
 		    && (iVal >= 0) && (iVal <= MP_PRECISION_MAX)) {
 
 		mdPtr->precision = iVal;
+		mdPtr->precisionSets++;
 		UpdateEpsilon(mdPtr);
 		result = NULL;
 	    }
@@ -316,6 +580,73 @@ UpdateEpsilon(mdPtr)
     if (mdPtr->epsilon) {
 	qfree(mdPtr->epsilon);
     }
-    mdPtr->epsilon = qalloc();
-    ztenpow(mdPtr->precision, &(mdPtr->epsilon->den));
+    mdPtr->epsilon = qlink(MpGetEpsilon(mdPtr, mdPtr->precision));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MpGetEpsilon --
+ *
+ *	Return the epsilon for a precision:  10 to the power -precision.
+ *	Epsilons are kept in a per-interpreter cache, so switching
+ *	between a few precisions doesn't compute them over and over.
+ *
+ * Results:
+ *	The epsilon.  It belongs to the cache;  qlink it to keep it.
+ *
+ * Side effects:
+ *	The cache is emptied when it holds MP_EPSILON_CACHE_MAX
+ *	epsilons.
+ *
+ *----------------------------------------------------------------------
+ */
+
+NUMBER *
+MpGetEpsilon(mdPtr, precision)
+    Mp_Data *mdPtr;
+    long precision;
+{
+    Tcl_HashEntry *hPtr;
+    NUMBER *q;
+    int new;
+
+    if (mdPtr->epsilonCache == NULL) {
+	mdPtr->epsilonCache = (Tcl_HashTable *) ckalloc(sizeof(Tcl_HashTable));
+	Tcl_InitHashTable(mdPtr->epsilonCache, TCL_ONE_WORD_KEYS);
+    }
+    hPtr = Tcl_FindHashEntry(mdPtr->epsilonCache, (char *) precision);
+    if (hPtr != NULL) {
+	return (NUMBER *) Tcl_GetHashValue(hPtr);
+    }
+    if (mdPtr->epsilonCache->numEntries >= MP_EPSILON_CACHE_MAX) {
+	FreeEpsilonCache(mdPtr);
+	mdPtr->epsilonCache = (Tcl_HashTable *) ckalloc(sizeof(Tcl_HashTable));
+	Tcl_InitHashTable(mdPtr->epsilonCache, TCL_ONE_WORD_KEYS);
+    }
+    q = qalloc();
+    ztenpow(precision, &q->den);
+    qkeep(q);
+    hPtr = Tcl_CreateHashEntry(mdPtr->epsilonCache, (char *) precision, &new);
+    Tcl_SetHashValue(hPtr, (ClientData) q);
+    return q;
+}
+
+static void
+FreeEpsilonCache(mdPtr)
+    Mp_Data *mdPtr;
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+
+    if (mdPtr->epsilonCache == NULL) {
+	return;
+    }
+    for (hPtr = Tcl_FirstHashEntry(mdPtr->epsilonCache, &search); hPtr;
+	    hPtr = Tcl_NextHashEntry(&search)) {
+	qfree((NUMBER *) Tcl_GetHashValue(hPtr));
+    }
+    Tcl_DeleteHashTable(mdPtr->epsilonCache);
+    ckfree((char *) mdPtr->epsilonCache);
+    mdPtr->epsilonCache = NULL;
 }
@@ -26,6 +26,9 @@
  * Function prototypes for procedures local to this file:
  */
 
+static CONST char *	ParseVar _ANSI_ARGS_((Tcl_Interp *interp,
+			    CONST char *string, CONST char **termPtr,
+			    int noEval, Tcl_Obj **objPtrPtr));
 static CONST char *	QuoteEnd _ANSI_ARGS_((CONST char *string, int term));
 static CONST char *	ScriptEnd _ANSI_ARGS_((CONST char *p, int nested));
 static CONST char *	VarNameEnd _ANSI_ARGS_((CONST char *string));
@@ -548,7 +551,7 @@ ScriptEnd(p, nested)
 /*
  *----------------------------------------------------------------------
  *
- * Mp_ParseVar --
+ * Mp_ParseVar, Mp_ParseVarObj --
  *
  *	Given a string starting with a $ sign, parse off a variable
  *	name and return its value.
@@ -561,6 +564,11 @@ ScriptEnd(p, nested)
  *	variable doesn't exist, then the return value is NULL and
  *	an error message will be left in interp->result.
  *
+ *	Mp_ParseVarObj returns the variable's value as an object, which
+ *	is owned by the variable.  It doesn't accept a "$" that isn't
+ *	followed by a variable name;  it returns NULL with an error
+ *	message for that.
+ *
  * Side effects:
  *	None.
  *
@@ -578,6 +586,63 @@ Mp_ParseVar(interp, string, termPtr, noEval)
     int noEval;				/* Whether to "evaluate" (in this case
 					 * substitute the value in the var) in
 					 * addition to parsing. */
+{
+    Tcl_Obj *objPtr = NULL;
+    CONST char *result;
+
+    result = ParseVar(interp, string, termPtr, noEval, &objPtr);
+    if (objPtr != NULL) {
+	result = Tcl_GetString(objPtr);
+    }
+    return result;
+}
+
+Tcl_Obj *
+Mp_ParseVarObj(interp, string)
+    Tcl_Interp *interp;			/* Context for looking up variable. */
+    CONST char *string;			/* String containing variable name.
+					 * First character must be "$". */
+{
+    Tcl_Obj *objPtr = NULL;
+
+    if ((ParseVar(interp, string, (CONST char **) NULL, 0, &objPtr) != NULL)
+	    && (objPtr == NULL)) {
+	Tcl_AppendResult(interp, "missing variable name in \"", string,
+		"\"", (char *) NULL);
+    }
+    return objPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ParseVar --
+ *
+ *	Common code for Mp_ParseVar and Mp_ParseVarObj.
+ *
+ * Results:
+ *	As for Mp_ParseVar, except that when the variable is read its
+ *	value is stored at *objPtrPtr and "" is returned.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static CONST char *
+ParseVar(interp, string, termPtr, noEval, objPtrPtr)
+    Tcl_Interp *interp;			/* Context for looking up variable. */
+    register CONST char *string;	/* String containing variable name.
+					 * First character must be "$". */
+    CONST char **termPtr;		/* If non-NULL, points to word to fill
+					 * in with character just after last
+					 * one in the variable specifier. */
+    int noEval;				/* Whether to "evaluate" (in this case
+					 * substitute the value in the var) in
+					 * addition to parsing. */
+    Tcl_Obj **objPtrPtr;		/* Where to store the variable's
+					 * value. */
 {
     CONST char *name1;
     CONST char *name1End;
@@ -687,7 +752,8 @@ Mp_ParseVar(interp, string, termPtr, noEval)
       --offset;
       name1_copy[offset] = name1[offset];
     }
-    result = Tcl_GetVar2(interp, name1_copy, name2, TCL_LEAVE_ERR_MSG);
+    *objPtrPtr = Tcl_GetVar2Ex(interp, name1_copy, name2, TCL_LEAVE_ERR_MSG);
+    result = (*objPtrPtr == NULL) ? NULL : "";
     ckfree(name1_copy);
 
     done:
@@ -284,8 +284,8 @@ qround(q, places)
 		r->den = tenpow;
 		return r;
 	}
-	zquo(tmp2, tmp1, &r->num);
-	zquo(tenpow, tmp1, &r->den);
+	zdivexact(tmp2, tmp1, &r->num);
+	zdivexact(tenpow, tmp1, &r->den);
 	zfree(tmp1);
 	zfree(tmp2);
 	zfree(tenpow);
@@ -348,6 +348,69 @@ qbround(q, places)
 	return r;
 }
 
+/*
+ * Multiply two numbers and round the product to the specified number of
+ * binary places, as qbround(qmul(q1, q2), places) does.  When both
+ * denominators are powers of two, as they are for numbers which have
+ * already been rounded by qbround, only the high part of the product
+ * of the numerators is formed.  The low words left out are well below
+ * the rounding point, so the result can differ from the exactly rounded
+ * one by at most one in the last place, and only in rare near-halfway
+ * cases.
+ */
+NUMBER *
+qmulbround(q1, q2, places)
+	NUMBER *q1, *q2;	/* numbers to be multiplied */
+	long places;		/* number of binary places to round to */
+{
+	long shift, skip, twopow;
+	NUMBER *r;
+	ZVALUE prod, roundval;
+
+	if (places < 0)
+		math_error("Negative places for qmulbround");
+	if (qiszero(q1) || qiszero(q2))
+		return qlink(&_qzero_);
+	shift = 0;
+	if (zisonebit(q1->den) && zisonebit(q2->den))
+		shift = zlowbit(q1->den) + zlowbit(q2->den) - places;
+	if (shift <= 0) {
+		r = qmul(q1, q2);
+		q1 = qbround(r, places);
+		qfree(r);
+		return q1;
+	}
+	/*
+	 * Leave out all but one word below the rounding point, then add
+	 * one half and shift away the rest.
+	 */
+	skip = (shift / BASEB) - 1;
+	if (skip < 0)
+		skip = 0;
+	zmulhigh(q1->num, q2->num, skip, &prod);
+	shift -= skip * BASEB;
+	zbitvalue(shift - 1, &roundval);
+	roundval.sign = prod.sign;
+	zaddto(&prod, roundval);
+	zfree(roundval);
+	zshift(prod, -shift, &roundval);
+	zfree(prod);
+	if (ziszero(roundval))
+		return qlink(&_qzero_);
+	/*
+	 * Now reduce the result to the lowest common denominator.
+	 */
+	r = qalloc();
+	twopow = zlowbit(roundval);
+	if (twopow > places)
+		twopow = places;
+	places -= twopow;
+	zshift(roundval, -twopow, &r->num);
+	zfree(roundval);
+	zbitvalue(places, &r->den);
+	return r;
+}
+
 /*
  * Compute the gcd (greatest common divisor) of two numbers.
  *	q3 = qgcd(q1, q2);
@@ -38,6 +38,7 @@ qprintff(q, width, precision)
 		if (scale->number.v)
 			zfree(scale->number);
 		ztenpow(precision, &(scale->number));
+		zkeep(scale->number);
 		scale->factor = precision;
 	}
 	if (scale->number.v)
@@ -74,6 +75,7 @@ Qprintff(q, width, precision)
 		if (scale->number.v)
 			zfree(scale->number);
 		ztenpow(precision, &(scale->number));
+		zkeep(scale->number);
 		scale->factor = precision;
 	}
 	if (scale->number.v)
@@ -15,6 +15,72 @@ static NUMBER _qten_ =	{ { _tenval_, 1, 0 }, { _oneval_, 1, 0 }, 1 };
 NUMBER _qnegone_ =	{ { _oneval_, 1, 1 }, { _oneval_, 1, 0 }, 1 };
 NUMBER _qonehalf_ =	{ { _oneval_, 1, 0 }, { _twoval_, 1, 0 }, 1 };
 
+static void qsetval MATH_PROTO((FULL val, HALF *hp, ZVALUE *res));
+static void qcopyval MATH_PROTO((ZVALUE z, HALF *hp, ZVALUE *res));
+static void qaddval MATH_PROTO((ZVALUE z1, ZVALUE z2, NUMBER *r));
+static void qfreenode MATH_PROTO((NUMBER *q));
+
+
+/*
+ * Set a value of a new number to a positive value of up to two words,
+ * kept in the given words of the number.
+ */
+static void
+qsetval(val, hp, res)
+	FULL val;		/* value to set */
+	HALF *hp;		/* words kept in the number */
+	ZVALUE *res;		/* value of the number to set */
+{
+	hp[0] = (HALF) val;
+	hp[1] = (HALF) (val >> BASEB);
+	res->v = hp;
+	res->len = 1 + (hp[1] != 0);
+	res->sign = 0;
+}
+
+
+/*
+ * Copy an integer into a value of a new number, using the given words
+ * kept in the number if they are enough.
+ */
+static void
+qcopyval(z, hp, res)
+	ZVALUE z;		/* integer to copy */
+	HALF *hp;		/* words kept in the number */
+	ZVALUE *res;		/* value of the number to set */
+{
+	res->v = (z.len <= QINLINE) ? hp : alloc(z.len);
+	res->len = z.len;
+	res->sign = z.sign;
+	zcopyval(z, *res);
+}
+
+
+/*
+ * Add two integers of one word each as the numerator of a new number,
+ * keeping the sum in the number itself.
+ */
+static void
+qaddval(z1, z2, r)
+	ZVALUE z1, z2;		/* integers of one word */
+	NUMBER *r;		/* number to set */
+{
+	HALF h1, h2;
+
+	h1 = z1.v[0];
+	h2 = z2.v[0];
+	if (z1.sign == z2.sign) {
+		qsetval(((FULL) h1) + h2, r->numval, &r->num);
+		r->num.sign = z1.sign;
+	} else if (h1 >= h2) {
+		qsetval((FULL) (h1 - h2), r->numval, &r->num);
+		r->num.sign = z1.sign && (h1 != h2);
+	} else {
+		qsetval((FULL) (h2 - h1), r->numval, &r->num);
+		r->num.sign = z2.sign;
+	}
+}
+
 /*
  * Create another copy of a number.
  *	q2 = qcopy(q1);
@@ -27,16 +93,10 @@ qcopy(q)
 
 	r = qalloc();
 	r->num.sign = q->num.sign;
-	if (!zisunit(q->num)) {
-		r->num.len = q->num.len;
-		r->num.v = alloc(r->num.len);
-		zcopyval(q->num, r->num);
-	}
-	if (!zisunit(q->den)) {
-		r->den.len = q->den.len;
-		r->den.v = alloc(r->den.len);
-		zcopyval(q->den, r->den);
-	}
+	if (!zisunit(q->num))
+		qcopyval(q->num, r->numval, &r->num);
+	if (!zisunit(q->den))
+		qcopyval(q->den, r->denval, &r->den);
 	return r;
 }
 
@@ -84,7 +144,11 @@ itoq(i)
 			return qlink(q);
 	}
 	q = qalloc();
-	itoz(i, &q->num);
+	if (i < 0)
+		qsetval(((FULL) -(i + 1)) + 1, q->numval, &q->num);
+	else
+		qsetval((FULL) i, q->numval, &q->num);
+	q->num.sign = (i < 0);
 	return q;
 }
 
@@ -121,8 +185,8 @@ iitoq(inum, iden)
 		return itoq(sign ? -inum : inum);
 	q = qalloc();
 	if (inum != 1)
-		itoz(inum, &q->num);
-	itoz(iden, &q->den);
+		qsetval((FULL) inum, q->numval, &q->num);
+	qsetval((FULL) iden, q->denval, &q->den);
 	q->num.sign = sign;
 	return q;
 }
@@ -148,7 +212,10 @@ qadd(q1, q2)
 	 * If either number is an integer, then the result is easy.
 	 */
 	if (qisint(q1) && qisint(q2)) {
-		zadd(q1->num, q2->num, &r->num);
+		if ((q1->num.len == 1) && (q2->num.len == 1))
+			qaddval(q1->num, q2->num, r);
+		else
+			zadd(q1->num, q2->num, &r->num);
 		return r;
 	}
 	if (qisint(q2)) {
@@ -185,8 +252,8 @@ qadd(q1, q2)
 	 * The calculation is now more complicated.
 	 * See Knuth Vol 2 for details.
 	 */
-	zquo(q2->den, d1, &vpd1);
-	zquo(q1->den, d1, &upd1);
+	zdivexact(q2->den, d1, &vpd1);
+	zdivexact(q1->den, d1, &upd1);
 	zmul(q1->num, vpd1, &t1);
 	zmul(q2->num, upd1, &t2);
 	zadd(t1, t2, &temp);
@@ -202,9 +269,9 @@ qadd(q1, q2)
 		zfree(upd1);
 		return r;
 	}
-	zquo(temp, d2, &r->num);
+	zdivexact(temp, d2, &r->num);
 	zfree(temp);
-	zquo(q2->den, d2, &temp);
+	zdivexact(q2->den, d2, &temp);
 	zfree(d2);
 	zmul(temp, upd1, &r->den);
 	zfree(temp);
@@ -222,6 +289,7 @@ qsub(q1, q2)
 	register NUMBER *q1, *q2;
 {
 	NUMBER *r;
+	ZVALUE z2;
 
 	if (q1 == q2)
 		return qlink(&_qzero_);
@@ -229,7 +297,12 @@ qsub(q1, q2)
 		return qlink(q1);
 	if (qisint(q1) && qisint(q2)) {
 		r = qalloc();
-		zsub(q1->num, q2->num, &r->num);
+		if ((q1->num.len == 1) && (q2->num.len == 1)) {
+			z2 = q2->num;
+			z2.sign = !z2.sign;
+			qaddval(q1->num, z2, r);
+		} else
+			zsub(q1->num, q2->num, &r->num);
 		return r;
 	}
 	q2 = qneg(q2);
@@ -252,7 +325,10 @@ qinc(q)
 
 	r = qalloc();
 	if (qisint(q)) {
-		zadd(q->num, _one_, &r->num);
+		if (q->num.len == 1)
+			qaddval(q->num, _one_, r);
+		else
+			zadd(q->num, _one_, &r->num);
 		return r;
 	}
 	zadd(q->num, q->den, &r->num);
@@ -272,7 +348,10 @@ qdec(q)
 
 	r = qalloc();
 	if (qisint(q)) {
-		zsub(q->num, _one_, &r->num);
+		if (q->num.len == 1)
+			qaddval(q->num, _qnegone_.num, r);
+		else
+			zsub(q->num, _one_, &r->num);
 		return r;
 	}
 	zsub(q->num, q->den, &r->num);
@@ -300,7 +379,12 @@ qmul(q1, q2)
 		return qlink(q1);
 	if (qisint(q1) && qisint(q2)) {	/* easy results if integers */
 		r = qalloc();
-		zmul(q1->num, q2->num, &r->num);
+		if ((q1->num.len == 1) && (q2->num.len == 1)) {
+			qsetval(((FULL) q1->num.v[0]) * q2->num.v[0],
+				r->numval, &r->num);
+			r->num.sign = q1->num.sign ^ q2->num.sign;
+		} else
+			zmul(q1->num, q2->num, &r->num);
 		return r;
 	}
 	n1 = q1->num;
@@ -314,16 +398,16 @@ qmul(q1, q2)
 	if (!zisunit(n1) && !zisunit(d2)) {	/* possibly reduce */
 		zgcd(n1, d2, &tmp);
 		if (!zisunit(tmp)) {
-			zquo(q1->num, tmp, &n1);
-			zquo(q2->den, tmp, &d2);
+			zdivexact(q1->num, tmp, &n1);
+			zdivexact(q2->den, tmp, &d2);
 		}
 		zfree(tmp);
 	}
 	if (!zisunit(n2) && !zisunit(d1)) {	/* again possibly reduce */
 		zgcd(n2, d1, &tmp);
 		if (!zisunit(tmp)) {
-			zquo(q2->num, tmp, &n2);
-			zquo(q1->den, tmp, &d1);
+			zdivexact(q2->num, tmp, &n2);
+			zdivexact(q1->den, tmp, &d1);
 		}
 		zfree(tmp);
 	}
@@ -478,9 +562,9 @@ qneg(q)
 		return qlink(&_qzero_);
 	r = qalloc();
 	if (!zisunit(q->num))
-		zcopy(q->num, &r->num);
+		qcopyval(q->num, r->numval, &r->num);
 	if (!zisunit(q->den))
-		zcopy(q->den, &r->den);
+		qcopyval(q->den, r->denval, &r->den);
 	r->num.sign = !q->num.sign;
 	return r;
 }
@@ -503,9 +587,9 @@ qinv(q)
 		math_error("Division by zero");
 	r = qalloc();
 	if (!zisunit(q->num))
-		zcopy(q->num, &r->den);
+		qcopyval(q->num, r->denval, &r->den);
 	if (!zisunit(q->den))
-		zcopy(q->den, &r->num);
+		qcopyval(q->den, r->numval, &r->num);
 	r->num.sign = q->num.sign;
 	r->den.sign = 0;
 	return r;
@@ -630,6 +714,160 @@ qmax(q1, q2)
 	return qlink(q1);
 }
 
+
+/*
+ * Add up an array of numbers.
+ *	q = qsum(qv, count);
+ * The sum is kept as an unreduced fraction whose denominator is only
+ * enlarged when a term's denominator does not divide it, so adding up
+ * integers or decimals of the same scale needs no gcd at all.  The
+ * result is reduced once at the end.
+ */
+NUMBER *
+qsum(qv, count)
+	NUMBER **qv;
+	long count;
+{
+	NUMBER *q, *r;
+	ZVALUE num, den, quo, rem, t1, t2;
+	long i;
+
+	num = _zero_;
+	den = _one_;
+	for (i = 0; i < count; i++) {
+		q = qv[i];
+		if (qiszero(q))
+			continue;
+		if (qisint(q) || !zcmp(q->den, den)) {
+			/* num += q->num * den / q->den */
+			if (qisint(q) && !zisone(den)) {
+				zmul(q->num, den, &t1);
+				zadd(num, t1, &t2);
+				zfree(t1);
+			} else
+				zadd(num, q->num, &t2);
+			zfree(num);
+			num = t2;
+			continue;
+		}
+		if (zisone(den)) {
+			zmul(num, q->den, &t1);
+			zadd(t1, q->num, &t2);
+			zfree(t1);
+			zfree(num);
+			num = t2;
+			zcopy(q->den, &den);
+			continue;
+		}
+		if (zrel(q->den, den) < 0) {
+			zdiv(den, q->den, &quo, &rem);
+			if (ziszero(rem)) {
+				zmul(q->num, quo, &t1);
+				zadd(num, t1, &t2);
+				zfree(t1);
+				zfree(num);
+				zfree(quo);
+				zfree(rem);
+				num = t2;
+				continue;
+			}
+		} else {
+			zdiv(q->den, den, &quo, &rem);
+			if (ziszero(rem)) {
+				zmul(num, quo, &t1);
+				zadd(t1, q->num, &t2);
+				zfree(t1);
+				zfree(num);
+				zfree(den);
+				zfree(quo);
+				zfree(rem);
+				num = t2;
+				zcopy(q->den, &den);
+				continue;
+			}
+		}
+		zfree(quo);
+		zfree(rem);
+		/*
+		 * Neither denominator divides the other, so use the
+		 * cross product and leave the reduction for later.
+		 */
+		zmul(num, q->den, &t1);
+		zmul(q->num, den, &t2);
+		zfree(num);
+		zadd(t1, t2, &num);
+		zfree(t1);
+		zfree(t2);
+		zmul(den, q->den, &t1);
+		zfree(den);
+		den = t1;
+	}
+	if (ziszero(num)) {
+		zfree(num);
+		zfree(den);
+		return qlink(&_qzero_);
+	}
+	r = qalloc();
+	if (zisone(den)) {
+		r->num = num;
+		return r;
+	}
+	zreduce(num, den, &r->num, &r->den);
+	zfree(num);
+	zfree(den);
+	return r;
+}
+
+
+/*
+ * Multiply together an array of numbers.
+ *	q = qprod(qv, count);
+ * The numerators and denominators are multiplied separately and the
+ * result is reduced once at the end.
+ */
+NUMBER *
+qprod(qv, count)
+	NUMBER **qv;
+	long count;
+{
+	NUMBER *q, *r;
+	ZVALUE num, den, tmp;
+	long i;
+
+	num = _one_;
+	den = _one_;
+	for (i = 0; i < count; i++) {
+		q = qv[i];
+		if (qiszero(q)) {
+			zfree(num);
+			zfree(den);
+			return qlink(&_qzero_);
+		}
+		if (!zisone(q->num)) {
+			zmul(num, q->num, &tmp);
+			zfree(num);
+			num = tmp;
+		}
+		if (!qisint(q)) {
+			zmul(den, q->den, &tmp);
+			zfree(den);
+			den = tmp;
+		}
+	}
+	r = qalloc();
+	if (zisone(den)) {
+		if (zisone(num)) {
+			zfree(num);
+		} else
+			r->num = num;
+		return r;
+	}
+	zreduce(num, den, &r->num, &r->den);
+	zfree(num);
+	zfree(den);
+	return r;
+}
+
 /*
  * Return the precision of a number (usually for examining an epsilon value).
  * This is the largest power of two whose reciprocal is not smaller in absolute
@@ -775,7 +1013,7 @@ qreli(q, n)
 	num.len = 1 + (n >= BASE);
 	num.v = h2;
 	h2[0] = (n & BASE1);
-	h2[1] = (n >> BASEB);
+	h2[1] = (HALF) (((FULL) n) >> BASEB);
 	if (zisunit(q->den))	/* integer compare if no denominator */
 		return zrel(q->num, num);
 	q2.num = num;
@@ -795,33 +1033,52 @@ union allocNode {
 	union allocNode	*link;
 };
 
+typedef struct {
+	union allocNode	*free;	/* free numbers */
+	long	count;		/* number of free numbers */
+	long	total;		/* number of numbers allocated */
+} NodeList;
+
 static Tcl_ThreadDataKey allocKey = NULL;
-static union allocNode	*freeNum;
+
+/* the number holding the given scope link */
+#define	linknum(lp)	((NUMBER *) ((char *) (lp) - \
+			((char *) &_qzero_.link - (char *) &_qzero_)))
 
 
 NUMBER *
 qalloc()
 {
 	register union allocNode *temp;
-	union allocNode **freeNumPtr = Tcl_GetThreadData(&allocKey,
-		sizeof(union allocNode *));
+	NodeList *list = Tcl_GetThreadData(&allocKey, sizeof(NodeList));
+	ZSCOPE *sp;
 
-	if (*freeNumPtr == NULL) {
-		*freeNumPtr = (union allocNode *)
+	if (list->free == NULL) {
+		list->free = (union allocNode *)
 			ckalloc(sizeof (NUMBER) * NNALLOC);
-		if (*freeNumPtr == NULL)
+		if (list->free == NULL)
 			math_error("Not enough memory");
-		(*freeNumPtr)[NNALLOC-1].link = NULL;
-		for (temp=(*freeNumPtr)+NNALLOC-2; temp >= (*freeNumPtr);
+		/* clears the headers of the words kept in each number */
+		memset(list->free, 0, sizeof (NUMBER) * NNALLOC);
+		list->free[NNALLOC-1].link = NULL;
+		for (temp=list->free+NNALLOC-2; temp >= list->free;
 			--temp) {
 			temp->link = temp+1;
 		}
+		list->count += NNALLOC;
+		list->total += NNALLOC;
 	}
-	temp = (*freeNumPtr);
-	(*freeNumPtr) = temp->link;
+	temp = list->free;
+	list->free = temp->link;
+	list->count--;
 	temp->num.links = 1;
 	temp->num.num = _one_;
 	temp->num.den = _one_;
+	sp = zgetscope();
+	if (sp)
+		zlinkin(&sp->numbers, &temp->num.link);
+	else
+		temp->num.link.next = NULL;
 	return &temp->num;
 }
 
@@ -830,17 +1087,79 @@ void
 qfreenum(q)
 	register NUMBER *q;
 {
-	union allocNode *a;
-	union allocNode **freeNumPtr = Tcl_GetThreadData(&allocKey,
-		sizeof(union allocNode *));
-
 	if (q == NULL)
 		return;
 	zfree(q->num);
 	zfree(q->den);
+	qfreenode(q);
+}
+
+
+/*
+ * Return a number to the free list, leaving its values alone.
+ */
+static void
+qfreenode(q)
+	NUMBER *q;
+{
+	union allocNode *a;
+	NodeList *list = Tcl_GetThreadData(&allocKey, sizeof(NodeList));
+
+	if (q->link.next)
+		zunlink(&q->link);
 	a = (union allocNode *) q;
-	a->link = (*freeNumPtr);
-	(*freeNumPtr) = a;
+	a->link = list->free;
+	list->free = a;
+	list->count++;
+}
+
+
+/*
+ * Return the number of numbers allocated by the current thread, and how
+ * many of them are on its free list.
+ */
+void
+qnodestat(total, count)
+	long *total;		/* where to return the numbers allocated */
+	long *count;		/* where to return the free numbers */
+{
+	NodeList *list = Tcl_GetThreadData(&allocKey, sizeof(NodeList));
+
+	*total = list->total;
+	*count = list->count;
+}
+
+
+/*
+ * Keep a number made while an expression is evaluated beyond the end of
+ * the evaluation, e.g. because an object or a cache holds it.
+ */
+void
+qkeep(q)
+	NUMBER *q;
+{
+	if (q->link.next)
+		zunlink(&q->link);
+	zkeep(q->num);
+	zkeep(q->den);
+}
+
+
+/*
+ * End the scope of an evaluation.  If the evaluation was abandoned the
+ * numbers still held in the scope are freed, and their values with the
+ * other arrays of the scope.
+ */
+void
+qendscope(sp, release)
+	ZSCOPE *sp;
+	BOOL release;		/* TRUE to free what the scope holds */
+{
+	if (release) {
+		while (sp->numbers.next != &sp->numbers)
+			qfreenode(linknum(sp->numbers.next));
+	}
+	zendscope(sp, release);
 }
 
 /* END CODE */
@@ -14,11 +14,23 @@
 
 /*
  * Rational arithmetic definitions.
+ *
+ * A numerator or denominator of up to QINLINE words may be kept in the
+ * number itself instead of in an allocated array.  The headers before
+ * those words have no room, so that freeh leaves them alone and any
+ * routine growing a value in place copies it out first.
  */
+#define	QINLINE	(128 / BASEB)	/* words of each value kept in a number */
+
 typedef struct {
 	ZVALUE num;		/* numerator (containing sign) */
 	ZVALUE den;		/* denominator (always positive) */
 	long links;		/* number of links to this value */
+	ZLINK link;		/* place in the scope of an evaluation */
+	ZHEAD numhead;		/* header for the numerator words */
+	HALF numval[QINLINE];	/* numerator words kept in the number */
+	ZHEAD denhead;		/* header for the denominator words */
+	HALF denval[QINLINE];	/* denominator words kept in the number */
 } NUMBER;
 
 
@@ -32,6 +44,9 @@ extern NUMBER *itoq MATH_PROTO((long i));
 extern long qtoi MATH_PROTO((NUMBER *q));
 extern long qparse MATH_PROTO((CONST char *str, int flags));
 extern void qfreenum MATH_PROTO((NUMBER *q));
+extern void qkeep MATH_PROTO((NUMBER *q));
+extern void qendscope MATH_PROTO((ZSCOPE *sp, BOOL release));
+extern void qnodestat MATH_PROTO((long *total, long *count));
 extern void qprintff MATH_PROTO((NUMBER *q, long width, long precision));
 extern void Qprintff MATH_PROTO((NUMBER *q, long width, long precision)); 
 extern void qprintfe_round MATH_PROTO((NUMBER *q, long width, long precision));
@@ -53,6 +68,8 @@ extern NUMBER *qquo MATH_PROTO((NUMBER *q1, NUMBER *q2));
 extern NUMBER *qmod MATH_PROTO((NUMBER *q1, NUMBER *q2));
 extern NUMBER *qmin MATH_PROTO((NUMBER *q1, NUMBER *q2));
 extern NUMBER *qmax MATH_PROTO((NUMBER *q1, NUMBER *q2));
+extern NUMBER *qsum MATH_PROTO((NUMBER **qv, long count));
+extern NUMBER *qprod MATH_PROTO((NUMBER **qv, long count));
 extern NUMBER *qpowi MATH_PROTO((NUMBER *q1, NUMBER *q2));
 extern NUMBER *qsquare MATH_PROTO((NUMBER *q));
 extern NUMBER *qneg MATH_PROTO((NUMBER *q));
@@ -63,6 +80,7 @@ extern NUMBER *qinc MATH_PROTO((NUMBER *q));
 extern NUMBER *qdec MATH_PROTO((NUMBER *q));
 extern NUMBER *qround MATH_PROTO((NUMBER *q, long places));
 extern NUMBER *qbround MATH_PROTO((NUMBER *q, long places));
+extern NUMBER *qmulbround MATH_PROTO((NUMBER *q1, NUMBER *q2, long places));
 extern NUMBER *qscale MATH_PROTO((NUMBER *q, long i));
 extern BOOL qcmp MATH_PROTO((NUMBER *q1, NUMBER *q2));
 extern FLAG qrel MATH_PROTO((NUMBER *q1, NUMBER *q2));
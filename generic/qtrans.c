@@ -94,14 +94,13 @@ qcosimpl(q, epsilon, sinisnegPtr)
 	while (--scale >= 0) {
 		if (qisneg(sum))
 			*sinisnegPtr = !(*sinisnegPtr);
-		tmp = qsquare(sum);
+		tmp = qmulbround(sum, sum, bits2 + 1);
 		qfree(sum);
 		sum = qscale(tmp, 1L);
 		qfree(tmp);
 		tmp = qdec(sum);
 		qfree(sum);
-		sum = qbround(tmp, bits2);
-		qfree(tmp);
+		sum = tmp;
 	}
 	tmp = qbround(sum, bits);
 	qfree(sum);
@@ -449,20 +448,15 @@ qpi(epsilon)
 	shift = 4;
 	do {
 		t = 1 + (++N & 0x1);
-		(void) zdivi(comb, N / (3 - t), &tmp1);
-		zfree(comb);
-		zmuli(tmp1, t * (2 * N - 1), &comb);
-		zfree(tmp1);
+		(void) zdiviby(&comb, N / (3 - t));
+		zmuliby(&comb, t * (2 * N - 1));
 		zsquare(comb, &tmp1);
 		zmul(comb, tmp1, &tmp2);
 		zfree(tmp1);
-		zmuli(tmp2, 42 * N + 5, &tmp1);
-		zfree(tmp2);
-		zshift(sum, 12L, &tmp2);
-		zfree(sum);
-		zadd(tmp1, tmp2, &sum);
-		t = zhighbit(tmp1);
-		zfree(tmp1);
+		zmuliby(&tmp2, 42 * N + 5);
+		zshiftby(&sum, 12L);
+		zaddto(&sum, tmp2);
+		t = zhighbit(tmp2);
 		zfree(tmp2);
 		shift += 12;
 	} while ((shift - t) < bits);
@@ -548,10 +542,9 @@ qexp(q, epsilon)
 	 * Then invert it if the original argument was negative.
 	 */
 	while (--scale >= 0) {
-		tmp = qsquare(sum);
+		tmp = qmulbround(sum, sum, bits2);
 		qfree(sum);
-		sum = qbround(tmp, bits2);
-		qfree(tmp);
+		sum = tmp;
 	}
 	tmp = qbround(sum, bits);
 	qfree(sum);
@@ -606,7 +599,9 @@ qln(q, epsilon)
 	 * to 1 so that Taylor series to be used will converge rapidly.
 	 * The effect of scaling will be reversed by a later shift.
 	 */
-	maxr = iitoq(BASE + 1, BASE);
+	tmp1 = qscale(&_qone_, -BASEB);
+	maxr = qinc(tmp1);
+	qfree(tmp1);
 	shift = 1;
 	while (qrel(q, maxr) > 0) {
 		tmp1 = qsqrt(q, epsilon2);
@@ -629,14 +624,13 @@ qln(q, epsilon)
 	 * Now use the Taylor series expansion to calculate the result.
 	 */
 	n = 1;
-	term2 = qsquare(term);
+	term2 = qmulbround(term, term, bits2);
 	sum = qlink(term);
 	while (qrel(term, epsilon2) > 0) {
 		n += 2;
-		tmp1 = qmul(term, term2);
+		tmp1 = qmulbround(term, term2, bits2);
 		qfree(term);
-		term = qbround(tmp1, bits2);
-		qfree(tmp1);
+		term = tmp1;
 		tmp1 = qdivi(term, (long) n);
 		tmp2 = qadd(sum, tmp1);
 		qfree(tmp1);
@@ -803,14 +797,13 @@ qcosh(q, epsilon)
 	 *	cosh(2 * x) = 2 * cosh(x)^2 - 1.
 	 */
 	while (--scale >= 0) {
-		tmp = qsquare(sum);
+		tmp = qmulbround(sum, sum, bits2 + 1);
 		qfree(sum);
 		sum = qscale(tmp, 1L);
 		qfree(tmp);
 		tmp = qdec(sum);
 		qfree(sum);
-		sum = qbround(tmp, bits2);
-		qfree(tmp);
+		sum = tmp;
 	}
 	tmp = qbround(sum, bits);
 	qfree(sum);
@@ -0,0 +1,240 @@
+/*
+ * tune - Measure the algorithm sizes for this host
+ *
+ * The sizes in words where the faster multiply, square, modulo and division
+ * algorithms take over depend on the machine and the compiler, so the
+ * defaults in zmath.h are only a guess.  This program times each
+ * operation at increasing sizes, both with the faster algorithm used
+ * for the top level only and with the plain algorithm, and takes the
+ * size where the faster algorithm starts to win steadily.  The sizes
+ * are printed as defines for tune.h, which zmath.h uses in place of
+ * its defaults.
+ */
+
+#include "zmath.h"
+
+
+#define	MAXSIZE	300		/* largest size tried */
+#define	WINS	3		/* sizes in a row which must be won */
+#define	TRIALS	7		/* timings taken of each operation */
+#define	MINTIME	4000		/* microseconds for each timing */
+#define	POWLEN	4		/* size of the exponent for powers */
+
+#define	OP_MUL	0		/* multiply */
+#define	OP_SQ	1		/* square */
+#define	OP_REDC	2		/* REDC multiply */
+#define	OP_POW	3		/* modulo power */
+#define	OP_DIV	4		/* division */
+
+
+static LEN *tunesize MATH_PROTO((CONST char *name));
+static void randz MATH_PROTO((LEN len, ZVALUE *res));
+static double optime MATH_PROTO((int op, ZVALUE z1, ZVALUE z2, ZVALUE z3,
+	REDC *rp));
+static LEN crossover MATH_PROTO((CONST char *name, int op));
+
+static unsigned long seed = 1;	/* state of the random number generator */
+
+
+int
+main(argc, argv)
+	int argc;
+	char **argv;
+{
+	static CONST char *huge[] = {
+		"MUL_ALG3", "SQ_ALG3", "MUL_ALG4", "SQ_ALG4",
+		"MUL_NTT", "SQ_NTT", NULL
+	};
+	static CONST struct {
+		CONST char *name;	/* name of the size */
+		int op;			/* operation to time */
+	} sizes[] = {
+		{"MUL_ALG2", OP_MUL},
+		{"SQ_ALG2", OP_SQ},
+		{"REDC_ALG2", OP_REDC},
+		{"POW_ALG2", OP_POW},
+		{"DIV_ALG2", OP_DIV},
+		{NULL, 0}
+	};
+	LEN *sp;
+	int i;
+
+	Tcl_FindExecutable(argv[0]);
+	initmasks();
+
+	/*
+	 * Keep the larger algorithms out of the way of the timings.
+	 */
+	for (i = 0; huge[i]; i++) {
+		sp = tunesize(huge[i]);
+		if (sp && (*sp <= MAXSIZE))
+			*sp = MAXSIZE + 1;
+	}
+
+	/*
+	 * Find the sizes in order, since the REDC, power and division
+	 * sizes depend on the multiply and square sizes.
+	 */
+	printf("/*\n * DO NOT EDIT -- generated by the tune program\n */\n\n");
+	for (i = 0; sizes[i].name; i++) {
+		sp = tunesize(sizes[i].name);
+		*sp = crossover(sizes[i].name, sizes[i].op);
+		printf("#define %s %ld\n", sizes[i].name, (long) *sp);
+		fflush(stdout);
+	}
+	exit(0);
+}
+
+
+/*
+ * Return where the named algorithm size is kept.
+ */
+static LEN *
+tunesize(name)
+	CONST char *name;
+{
+	TUNE *tp;
+
+	for (tp = _tunes_; tp->name; tp++) {
+		if (strcmp(tp->name, name) == 0)
+			return tp->size;
+	}
+	return NULL;
+}
+
+
+/*
+ * Make a random number of the given number of words, whose top word
+ * is below the top bit so that it is less than any modulus of the
+ * same size made here, and whose bottom word is odd.
+ */
+static void
+randz(len, res)
+	LEN len;
+	ZVALUE *res;
+{
+	HALF *hp;
+	LEN i;
+	int j;
+
+	res->v = alloc(len);
+	res->len = len;
+	res->sign = 0;
+	hp = res->v;
+	for (i = 0; i < len; i++) {
+		*hp = 0;
+		for (j = 0; j < BASEB; j += 16) {
+			seed = seed * 1103515245 + 12345;
+			*hp = (HALF) ((((FULL) *hp) << 16) |
+				((seed >> 16) & 0xffff));
+		}
+		hp++;
+	}
+	res->v[len - 1] &= (HALF) (MAXHALF >> 1);
+	res->v[len - 1] |= (HALF) 1;
+	res->v[0] |= (HALF) 1;
+}
+
+
+/*
+ * Return the best time in microseconds taken by one operation.
+ */
+static double
+optime(op, z1, z2, z3, rp)
+	int op;			/* operation to time */
+	ZVALUE z1, z2, z3;	/* numbers to operate on */
+	REDC *rp;		/* REDC information for the modulus */
+{
+	Tcl_Time start, now;
+	ZVALUE res, rem;
+	double best, elapsed;
+	long count;
+	int trial;
+
+	best = 0.0;
+	for (trial = 0; trial < TRIALS; trial++) {
+		count = 0;
+		Tcl_GetTime(&start);
+		do {
+			switch (op) {
+				case OP_MUL:
+					zmul(z1, z2, &res);
+					break;
+				case OP_SQ:
+					zsquare(z1, &res);
+					break;
+				case OP_REDC:
+					zredcmul(rp, z1, z2, &res);
+					break;
+				case OP_DIV:
+					zdiv(z1, z3, &res, &rem);
+					zfree(rem);
+					break;
+				default:
+					zpowermod(z1, z2, z3, &res);
+					break;
+			}
+			zfree(res);
+			count++;
+			Tcl_GetTime(&now);
+			elapsed = (now.sec - start.sec) * 1000000.0 +
+				(now.usec - start.usec);
+		} while (elapsed < MINTIME);
+		elapsed /= count;
+		if ((trial == 0) || (elapsed < best))
+			best = elapsed;
+	}
+	return best;
+}
+
+
+/*
+ * Find the smallest size from which the faster algorithm wins for
+ * several sizes in a row.  The algorithm is used for a number when its
+ * size is at least the algorithm size, so setting the algorithm size
+ * to the number's size uses the faster algorithm at the top level only,
+ * and setting it one larger uses the plain algorithm throughout.
+ */
+static LEN
+crossover(name, op)
+	CONST char *name;	/* name of the algorithm size */
+	int op;			/* operation to time */
+{
+	ZVALUE z1, z2, z3;
+	REDC *rp;
+	LEN *sp;
+	LEN size, first;
+	double plain, fast;
+	int wins;
+
+	sp = tunesize(name);
+	wins = 0;
+	first = MAXSIZE;
+	for (size = 2; size <= MAXSIZE; size += (size / 8) + 1) {
+		randz((op == OP_DIV) ? 2 * size : size, &z1);
+		randz((op == OP_POW) ? POWLEN : size, &z2);
+		randz(size, &z3);
+		z3.v[size - 1] |= (HALF) TOPHALF;
+		rp = NULL;
+		if (op == OP_REDC)
+			rp = zredcalloc(z3);
+		*sp = size + 1;
+		plain = optime(op, z1, z2, z3, rp);
+		*sp = size;
+		fast = optime(op, z1, z2, z3, rp);
+		if (rp)
+			zredcfree(rp);
+		zfree(z1);
+		zfree(z2);
+		zfree(z3);
+		if (fast >= plain) {
+			wins = 0;
+			continue;
+		}
+		if (wins++ == 0)
+			first = size;
+		if (wins >= WINS)
+			return first;
+	}
+	return MAXSIZE;
+}
@@ -11,6 +11,23 @@
 static ZVALUE primeprod;		/* product of primes under 100 */
 ZVALUE _tenpowers_[2 * BASEB];		/* table of 10^2^n */
 
+/*
+ * Factors are collected in a long for as long as their product stays
+ * within MAXMUL, so that it can be multiplied in place in one pass.
+ * The cofactors in zmodinv are kept in FULLs, and with 64 bit words
+ * they need not fit in a long, so ZMULFULL multiplies by them without
+ * going through zmuli.
+ */
+#define	MAXMUL	((long) MAXHALF)
+
+#if BASEB == 64
+static void zmulfull MATH_PROTO((ZVALUE z, FULL n, ZVALUE *res));
+
+#define	ZMULFULL(z, n, res)	zmulfull(z, n, res)
+#else
+#define	ZMULFULL(z, n, res)	zmuli(z, (long) (n), res)
+#endif
+
 /*
  * Compute the factorial of a number.
  */
@@ -22,7 +39,7 @@ zfact(z, dest)
 	long n;			/* current multiplication value */
 	long m;			/* reduced multiplication value */
 	long mul;		/* collected value to multiply by */
-	ZVALUE res, temp;
+	ZVALUE res;
 
 	if (zisneg(z))
 		math_error("Negative argument for factorial");
@@ -40,26 +57,20 @@ zfact(z, dest)
 	for (; n > 1; n--) {
 		for (m = n; ((m & 0x1) == 0); m >>= 1)
 			ptwo++;
+		if (mul > MAXMUL / m) {
+			zmuliby(&res, mul);
+			mul = 1;
+		}
 		mul *= m;
-		if (mul < BASE1/2)
-			continue;
-		zmuli(res, mul, &temp);
-		zfree(res);
-		res = temp;
-		mul = 1;
 	}
 	/*
 	 * Multiply by the remaining value, then scale result by
 	 * the proper power of two.
 	 */
-	if (mul > 1) {
-		zmuli(res, mul, &temp);
-		zfree(res);
-		res = temp;
-	}
-	zshift(res, ptwo, &temp);
-	zfree(res);
-	*dest = temp;
+	if (mul > 1)
+		zmuliby(&res, mul);
+	zshiftby(&res, ptwo);
+	*dest = res;
 }
 
 
@@ -74,7 +85,7 @@ zpfact(z, dest)
 	long p;			/* current prime */
 	long i;			/* test value */
 	long mul;		/* collected value to multiply by */
-	ZVALUE res, temp;
+	ZVALUE res;
 
 	if (zisneg(z))
 		math_error("Negative argument for factorial");
@@ -92,23 +103,18 @@ zpfact(z, dest)
 			if ((p % i) == 0)
 				goto next;
 		}
+		if (mul > MAXMUL / p) {
+			zmuliby(&res, mul);
+			mul = 1;
+		}
 		mul *= p;
-		if (mul < BASE1/2)
-			continue;
-		zmuli(res, mul, &temp);
-		zfree(res);
-		res = temp;
-		mul = 1;
 next: ;
 	}
 	/*
 	 * Multiply by the final value if any.
 	 */
-	if (mul > 1) {
-		zmuli(res, mul, &temp);
-		zfree(res);
-		res = temp;
-	}
+	if (mul > 1)
+		zmuliby(&res, mul);
 	*dest = res;
 }
 
@@ -182,7 +188,7 @@ zcomb(z1, z2, res)
 		div.len = 1 + (dh[1] != 0);
 		zmul(ans, mul, &temp);
 		zfree(ans);
-		zquo(temp, div, &ans);
+		zdivexact(temp, div, &ans);
 		zfree(temp);
 		zsub(mul, _one_, &temp);
 		if (mul.v != z1.v)
@@ -242,6 +248,7 @@ zprimetest(z, count)
 	if (primeprod.len == 0) {
 		val[0] = 101;
 		zpfact(ztmp, &primeprod);
+		zkeep(primeprod);
 	}
 	zgcd(z, primeprod, &z1);
 	if (!zisunit(z1)) {
@@ -325,7 +332,7 @@ zfib(z, res)
 		res->sign = (BOOL)sign;
 		return;
 	}
-	i = TOPFULL;
+	i = TOPLONGVAL;
 	while ((i & n) == 0)
 		i >>= 1L;
 	i >>= 1L;
@@ -339,11 +346,11 @@ zfib(z, res)
 		zfree(fnm1);
 		zfree(fn);
 		zfree(fnp1);
-		zadd(t2, t3, &fnp1);
-		zsub(t3, t1, &fn);
+		fnp1 = t2;
+		zaddto(&fnp1, t3);
+		fn = t3;
+		zsubfrom(&fn, t1);
 		zfree(t1);
-		zfree(t2);
-		zfree(t3);
 		if (i & n) {
 			fnm1 = fn;
 			fn = fnp1;
@@ -452,7 +459,7 @@ zpowi(z1, z2, res)
 	 * Compute the power by squaring and multiplying.
 	 * This uses the left to right method of power raising.
 	 */
-	bit = TOPFULL;
+	bit = TOPLONGVAL;
 	while ((bit & power) == 0)
 		bit >>= 1L;
 	bit >>= 1L;
@@ -508,8 +515,10 @@ ztenpow(power, res)
 	ans = _one_;
 	_tenpowers_[0] = _ten_;
 	for (i = 0; power; i++) {
-		if (_tenpowers_[i].len == 0)
+		if (_tenpowers_[i].len == 0) {
 			zsquare(_tenpowers_[i-1], &_tenpowers_[i]);
+			zkeep(_tenpowers_[i]);
+		}
 		if (power & 0x1) {
 			zmul(ans, _tenpowers_[i], &temp);
 			zfree(ans);
@@ -521,6 +530,23 @@ ztenpow(power, res)
 }
 
 
+/*
+ * Return the number of bytes held by the table of powers of ten.
+ */
+long
+ztenpowsize()
+{
+	long bytes;
+	int i;
+
+	bytes = 0;
+	for (i = 1; (i < 2 * BASEB) && _tenpowers_[i].len; i++)
+		bytes += sizeof(ZHEAD) +
+			((ZHEAD *) _tenpowers_[i].v)[-1].size * sizeof(HALF);
+	return bytes;
+}
+
+
 /*
  * Calculate modular inverse suppressing unnecessary divisions.
  * This is based on the Euclidian algorithm for large numbers.
@@ -609,26 +635,26 @@ zmodinv(u, v, res)
 		 * values to update them as if the full precision
 		 * calculations had been carried out.
 		 */
-		zmuli(u2, (long) A, &tmp1);
-		zmuli(v2, (long) B, &tmp2);
+		ZMULFULL(u2, A, &tmp1);
+		ZMULFULL(v2, B, &tmp2);
 		zadd(tmp1, tmp2, &tmp3);
 		zfree(tmp1);
 		zfree(tmp2);
-		zmuli(u2, (long) C, &tmp1);
-		zmuli(v2, (long) D, &tmp2);
+		ZMULFULL(u2, C, &tmp1);
+		ZMULFULL(v2, D, &tmp2);
 		zfree(u2);
 		zfree(v2);
 		u2 = tmp3;
 		zadd(tmp1, tmp2, &v2);
 		zfree(tmp1);
 		zfree(tmp2);
-		zmuli(u3, (long) A, &tmp1);
-		zmuli(v3, (long) B, &tmp2);
+		ZMULFULL(u3, A, &tmp1);
+		ZMULFULL(v3, B, &tmp2);
 		zadd(tmp1, tmp2, &tmp3);
 		zfree(tmp1);
 		zfree(tmp2);
-		zmuli(u3, (long) C, &tmp1);
-		zmuli(v3, (long) D, &tmp2);
+		ZMULFULL(u3, C, &tmp1);
+		ZMULFULL(v3, D, &tmp2);
 		zfree(u3);
 		zfree(v3);
 		u3 = tmp3;
@@ -648,18 +674,18 @@ zmodinv(u, v, res)
 		zfree(v2);
 		return TRUE;
 	}
-	ui3 = (zistiny(u3) ? z1tol(u3) : z2tol(u3));
-	vi3 = (zistiny(v3) ? z1tol(v3) : z2tol(v3));
+	ui3 = (FULL) u3.v[0];
+	vi3 = (FULL) v3.v[0];
 	zfree(u3);
 	zfree(v3);
 	while (vi3) {
 		q1 = ui3 / vi3;
-		zmuli(v2, (long) q1, &tmp1);
-		zsub(u2, tmp1, &tmp2);
-		zfree(tmp1);
-		zfree(u2);
+		tmp1 = v2;
+		tmp1.sign = !tmp1.sign;
+		zaddmul(&u2, tmp1, (HALF) q1);
+		tmp1 = u2;
 		u2 = v2;
-		v2 = tmp2;
+		v2 = tmp1;
 		q2 = ui3 - q1 * vi3;
 		ui3 = vi3;
 		vi3 = q2;
@@ -678,6 +704,29 @@ zmodinv(u, v, res)
 	return FALSE;
 }
 
+#if BASEB == 64
+/*
+ * Multiply a number by a two's complement value held in a FULL.
+ */
+static void
+zmulfull(z, n, res)
+	ZVALUE z, *res;
+	FULL n;
+{
+	ZVALUE mul;
+	HALF mulval[2];
+
+	mul.sign = ((n & TOPFULL) != 0);
+	if (mul.sign)
+		n = -n;
+	mulval[0] = (HALF) n;
+	mulval[1] = (HALF) (n >> BASEB);
+	mul.v = mulval;
+	mul.len = 1 + (mulval[1] != 0);
+	zmul(z, mul, res);
+}
+#endif
+
 /*
  * Binary gcd algorithm
  * This algorithm taken from Knuth
@@ -799,10 +848,7 @@ zgcd(z1, z2, res)
 	if (k) {
 		olen = u.len;
 		u.len += k / BASEB + 1;
-		u.v = (HALF *) ckrealloc((char *)u.v, u.len * sizeof(HALF));
-		if (u.v == NULL) {
-		    math_error("Not enough memory to expand number");
-		}
+		u.v = realloch(u.v, olen, u.len);
 		while (olen != u.len)
 			u.v[olen++] = 0;
 		zshiftl(u, k);
@@ -829,7 +875,7 @@ zlcm(z1, z2, res)
 	ZVALUE temp1, temp2;
 
 	zgcd(z1, z2, &temp1);
-	zquo(z1, temp1, &temp2);
+	zdivexact(z1, temp1, &temp2);
 	zfree(temp1);
 	zmul(temp2, z2, res);
 	zfree(temp2);
@@ -916,8 +962,10 @@ zlog10(z)
 	zp = &_tenpowers_[0];
 	*zp = _ten_;
 	while (((zp->len * 2) - 1) <= z.len) {	/* while square not too large */
-		if (zp[1].len == 0)
+		if (zp[1].len == 0) {
 			zsquare(*zp, zp + 1);
+			zkeep(zp[1]);
+		}
 		zp++;
 		worth *= 2;
 	}
@@ -1073,7 +1121,7 @@ zgcdrem(z1, z2, res)
 		zcopyval(z1, *res);
 		return;
 	}
-	zquo(z1, tmp1, &tmp2);
+	zdivexact(z1, tmp1, &tmp2);
 	z1 = tmp2;
 	z2 = tmp1;
 	/*
@@ -1166,8 +1214,8 @@ zsqrt(z1, dest)
 	ZVALUE z1, *dest;
 {
 	ZVALUE ztry, quo, rem, old, temp;
-	FULL iquo, val;
-	long i,j;
+	FULL iquo, val, j;
+	long i;
 
 	if (z1.sign)
 		math_error("Square root of negative number");
@@ -1191,7 +1239,7 @@ zsqrt(z1, dest)
 	 * is <= val > 0.  Avoid multiply overflow by doing 
 	 * a careful check at the BASE boundary.
 	 */
-	j = 1L<<(BASEB+BASEB-2);
+	j = ((FULL) 1) << (BASEB+BASEB-2);
 	if (val > j) {
 		iquo = BASE;
 	} else {
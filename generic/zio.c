@@ -15,6 +15,19 @@
 #define	PRINTF1(fmt, a1)	math_fmt(fmt, a1)
 #define	PRINTF2(fmt, a1, a2)	math_fmt(fmt, a1, a2)
 
+/*
+ * Octal output of a FULL.  When a FULL is wider than any type printf
+ * knows about, the digits are generated by hand.
+ */
+#if BASEB == 64
+static void zprintoct MATH_PROTO((FULL num, int width));
+#define	PRINTOCT1(num)		(PUTCHAR('0'), zprintoct(num, 0))
+#define	PRINTOCT2(num)		zprintoct(num, BASEB/2)
+#else
+#define	PRINTOCT1(num)		PRINTF1("0%"FULLFMT"o", num)
+#define	PRINTOCT2(num)		PRINTF2("%0*"FULLFMT"o", BASEB/2, num)
+#endif
+
 /*
  * Output state that has been saved when diversions are done.
  */
@@ -229,9 +242,9 @@ zprintx(z, width)
 		return;
 	}
 	hp = z.v + len;
-	PRINTF1("0x%x", (FULL) *hp--);
+	PRINTF1("0x%lx", (unsigned long) *hp--);
 	while (--len >= 0)
-		PRINTF2("%0*x", BASEB/4, (FULL) *hp--);
+		PRINTF2("%0*lx", BASEB/4, (unsigned long) *hp--);
 }
 
 
@@ -274,7 +287,7 @@ zprintb(z, width)
 	PUTSTR("0b");
 	while (len-- >= 0) {
 		val = *hp--;
-		mask = (1 << (BASEB - 1));
+		mask = (HALF) TOPHALF;
 		while (mask) {
 			ch = '0' + ((mask & val) != 0);
 			if (didprint || (ch != '0')) {
@@ -287,6 +300,32 @@ zprintb(z, width)
 }
 
 
+#if BASEB == 64
+/*
+ * Print a full value in octal, padded with zeroes to the given width.
+ */
+static void
+zprintoct(num, width)
+	FULL num;
+	int width;
+{
+	char buf[48];		/* room for 128 bits of octal digits */
+	char *cp;
+
+	cp = &buf[sizeof(buf) - 1];
+	*cp = '\0';
+	do {
+		*--cp = (char) ('0' + (int) (num & 7));
+		num >>= 3;
+		width--;
+	} while (num);
+	while (width-- > 0)
+		*--cp = '0';
+	PUTSTR(cp);
+}
+#endif
+
+
 /*
  * Print an integer value as an octal number.
  * The number begins with a leading 0 to indicate that it is octal.
@@ -339,18 +378,18 @@ zprinto(z, width)
 			break;
 	}
 	if (num1) {
-		PRINTF1("0%"FULLFMT"o", num1);
-		PRINTF2("%0*"FULLFMT"o", BASEB/2, num2);
+		PRINTOCT1(num1);
+		PRINTOCT2(num2);
 	} else {
-		PRINTF1("0%"FULLFMT"o", num2);
+		PRINTOCT1(num2);
 	}
 	len -= rem;
 	hp -= rem;
 	while (len > 0) {	/* finish in groups of 3 halfwords */
 		num1 = (((FULL) hp[0]) << (BASEB/2)) + (((FULL) hp[-1]) >> (BASEB/2));
 		num2 = (((FULL) (hp[-1] & mask)) << BASEB) + ((FULL) hp[-2]);
-		PRINTF2("%0*"FULLFMT"o", BASEB/2, num1);
-		PRINTF2("%0*"FULLFMT"o", BASEB/2, num2);
+		PRINTOCT2(num1);
+		PRINTOCT2(num2);
 		hp -= 3;
 		len -= 3;
 	}
@@ -403,8 +442,10 @@ zprintval(z, decimals, width)
 	depth = 0;
 	while ((_tenpowers_[depth].len < z.len) || (zrel(_tenpowers_[depth], z) <= 0)) {
 		depth++;
-		if (_tenpowers_[depth].len == 0)
+		if (_tenpowers_[depth].len == 0) {
 			zsquare(_tenpowers_[depth-1], &_tenpowers_[depth]);
+			zkeep(_tenpowers_[depth]);
+		}
 	}
 	/*
 	 * Divide by smaller 2^N powers of ten until the parts are small
@@ -514,8 +555,10 @@ Zprintval(z, decimals, width)
 	depth = 0;
 	while ((_tenpowers_[depth].len < z.len) || (zrel(_tenpowers_[depth], z) <= 0)) {
 		depth++;
-		if (_tenpowers_[depth].len == 0)
+		if (_tenpowers_[depth].len == 0) {
 			zsquare(_tenpowers_[depth-1], &_tenpowers_[depth]);
+			zkeep(_tenpowers_[depth]);
+		}
 	}
 	/*
 	 * Divide by smaller 2^N powers of ten until the parts are small
@@ -592,7 +635,7 @@ atoz(s, res)
 	register CONST char *s;
 	ZVALUE *res;
 {
-	ZVALUE z, ztmp, digit;
+	ZVALUE z, digit;
 	HALF digval;
 	BOOL minus;
 	long shift;
@@ -634,12 +677,10 @@ atoz(s, res)
 		else
 			break;
 		if (shift)
-			zshift(z, shift, &ztmp);
+			zshiftby(&z, shift);
 		else
-			zmuli(z, 10L, &ztmp);
-		zfree(z);
-		zadd(ztmp, digit, &z);
-		zfree(ztmp);
+			zmuliby(&z, 10L);
+		zaddto(&z, digit);
 	}
 	ztrim(&z);
 	if (minus && !ziszero(z))
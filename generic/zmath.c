@@ -6,14 +6,15 @@
  * Extended precision integral arithmetic primitives
  */
 
-#include <tcl.h>
-#include "zmath.h"
+#include "mpexpr.h"
 
 
-HALF _twoval_[] = { 2 };
-HALF _zeroval_[] = { 0 };
-HALF _oneval_[] = { 1 };
-HALF _tenval_[] = { 10 };
+ZCONST _zconst_[] = {
+	{ { { NULL, NULL }, 0 }, { 0 } },
+	{ { { NULL, NULL }, 0 }, { 1 } },
+	{ { { NULL, NULL }, 0 }, { 2 } },
+	{ { { NULL, NULL }, 0 }, { 10 } }
+};
 
 ZVALUE _zero_ = { _zeroval_, 1, 0};
 ZVALUE _one_ = { _oneval_, 1, 0 };
@@ -28,53 +29,364 @@ ZVALUE _ten_ = { _tenval_, 1, 0 };
 static HALF *bmask;		/* actual rotation thru 8 cycles */
 HALF *bitmask;			/* bit rotation, norm 0 */
 
-static void dadd MATH_PROTO((ZVALUE z1, ZVALUE z2, long y, long n));
-static BOOL dsub MATH_PROTO((ZVALUE z1, ZVALUE z2, long y, long n));
-static void dmul MATH_PROTO((ZVALUE z, FULL x, ZVALUE *dest));
+static void zdivlarge MATH_PROTO((ZVALUE z1, ZVALUE z2, ZVALUE *quo,
+	ZVALUE *rem));
+static void zdivrec MATH_PROTO((ZVALUE a, ZVALUE b, LEN k, ZVALUE *quo,
+	ZVALUE *rem));
+static ZVALUE zwords MATH_PROTO((ZVALUE z, LEN pos, LEN len));
+static void zjoin MATH_PROTO((ZVALUE hi, ZVALUE lo, LEN pos, ZVALUE *res));
 
+LEN _div2_ = DIV_ALG2;		/* size of divisor to divide recursively */
 
-#ifdef ALLOCTEST
-static long nalloc = 0;
-static long nfree = 0;
+
+/*
+ * Arrays of words up to a medium size are kept in pools of free arrays
+ * for each thread when freed, so that the many short lived numbers made
+ * while evaluating an expression do not each go to the memory allocator.
+ * The small size classes step by a few words and the larger ones by
+ * powers of two, and each class keeps about the same number of words.
+ * Larger arrays are allocated and freed directly.
+ */
+#define	POOLSTEP	2	/* words between the small size classes */
+#define	POOLSMALL	16	/* number of small size classes */
+#define	POOLCLASSES	22	/* number of size classes */
+#define	POOLWORDS	16384	/* words kept free in each size class */
+
+typedef struct {
+	ZHEAD	*free[POOLCLASSES];	/* free arrays of each size class */
+	LEN	count[POOLCLASSES];	/* number of free arrays of each class */
+	int	ready;			/* nonzero once the exit handler is set */
+	ZSCOPE	*scope;			/* scope of the current evaluation */
+	ZSTAT	stats[POOLCLASSES + 1];	/* use of each size class, and of the
+					 * arrays too large for a pool */
+} Pool;
+
+static Tcl_ThreadDataKey poolKey = NULL;
+
+/*
+ * Finding thread data through Tcl takes about as long as the allocation
+ * being saved, so where the compiler has thread local variables the pool
+ * of each thread is remembered in one.
+ */
+#if defined(__GNUC__)
+# define POOLLOCAL __thread
+#elif defined(_MSC_VER)
+# define POOLLOCAL __declspec(thread)
+#endif
+
+#ifdef POOLLOCAL
+static POOLLOCAL Pool *threadPool = NULL;
+#endif
+
+static Pool *getpool MATH_PROTO((void));
+static int poolclass MATH_PROTO((LEN size));
+static LEN poolsize MATH_PROTO((int class));
+static void poolexit MATH_PROTO((ClientData clientData));
+
+
+/*
+ * Return the pool of the current thread.
+ */
+static Pool *
+getpool()
+{
+#ifdef POOLLOCAL
+	if (threadPool == NULL)
+		threadPool = Tcl_GetThreadData(&poolKey, sizeof(Pool));
+	return threadPool;
+#else
+	return Tcl_GetThreadData(&poolKey, sizeof(Pool));
+#endif
+}
+
+
+/*
+ * Return the size class for an array of the given number of words, which
+ * is POOLCLASSES if the array is too large to be kept in a pool.
+ */
+static int
+poolclass(size)
+	LEN size;
+{
+	LEN room;
+	int class;
+
+	if (size <= POOLSTEP * POOLSMALL)
+		return (int) ((size - 1) / POOLSTEP);
+	room = POOLSTEP * POOLSMALL * 2;
+	for (class = POOLSMALL; (class < POOLCLASSES) && (room < size); class++)
+		room <<= 1;
+	return class;
+}
+
+
+/*
+ * Return the number of words in the arrays of a size class.
+ */
+static LEN
+poolsize(class)
+	int class;
+{
+	if (class < POOLSMALL)
+		return (LEN) (class + 1) * POOLSTEP;
+	return ((LEN) POOLSTEP * POOLSMALL * 2) << (class - POOLSMALL);
+}
+
+
+/*
+ * Free the arrays kept in the pools of a thread when it exits.
+ */
+static void
+poolexit(clientData)
+	ClientData clientData;
+{
+	Pool *pool = (Pool *) clientData;
+	ZHEAD *hp;
+	int class;
+
+	for (class = 0; class < POOLCLASSES; class++) {
+		while ((hp = pool->free[class]) != NULL) {
+			pool->free[class] = (ZHEAD *) hp->link.next;
+			ckfree((char *) hp);
+		}
+		pool->count[class] = 0;
+	}
+#ifdef POOLLOCAL
+	threadPool = NULL;
 #endif
+}
 
 
+/*
+ * Allocate an array with room for the given number of words and one more.
+ */
 HALF *
 alloc(len)
-	long len;
+	LEN len;
+{
+	Pool *pool;
+	ZHEAD *hp;
+	LEN size;
+	int class;
+
+	pool = getpool();
+	size = len + 1;
+	class = poolclass(size);
+	hp = NULL;
+	if (class < POOLCLASSES) {
+		size = poolsize(class);
+		hp = pool->free[class];
+		if (hp) {
+			pool->free[class] = (ZHEAD *) hp->link.next;
+			pool->count[class]--;
+		}
+	}
+	if (hp == NULL) {
+		hp = (ZHEAD *) ckalloc(sizeof(ZHEAD) + size * sizeof(HALF));
+		if (hp == 0)
+			math_error("Not enough memory");
+	}
+	hp->size = size;
+	if (pool->scope)
+		zlinkin(&pool->scope->arrays, &hp->link);
+	else
+		hp->link.next = NULL;
+	pool->stats[class].allocs++;
+	pool->stats[class].words += size;
+	return (HALF *) (hp + 1);
+}
+
+
+/*
+ * Make room for the given number of words and one more in place of an
+ * array whose first words are in use, keeping those words.  The array
+ * is returned unchanged if it already has the room, and otherwise it is
+ * freed and a new one returned.  A constant is always copied.
+ */
+HALF *
+realloch(h, used, len)
+	HALF *h;		/* array to make room in */
+	LEN used;		/* number of words in use */
+	LEN len;		/* number of words needed */
 {
 	HALF *hp;
 
-	hp = (HALF *) ckalloc((len+1) * sizeof(HALF));
-	if (hp == 0)
-		math_error("Not enough memory");
-#ifdef ALLOCTEST
-	++nalloc;
-#endif
+	if (((ZHEAD *) h)[-1].size > len)
+		return h;
+	hp = alloc(len);
+	memcpy(hp, h, used * sizeof(HALF));
+	freeh(h);
 	return hp;
 }
 
 
-#ifdef ALLOCTEST
+/*
+ * Free an array made by alloc, keeping it in the pool for its size class
+ * if the pool is not full.  The constants are left alone.
+ */
 void
 freeh(h)
 	HALF *h;
 {
-	if ((h != _zeroval_) && (h != _oneval_)
-	    (h != _twoval_)  && (h != _tenval_)) {
-		ckfree(h);
-		++nfree;
+	Pool *pool;
+	ZHEAD *hp;
+	int class;
+
+	hp = ((ZHEAD *) h) - 1;
+	if (hp->size == 0)
+		return;
+	if (hp->link.next)
+		zunlink(&hp->link);
+	pool = getpool();
+	class = poolclass(hp->size);
+	pool->stats[class].frees++;
+	pool->stats[class].words -= hp->size;
+	if (class < POOLCLASSES) {
+		if (pool->count[class] * hp->size < POOLWORDS) {
+			if (!pool->ready) {
+				Tcl_CreateThreadExitHandler(poolexit,
+					(ClientData) pool);
+				pool->ready = 1;
+			}
+			hp->link.next = (ZLINK *) pool->free[class];
+			pool->free[class] = hp;
+			pool->count[class]++;
+			return;
+		}
 	}
+	ckfree((char *) hp);
 }
 
 
+/*
+ * Keep an array made while an expression is evaluated beyond the end of
+ * the evaluation, by taking it out of the scope of the evaluation.
+ */
 void
-allocStat()
+keeph(h)
+	HALF *h;
 {
-	fprintf(stderr, "nalloc: %ld nfree: %ld kept: %ld\n",
-		nalloc, nfree, nalloc - nfree);
+	ZHEAD *hp;
+
+	hp = ((ZHEAD *) h) - 1;
+	if (hp->link.next)
+		zunlink(&hp->link);
+}
+
+
+/*
+ * Begin a scope holding the arrays and numbers made from now on, within
+ * the current scope if there is one.
+ */
+void
+zbeginscope(sp)
+	ZSCOPE *sp;
+{
+	Pool *pool = getpool();
+
+	sp->arrays.next = sp->arrays.prev = &sp->arrays;
+	sp->numbers.next = sp->numbers.prev = &sp->numbers;
+	sp->outer = pool->scope;
+	pool->scope = sp;
+}
+
+
+/*
+ * End a scope, making the scope it was begun in current again.  If the
+ * evaluation was abandoned the arrays still held in the scope are freed,
+ * after qendscope has freed the numbers.  Otherwise whatever is still
+ * held is handed to the enclosing scope, or to no scope at all.
+ */
+void
+zendscope(sp, release)
+	ZSCOPE *sp;
+	BOOL release;		/* TRUE to free the arrays */
+{
+	Pool *pool = getpool();
+	ZLINK *lists[2], *head, *to, *lp;
+	int i;
+
+	if (release) {
+		while ((lp = sp->arrays.next) != &sp->arrays) {
+			zunlink(lp);
+			freeh((HALF *) (((ZHEAD *) lp) + 1));
+		}
+	}
+	lists[0] = &sp->arrays;
+	lists[1] = &sp->numbers;
+	for (i = 0; i < 2; i++) {
+		head = lists[i];
+		if (head->next == head)
+			continue;
+		if (sp->outer) {
+			to = (i == 0) ? &sp->outer->arrays : &sp->outer->numbers;
+			head->next->prev = to;
+			head->prev->next = to->next;
+			to->next->prev = head->prev;
+			to->next = head->next;
+		} else {
+			while ((lp = head->next) != head) {
+				head->next = lp->next;
+				lp->next = NULL;
+			}
+		}
+		head->next = head->prev = head;
+	}
+	pool->scope = sp->outer;
+}
+
+
+/*
+ * Make the given scope current, or none if it is NULL, returning the
+ * scope which was current.  This is used to leave values such as
+ * compiled expressions out of the scope of an evaluation.
+ */
+ZSCOPE *
+zsetscope(sp)
+	ZSCOPE *sp;
+{
+	Pool *pool = getpool();
+	ZSCOPE *old;
+
+	old = pool->scope;
+	pool->scope = sp;
+	return old;
+}
+
+
+/*
+ * Return the current scope, or NULL if there is none.
+ */
+ZSCOPE *
+zgetscope()
+{
+	return getpool()->scope;
+}
+
+
+/*
+ * Return the use of the arrays of a size class by the current thread,
+ * where the classes after the ones kept in pools count the arrays too
+ * large for a pool.  FALSE is returned if there is no such class.
+ */
+BOOL
+zallocstat(class, sp)
+	int class;		/* size class */
+	ZSTAT *sp;		/* where to return the use of the class */
+{
+	Pool *pool = getpool();
+
+	if ((class < 0) || (class > POOLCLASSES))
+		return FALSE;
+	*sp = pool->stats[class];
+	sp->size = 0;
+	sp->pooled = 0;
+	if (class < POOLCLASSES) {
+		sp->size = poolsize(class);
+		sp->pooled = pool->count[class];
+	}
+	return TRUE;
 }
-#endif
 
 
 /*
@@ -126,7 +438,7 @@ ztoi(z)
 	long i;
 
 	if (zisbig(z)) {
-		i = MAXFULL;
+		i = MAXLONGVAL;
 		return (z.sign ? -i : i);
 	}
 	i = (zistiny(z) ? z1tol(z) : z2tol(z));
@@ -160,7 +472,7 @@ zadd(z1, z2, res)
 	ZVALUE z1, z2, *res;
 {
 	ZVALUE dest;
-	HALF *p1, *p2, *pd;
+	HALF *p1, *pd;
 	long len;
 	FULL carry;
 	SIUNION sival;
@@ -182,16 +494,9 @@ zadd(z1, z2, res)
 	dest.len = z1.len + 1;
 	dest.v = alloc(dest.len);
 	dest.sign = z1.sign;
-	carry = 0;
-	pd = dest.v;
-	p1 = z1.v;
-	p2 = z2.v;
-	len = z2.len;
-	while (len--) {
-		sival.ivalue = ((FULL) *p1++) + ((FULL) *p2++) + carry;
-		*pd++ = sival.silow;
-		carry = sival.sihigh;
-	}
+	carry = zvadd(dest.v, z1.v, z2.v, z2.len);
+	pd = dest.v + z2.len;
+	p1 = z1.v + z2.len;
 	len = z1.len - z2.len;
 	while (len--) {
 		sival.ivalue = ((FULL) *p1++) + carry;
@@ -256,12 +561,9 @@ zsub(z1, z2, res)
 	dest.v = hd;
 	dest.len = len1;
 	len1 -= len2;
-	carry = 0;
-	while (--len2 >= 0) {
-		sival.ivalue = (BASE1 - ((FULL) *h1++)) + *h2++ + carry;
-		*hd++ = BASE1 - sival.silow;
-		carry = sival.sihigh;
-	}
+	carry = zvsub(hd, h1, h2, len2);
+	hd += len2;
+	h1 += len2;
 	while (--len1 >= 0) {
 		sival.ivalue = (BASE1 - ((FULL) *h1++)) + carry;
 		*hd++ = BASE1 - sival.silow;
@@ -282,12 +584,10 @@ zmuli(z, n, res)
 	long n;
 	ZVALUE *res;
 {
-	register HALF *h1, *sd;
+	register HALF *sd;
 	FULL low;
 	FULL high;
 	FULL carry;
-	long len;
-	SIUNION sival;
 	ZVALUE dest;
 
 	if ((n == 0) || ziszero(z)) {
@@ -310,15 +610,8 @@ zmuli(z, n, res)
 	/*
 	 * Multiply by the low digit.
 	 */
-	h1 = z.v;
-	sd = dest.v;
-	len = z.len;
-	carry = 0;
-	while (len--) {
-		sival.ivalue = ((FULL) *h1++) * low + carry;
-		*sd++ = sival.silow;
-		carry = sival.sihigh;
-	}
+	carry = zvmul1(dest.v, z.v, z.len, (HALF) low);
+	sd = dest.v + z.len;
 	*sd = (HALF)carry;
 	/*
 	 * If there was only one digit, then we are all done except
@@ -336,21 +629,289 @@ zmuli(z, n, res)
 	 * previous value.  Clear the final word of rubbish first.
 	 */
 	*(++sd) = 0;
-	h1 = z.v;
-	sd = dest.v + 1;
-	len = z.len;
-	carry = 0;
-	while (len--) {
-		sival.ivalue = ((FULL) *h1++) * high + ((FULL) *sd) + carry;
-		*sd++ = sival.silow;
-		carry = sival.sihigh;
-	}
-	*sd = (HALF)carry;
+	*sd = zvaddmul1(dest.v + 1, z.v, z.len, (HALF) high);
 	zquicktrim(dest);
 	*res = dest;
 }
 
 
+/*
+ * Make an integer which is about to be changed in place own its storage
+ * and have room for at least the given number of words.  Any new words
+ * are cleared, and are included in the length until the caller trims it.
+ */
+static void
+zroom(z, len)
+	ZVALUE *z;
+	LEN len;
+{
+	z->v = realloch(z->v, z->len, (len > z->len) ? len : z->len);
+	if (len > z->len) {
+		memset(z->v + z->len, 0, (len - z->len) * sizeof(HALF));
+		z->len = len;
+	}
+}
+
+
+/*
+ * Add an integer to another in place, growing the destination only
+ * when the sum needs more words.  The integer being added must not
+ * share its storage with the destination.
+ */
+void
+zaddto(res, z)
+	ZVALUE *res;
+	ZVALUE z;
+{
+	HALF *h1, *h2;
+	LEN len, i;
+	HALF carry;
+
+	if (ziszero(z))
+		return;
+	if (res->sign == z.sign) {
+		zroom(res, z.len);
+		carry = zvadd(res->v, res->v, z.v, z.len);
+		for (i = z.len; carry && (i < res->len); i++)
+			carry = (++res->v[i] == 0);
+		if (carry) {
+			len = res->len;
+			zroom(res, len + 1);
+			res->v[len] = carry;
+		}
+		return;
+	}
+	/*
+	 * The signs differ, so subtract the smaller magnitude from the
+	 * larger one, and take the sign of the larger one.
+	 */
+	len = res->len;
+	if (len == z.len) {
+		h1 = res->v + len - 1;
+		h2 = z.v + len - 1;
+		while ((len > 0) && (*h1 == *h2)) {
+			len--;
+			h1--;
+			h2--;
+		}
+		if (len == 0) {
+			zfree(*res);
+			*res = _zero_;
+			return;
+		}
+		carry = (*h1 < *h2);
+	} else
+		carry = (len < z.len);
+	zroom(res, z.len);
+	if (carry) {
+		(void) zvsub(res->v, z.v, res->v, z.len);
+		res->sign = z.sign;
+	} else {
+		carry = zvsub(res->v, res->v, z.v, z.len);
+		for (i = z.len; carry && (i < res->len); i++)
+			carry = (res->v[i]-- == 0);
+	}
+	ztrim(res);
+}
+
+
+/*
+ * Subtract an integer from another in place.  The integer being
+ * subtracted must not share its storage with the destination.
+ */
+void
+zsubfrom(res, z)
+	ZVALUE *res;
+	ZVALUE z;
+{
+	if (ziszero(z))
+		return;
+	z.sign = !z.sign;
+	zaddto(res, z);
+}
+
+
+/*
+ * Multiply an integer by a small number in place, growing the
+ * destination only when the product needs another word.
+ */
+void
+zmuliby(res, n)
+	ZVALUE *res;
+	long n;
+{
+	HALF carry;
+	ZVALUE tmp;
+	LEN len;
+
+	if ((n == 0) || ziszero(*res)) {
+		zfree(*res);
+		*res = _zero_;
+		return;
+	}
+	if (n < 0) {
+		n = -n;
+		res->sign = !res->sign;
+	}
+	if (n == 1)
+		return;
+	if (((FULL) n) > BASE1) {
+		zmuli(*res, n, &tmp);
+		zfree(*res);
+		*res = tmp;
+		return;
+	}
+	len = res->len;
+	zroom(res, len);
+	carry = zvmul1(res->v, res->v, len, (HALF) n);
+	if (carry) {
+		zroom(res, len + 1);
+		res->v[len] = carry;
+	}
+}
+
+
+/*
+ * Add the product of an integer and a single word to another integer
+ * in place.  The integer being multiplied must not share its storage
+ * with the destination.
+ */
+void
+zaddmul(res, z, n)
+	ZVALUE *res;
+	ZVALUE z;
+	HALF n;
+{
+	HALF carry;
+	ZVALUE tmp;
+	LEN len, i;
+
+	if ((n == 0) || ziszero(z))
+		return;
+	if ((res->sign != z.sign) && !ziszero(*res)) {
+		tmp.len = z.len + 1;
+		tmp.v = alloc(tmp.len);
+		tmp.sign = z.sign;
+		tmp.v[z.len] = zvmul1(tmp.v, z.v, z.len, n);
+		zquicktrim(tmp);
+		zaddto(res, tmp);
+		zfree(tmp);
+		return;
+	}
+	res->sign = z.sign;
+	zroom(res, z.len);
+	carry = zvaddmul1(res->v, z.v, z.len, n);
+	for (i = z.len; carry && (i < res->len); i++) {
+		res->v[i] += carry;
+		carry = (res->v[i] < carry);
+	}
+	if (carry) {
+		len = res->len;
+		zroom(res, len + 1);
+		res->v[len] = carry;
+	}
+}
+
+
+/*
+ * Shift an integer left (or right) by the given number of bits in place,
+ * growing the destination only when the shifted value needs more words
+ * than it has room for.  The sign of the number is preserved.
+ */
+void
+zshiftby(res, n)
+	ZVALUE *res;
+	long n;
+{
+	ZVALUE top;
+	LEN len;
+	long hc;		/* number of halfwords shift is by */
+
+	if ((n == 0) || ziszero(*res))
+		return;
+	if (n < 0) {
+		n = -n;
+		if ((n < 0) || (n >= (res->len * BASEB))) {
+			zfree(*res);
+			*res = _zero_;
+			return;
+		}
+		zroom(res, res->len);
+		zshiftr(*res, n);
+		ztrim(res);
+		if (ziszero(*res)) {
+			zfree(*res);
+			*res = _zero_;
+		}
+		return;
+	}
+	hc = n / BASEB;
+	n %= BASEB;
+	len = res->len;
+	zroom(res, len + hc + 1);
+	if (hc > 0) {
+		memmove((char *) (res->v + hc), (char *) res->v,
+			len * sizeof(HALF));
+		memset((char *) res->v, 0, hc * sizeof(HALF));
+	}
+	if (n > 0) {
+		top.v = res->v + hc;
+		top.len = len + 1;
+		zshiftl(top, n);
+	}
+	ztrim(res);
+}
+
+
+/*
+ * Divide an integer by a small number in place, returning the remainder.
+ * The storage of the destination is reused, since the quotient is no
+ * longer than it.
+ */
+long
+zdiviby(res, n)
+	ZVALUE *res;
+	long n;
+{
+	register HALF *hp;
+	FULL val;
+	ZVALUE tmp;
+	LEN len;
+
+	if (n == 0)
+		math_error("Division by zero");
+	if (ziszero(*res))
+		return 0;
+	if ((n & ~BASE1) && (-n & ~BASE1)) {
+		n = zdivi(*res, n, &tmp);
+		zfree(*res);
+		*res = tmp;
+		return n;
+	}
+	if (n < 0) {
+		n = -n;
+		res->sign = !res->sign;
+	}
+	if (n == 1)
+		return 0;
+	zroom(res, res->len);
+	len = res->len;
+	hp = res->v + len - 1;
+	val = 0;
+	while (len--) {
+		val = ((val << BASEB) + ((FULL) *hp));
+		*hp-- = (HALF) (val / n);
+		val %= n;
+	}
+	ztrim(res);
+	if (ziszero(*res)) {
+		zfree(*res);
+		*res = _zero_;
+	}
+	return (long) val;
+}
+
+
 /*
  * Divide two numbers by their greatest common divisor.
  * This is useful for reducing the numerator and denominator of
@@ -370,8 +931,8 @@ zreduce(z1, z2, z1res, z2res)
 		zcopy(z1, z1res);
 		zcopy(z2, z2res);
 	} else {
-		zquo(z1, tmp, z1res);
-		zquo(z2, tmp, z2res);
+		zdivexact(z1, tmp, z1res);
+		zdivexact(z2, tmp, z2res);
 	}
 	zfree(tmp);
 }
@@ -387,13 +948,14 @@ void
 zdiv(z1, z2, res, rem)
 	ZVALUE z1, z2, *res, *rem;
 {
-	long i, j, k;
+	long j, k;
 	register HALF *q, *pp;
 	SIUNION pair;		/* pair of halfword values */
 	HALF h2, v2;
+	HALF borrow;		/* borrow from subtracting multiple */
 	long y;
 	FULL x;
-	ZVALUE ztmp1, ztmp2, ztmp3, quo;
+	ZVALUE ztmp1, ztmp2, quo;
 
 	if (ziszero(z2))
 		math_error("Division by zero");
@@ -407,12 +969,15 @@ zdiv(z1, z2, res, rem)
 		*rem = _zero_;
 		return;
 	}
-	i = BASE / 2;
+	if ((z2.len >= _div2_) && (z1.len - z2.len >= _div2_)) {
+		zdivlarge(z1, z2, res, rem);
+		return;
+	}
+	h2 = (HALF) TOPHALF;
 	j = 0;
-	k = (long) z2.v[z2.len - 1];
-	while (! (k & i)) {
+	while (! (z2.v[z2.len - 1] & h2)) {
 		j ++;
-		i >>= 1;
+		h2 >>= 1;
 	}
 	ztmp1.v = alloc(z1.len + 1);
 	ztmp1.len = z1.len + 1;
@@ -436,8 +1001,6 @@ zdiv(z1, z2, res, rem)
 	quo.sign = z1.sign != z2.sign;
 	zclearval(quo);
 
-	ztmp3.v = zalloctemp(z2.len + 1);
-
 	/*
 	 * Normalize z1 and z2
 	 */
@@ -464,23 +1027,13 @@ zdiv(z1, z2, res, rem)
 				v2 * x > (pair.ivalue - x * h2) * BASE + ztmp1.v [y-2]) {
 					--x;
 			}
-			dmul(ztmp2, x, &ztmp3);
-#ifdef divblab
-			printf(" x: %ld\n", x);
-			printf("ztmp1: ");
-			printz(ztmp1);
-			printf("ztmp2: ");
-			printz(ztmp2);
-			printf("ztmp3: ");
-			printz(ztmp3);
-#endif
-			if (dsub(ztmp1, ztmp3, y, ztmp2.len)) {
+			pp = ztmp1.v + y - ztmp2.len;
+			borrow = zvsubmul1(pp, ztmp2.v, ztmp2.len, (HALF) x);
+			if (pp[ztmp2.len] < borrow) {
 				--x;
-				/*
-				printf("adding back\n");
-				*/
-				dadd(ztmp1, ztmp2, y, ztmp2.len);
+				borrow -= zvadd(pp, pp, ztmp2.v, ztmp2.len);
 			}
+			pp[ztmp2.len] -= borrow;
 		}
 		ztrim(&ztmp1);
 		*--q = (HALF)x;
@@ -494,6 +1047,201 @@ zdiv(z1, z2, res, rem)
 }
 
 
+/*
+ * Divide two large numbers by recursive division, as described by
+ * Burnikel and Ziegler, Fast Recursive Division, MPI-I-98-1-022.
+ * The numbers are normalized so that the divisor has its top bit set,
+ * and the dividend is divided a divisor's size of quotient words at a
+ * time from the top.  The quotient has the sign zdiv gives it and the
+ * remainder is not negative.  Either result can be skipped by passing NULL.
+ */
+static void
+zdivlarge(z1, z2, quo, rem)
+	ZVALUE z1, z2;		/* numbers to divide */
+	ZVALUE *quo;		/* returned quotient, or NULL */
+	ZVALUE *rem;		/* returned remainder, or NULL */
+{
+	ZVALUE a, b, q, qt, rt, ztmp;
+	HALF h2;
+	BOOL neg;
+	long j;
+	LEN k, n, s;
+
+	h2 = (HALF) TOPHALF;
+	j = 0;
+	while (! (z2.v[z2.len - 1] & h2)) {
+		j ++;
+		h2 >>= 1;
+	}
+	neg = (z1.sign != z2.sign);
+	z1.sign = 0;
+	z2.sign = 0;
+	zshift(z1, j, &a);
+	zshift(z2, j, &b);
+
+	/*
+	 * The dividend is less than the divisor times BASE^k.
+	 */
+	n = b.len;
+	k = a.len - n + 1;
+	q.v = alloc(k);
+	q.len = k;
+	q.sign = 0;
+	zclearval(q);
+	while (k > n) {
+		s = k - n;
+		zdivrec(zwords(a, s, a.len), b, n, &qt, &rt);
+		memcpy(q.v + s, qt.v, qt.len * sizeof(HALF));
+		zjoin(rt, zwords(a, 0, s), s, &ztmp);
+		zfree(qt);
+		zfree(rt);
+		zfree(a);
+		a = ztmp;
+		k = s;
+	}
+	zdivrec(a, b, k, &qt, &rt);
+	memcpy(q.v, qt.v, qt.len * sizeof(HALF));
+	zfree(qt);
+	zfree(a);
+	zfree(b);
+
+	ztrim(&q);
+	if (quo) {
+		q.sign = neg;
+		*quo = q;
+	} else
+		zfree(q);
+	if (rem) {
+		zshift(rt, -j, rem);
+		rem->sign = 0;
+	}
+	zfree(rt);
+}
+
+
+/*
+ * Divide a number by a normalized divisor of n words when the quotient is
+ * known to fit in k words, where k is at most n.  When k is less than n,
+ * the quotient is estimated by dividing the top words of both numbers and
+ * is then corrected, which takes at most two steps since the divisor is
+ * normalized.  When k equals n, the quotient is found a half at a time.
+ * Divisions by small divisors are done by zdiv.
+ */
+static void
+zdivrec(a, b, k, quo, rem)
+	ZVALUE a;		/* number to divide, less than b*BASE^k */
+	ZVALUE b;		/* normalized divisor */
+	LEN k;			/* size of quotient */
+	ZVALUE *quo;		/* returned quotient */
+	ZVALUE *rem;		/* returned remainder */
+{
+	ZVALUE a1, b1, q, q1, r, r1, ztmp;
+	LEN n, s, h;
+
+	n = b.len;
+	if (n < _div2_) {
+		zdiv(a, b, quo, rem);
+		return;
+	}
+	if (k < n) {
+		s = n - k;
+		a1 = zwords(a, s, a.len);
+		b1 = zwords(b, s, k);
+		if (zrel(zwords(a1, k, a1.len), b1) >= 0) {
+			/*
+			 * The estimate would not fit, so use BASE^k - 1.
+			 */
+			q.v = alloc(k);
+			q.len = k;
+			q.sign = 0;
+			memset(q.v, 0xff, k * sizeof(HALF));
+			zjoin(b1, _zero_, k, &ztmp);
+			zsub(a1, ztmp, &r);
+			zfree(ztmp);
+			zadd(r, b1, &r1);
+			zfree(r);
+		} else
+			zdivrec(a1, b1, k, &q, &r1);
+		zmul(q, zwords(b, 0, s), &ztmp);
+		zjoin(r1, zwords(a, 0, s), s, &r);
+		zfree(r1);
+		zsub(r, ztmp, &r1);
+		zfree(r);
+		zfree(ztmp);
+		while (zisneg(r1)) {
+			zsub(q, _one_, &ztmp);
+			zfree(q);
+			q = ztmp;
+			zadd(r1, b, &ztmp);
+			zfree(r1);
+			r1 = ztmp;
+		}
+		*quo = q;
+		*rem = r1;
+		return;
+	}
+	h = k / 2;
+	zdivrec(zwords(a, h, a.len), b, k - h, &q1, &r1);
+	zjoin(r1, zwords(a, 0, h), h, &ztmp);
+	zfree(r1);
+	zdivrec(ztmp, b, h, &q, rem);
+	zfree(ztmp);
+	zjoin(q1, q, h, quo);
+	zfree(q1);
+	zfree(q);
+}
+
+
+/*
+ * Return the words of a number from the given position for the given
+ * length, or up to its top, without copying them.  The result must not
+ * be freed.
+ */
+static ZVALUE
+zwords(z, pos, len)
+	ZVALUE z;		/* number to take words from */
+	LEN pos;		/* position of the lowest word */
+	LEN len;		/* number of words */
+{
+	ZVALUE res;
+
+	if (pos >= z.len)
+		return _zero_;
+	if (len > z.len - pos)
+		len = z.len - pos;
+	res.v = z.v + pos;
+	res.len = len;
+	res.sign = 0;
+	ztrim(&res);
+	return res;
+}
+
+
+/*
+ * Form hi * BASE^pos + lo, where lo is less than BASE^pos.
+ */
+static void
+zjoin(hi, lo, pos, res)
+	ZVALUE hi, lo;		/* high and low parts */
+	LEN pos;		/* position of the high part */
+	ZVALUE *res;		/* returned number */
+{
+	ZVALUE ans;
+
+	if (ziszero(hi)) {
+		zcopy(lo, res);
+		return;
+	}
+	ans.len = hi.len + pos;
+	ans.v = alloc(ans.len);
+	ans.sign = 0;
+	memcpy(ans.v, lo.v, lo.len * sizeof(HALF));
+	memset(ans.v + lo.len, 0, (pos - lo.len) * sizeof(HALF));
+	memcpy(ans.v + pos, hi.v, hi.len * sizeof(HALF));
+	*res = ans;
+}
+
+
 /*
  * Return the quotient and remainder of an integer divided by a small
  * number.  A nonzero remainder is only meaningful when both numbers
@@ -569,13 +1317,14 @@ void
 zquo(z1, z2, res)
 	ZVALUE z1, z2, *res;
 {
-	long i, j, k;
+	long j, k;
 	register HALF *q, *pp;
 	SIUNION pair;			/* pair of halfword values */
 	HALF h2, v2;
+	HALF borrow;			/* borrow from subtracting multiple */
 	long y;
 	FULL x;
-	ZVALUE ztmp1, ztmp2, ztmp3, quo;
+	ZVALUE ztmp1, ztmp2, quo;
 
 	if (ziszero(z2))
 		math_error("Division by zero");
@@ -587,12 +1336,15 @@ zquo(z1, z2, res)
 		zcopy(z1, res);
 		return;
 	}
-	i = BASE / 2;
+	if ((z2.len >= _div2_) && (z1.len - z2.len >= _div2_)) {
+		zdivlarge(z1, z2, res, (ZVALUE *) NULL);
+		return;
+	}
+	h2 = (HALF) TOPHALF;
 	j = 0;
-	k = (long) z2.v[z2.len - 1];
-	while (! (k & i)) {
+	while (! (z2.v[z2.len - 1] & h2)) {
 		j ++;
-		i >>= 1;
+		h2 >>= 1;
 	}
 	ztmp1.v = alloc(z1.len + 1);
 	ztmp1.len = z1.len + 1;
@@ -614,8 +1366,6 @@ zquo(z1, z2, res)
 	quo.sign = z1.sign != z2.sign;
 	zclearval(quo);
 
-	ztmp3.v = zalloctemp(z2.len + 1);
-
 	/*
 	 * Normalize z1 and z2
 	 */
@@ -642,11 +1392,13 @@ zquo(z1, z2, res)
 				v2 * x > (pair.ivalue - x * h2) * BASE + ztmp1.v [y-2]) {
 					--x;
 			}
-			dmul(ztmp2, x, &ztmp3);
-			if (dsub(ztmp1, ztmp3, y, ztmp2.len)) {
+			pp = ztmp1.v + y - ztmp2.len;
+			borrow = zvsubmul1(pp, ztmp2.v, ztmp2.len, (HALF) x);
+			if (pp[ztmp2.len] < borrow) {
 				--x;
-				dadd(ztmp1, ztmp2, y, ztmp2.len);
+				borrow -= zvadd(pp, pp, ztmp2.v, ztmp2.len);
 			}
+			pp[ztmp2.len] -= borrow;
 		}
 		ztrim(&ztmp1);
 		*--q = (HALF)x;
@@ -658,6 +1410,93 @@ zquo(z1, z2, res)
 }
 
 
+/*
+ * Return the quotient of two numbers when the second is known to divide
+ * the first exactly, as when dividing by a gcd.  The quotient is found
+ * from the low words upwards (Jebelean's exact division), so that no
+ * quotient digits need to be estimated and no remainder is built.
+ * The result is wrong if the division is not exact.
+ */
+void
+zdivexact(z1, z2, res)
+	ZVALUE z1, z2, *res;
+{
+	ZVALUE a, d, quo;
+	HALF *ap;
+	HALF inv, borrow, t;
+	LEN qlen, len, i, j;
+	long shift;
+
+	if (ziszero(z2))
+		math_error("Division by zero");
+	if (ziszero(z1)) {
+		*res = _zero_;
+		return;
+	}
+	if (zisunit(z2)) {
+		zcopy(z1, res);
+		res->sign = (z1.sign != z2.sign);
+		return;
+	}
+	qlen = z1.len - z2.len + 1;
+	if ((z2.len >= _div2_) && (qlen >= _div2_)) {
+		zquo(z1, z2, res);
+		return;
+	}
+	/*
+	 * Remove the powers of two from the divisor so that it is odd,
+	 * and so has an inverse modulo the base.  The same number of low
+	 * zero bits can be removed from the dividend.  The dividend is
+	 * copied since it is destroyed as the quotient digits are found.
+	 */
+	shift = zlowbit(z2);
+	if (shift) {
+		zshift(z1, -shift, &a);
+		zshift(z2, -shift, &d);
+	} else {
+		a.len = z1.len;
+		a.v = alloc(a.len);
+		zcopyval(z1, a);
+		d = z2;
+	}
+	qlen = a.len - d.len + 1;
+	quo.len = qlen;
+	quo.v = alloc(qlen);
+	quo.sign = (z1.sign != z2.sign);
+	/*
+	 * Find the inverse of the low word of the divisor by Newton's
+	 * method.  An odd number is its own inverse modulo 8, and each
+	 * step doubles the number of correct bits.
+	 */
+	inv = d.v[0];
+	for (i = 3; i < BASEB; i *= 2)
+		inv = (HALF) (inv * (2 - ((FULL) d.v[0]) * inv));
+	/*
+	 * Each quotient digit is the one which clears the lowest remaining
+	 * word of the dividend.  Only the words below the top of the
+	 * quotient need to be kept up to date.
+	 */
+	ap = a.v;
+	for (i = 0; i < qlen; i++) {
+		quo.v[i] = (HALF) (((FULL) ap[i]) * inv);
+		len = qlen - i;
+		if (len > d.len)
+			len = d.len;
+		borrow = zvsubmul1(ap + i, d.v, len, quo.v[i]);
+		for (j = i + len; borrow && (j < qlen); j++) {
+			t = ap[j];
+			ap[j] = t - borrow;
+			borrow = (t < borrow);
+		}
+	}
+	zfree(a);
+	if (shift)
+		zfree(d);
+	ztrim(&quo);
+	*res = quo;
+}
+
+
 /*
  * Compute the remainder after dividing one number by another.
  * This is only defined for positive z2 values.
@@ -671,6 +1510,7 @@ zmod(z1, z2, rem)
 	register HALF *pp;
 	SIUNION pair;			/* pair of halfword values */
 	HALF h2, v2;
+	HALF borrow;			/* borrow from subtracting multiple */
 	long y;
 	FULL x;
 	ZVALUE ztmp1, ztmp2, ztmp3;
@@ -772,14 +1612,18 @@ zmod(z1, z2, rem)
 	}
 
 	/*
-	 * Must actually do the divide.
+	 * Must actually do the divide, recursively if the numbers are large.
 	 */
-	i = BASE / 2;
+	if ((z2.len >= _div2_) && (z1.len - z2.len >= _div2_)) {
+		zdivlarge(z1, z2, (ZVALUE *) NULL, &ztmp1);
+		ztmp2.len = 0;
+		goto gotanswer;
+	}
+	h2 = (HALF) TOPHALF;
 	j = 0;
-	k = (long) z2.v[z2.len - 1];
-	while (! (k & i)) {
+	while (! (z2.v[z2.len - 1] & h2)) {
 		j ++;
-		i >>= 1;
+		h2 >>= 1;
 	}
 	ztmp1.v = alloc(z1.len + 1);
 	ztmp1.len = z1.len + 1;
@@ -793,8 +1637,6 @@ zmod(z1, z2, rem)
 	if (zrel(ztmp1, ztmp2) < 0)
 		goto gotanswer;
 
-	ztmp3.v = zalloctemp(z2.len + 1);
-
 	/*
 	 * Normalize z1 and z2
 	 */
@@ -820,9 +1662,11 @@ zmod(z1, z2, rem)
 				v2 * x > (pair.ivalue - x * h2) * BASE + ztmp1.v [y-2]) {
 					--x;
 			}
-			dmul(ztmp2, x, &ztmp3);
-			if (dsub(ztmp1, ztmp3, y, ztmp2.len))
-				dadd(ztmp1, ztmp2, y, ztmp2.len);
+			pp = ztmp1.v + y - ztmp2.len;
+			borrow = zvsubmul1(pp, ztmp2.v, ztmp2.len, (HALF) x);
+			if (pp[ztmp2.len] < borrow)
+				borrow -= zvadd(pp, pp, ztmp2.v, ztmp2.len);
+			pp[ztmp2.len] -= borrow;
 		}
 		ztrim(&ztmp1);
 	}
@@ -1263,9 +2107,11 @@ zrel(z1, z2)
 		if (*h1-- != *h2--)
 			break;
 	}
-	if ((len1 = *++h1) > (len2 = *++h2))
+	h1++;
+	h2++;
+	if (*h1 > *h2)
 		return sign;
-	if (len1 < len2)
+	if (*h1 < *h2)
 		return -sign;
 	return 0;
 }
@@ -1295,132 +2141,6 @@ zcmp(z1, z2)
 }
 
 
-/*
- * Internal utility subroutines
- */
-static void
-dadd(z1, z2, y, n)
-	ZVALUE z1, z2;
-	long y, n;
-{
-	HALF *s1, *s2;
-	short carry;
-	long sum;
-
-	s1 = z1.v + y - n;
-	s2 = z2.v;
-	carry = 0;
-	while (n--) {
-		sum = (long)*s1 + (long)*s2 + carry;
-		carry = 0;
-		if (sum >= BASE) {
-			sum -= BASE;
-			carry = 1;
-		}
-		*s1 = (HALF)sum;
-		++s1;
-		++s2;
-	}
-	sum = (long)*s1 + carry;
-	*s1 = (HALF)sum;
-}
-
-
-/*
- * Do subtract for divide, returning TRUE if subtraction went negative.
- */
-static BOOL
-dsub(z1, z2, y, n)
-	ZVALUE z1, z2;
-	long y, n;
-{
-	HALF *s1, *s2, *s3;
-	FULL i1;
-	BOOL neg;
-
-	neg = FALSE;
-	s1 = z1.v + y - n;
-	s2 = z2.v;
-	if (++n > z2.len)
-		n = z2.len;
-	while (n--) {
-		i1 = (FULL) *s1;
-		if (i1 < (FULL) *s2) {
-			s3 = s1 + 1;
-			while (s3 < z1.v + z1.len && !(*s3)) {
-				*s3 = BASE1;
-				++s3;
-			}
-			if (s3 >= z1.v + z1.len)
-				neg = TRUE;
-			else
-				--(*s3);
-			i1 += BASE;
-		}
-		*s1 = i1 - (FULL) *s2;
-		++s1;
-		++s2;
-	}
-	return neg;
-}
-
-
-/*
- * Multiply a number by a single 'digit'.
- * This is meant to be used only by the divide routine, and so the
- * destination area must already be allocated and be large enough.
- */
-static void
-dmul(z, mul, dest)
-	ZVALUE z;
-	FULL mul;
-	ZVALUE *dest;
-{
-	register HALF *zp, *dp;
-	SIUNION sival;
-	FULL carry;
-	long len;
-
-	dp = dest->v;
-	dest->sign = 0;
-	if (mul == 0) {
-		dest->len = 1;
-		*dp = 0;
-		return;
-	}
-	len = z.len;
-	zp = z.v + len - 1;
-	while ((*zp == 0) && (len > 1)) {
-		len--;
-		zp--;
-	}
-	dest->len = len;
-	zp = z.v;
-	carry = 0;
-	while (len >= 4) {
-		len -= 4;
-		sival.ivalue = (mul * ((FULL) *zp++)) + carry;
-		*dp++ = sival.silow;
-		sival.ivalue = (mul * ((FULL) *zp++)) + ((FULL) sival.sihigh);
-		*dp++ = sival.silow;
-		sival.ivalue = (mul * ((FULL) *zp++)) + ((FULL) sival.sihigh);
-		*dp++ = sival.silow;
-		sival.ivalue = (mul * ((FULL) *zp++)) + ((FULL) sival.sihigh);
-		*dp++ = sival.silow;
-		carry = sival.sihigh;
-	}
-	while (--len >= 0) {
-		sival.ivalue = (mul * ((FULL) *zp++)) + carry;
-		*dp++ = sival.silow;
-		carry = sival.sihigh;
-	}
-	if (carry) {
-		*dp = (HALF)carry;
-		dest->len++;
-	}
-}
-
-
 /*
  * Utility to calculate the gcd of two small integers.
  */
@@ -1556,13 +2276,18 @@ initmasks()
 	 */
 	bmask = alloc((long)((8*BASEB)+1));
 	for (i=0; i < (8*BASEB)+1; ++i) {
-		bmask[i] = 1 << (i%BASEB);
+		bmask[i] = ((HALF) 1) << (i%BASEB);
 	}
 
 	/*
 	 * setup the bitmask array to allow -4*BASEB thru 4*BASEB indexing
 	 */
 	bitmask = &bmask[4*BASEB];
+
+	/*
+	 * choose the inner loops for this processor
+	 */
+	zvecinit();
 	return;
 }
 
@@ -38,22 +38,7 @@
 #include "calcendian.h"
 #endif
 
-
-#ifndef ALLOCTEST
-# if defined(CALC_MALLOC)
-#  define freeh(p) (((void *)p == (void *)_zeroval_) ||			\
-		    ((void *)p == (void *)_oneval_) || 			\
-		    ((void *)p == (void *)_twoval_) || 			\
-		    ((void *)p == (void *)_tenval_) || 			\
-		    ckfree((void *)p))
-# else
-#  define freeh(p) { if (((void *)p != (void *)_zeroval_) &&		\
-			 ((void *)p != (void *)_oneval_) &&		\
-			 ((void *)p != (void *)_twoval_) &&		\
-			 ((void *)p != (void *)_tenval_)		\
-			) ckfree((void *)p); }
-# endif
-#endif
+#include "tune.h"
 
 
 typedef	int FLAG;			/* small value (e.g. comparison) */
@@ -74,7 +59,27 @@ typedef unsigned long HASH;		/* hash value */
  *	 LEN storage size must be <= FULL storage size
  */
 
-#if LONG_BITS == 64			/* for 64-bit machines */
+#if (LONG_BITS == 64) && defined(HALF_BITS) && (HALF_BITS == 64)
+#if !defined(__SIZEOF_INT128__)
+#error "HALF_BITS 64 needs a compiler with unsigned __int128"
+#endif
+					/* for 64-bit words on 64-bit machines */
+typedef unsigned long HALF;		/* unit of number storage */
+typedef long SHALF;			/* signed HALF */
+typedef unsigned __int128 FULL;		/* double unit of number storage */
+typedef long LEN;			/* unit of length storage */
+
+#define BASE	(((FULL) 1) << 64)	/* base for calculations (2^64) */
+#define BASE1	((FULL) (BASE - 1))	/* one less than base */
+#define BASEB	64			/* number of bits in base */
+#define	BASEDIG	20			/* number of digits in base */
+#define	MAXHALF	((FULL) 0x7fffffffffffffff)	/* largest positive half value */
+#define	MAXFULL	(((FULL) -1) >> 1)	/* largest positive full value */
+#define	TOPHALF	((FULL) 0x8000000000000000)	/* highest bit in half value */
+#define	TOPFULL	(((FULL) 1) << 127)	/* highest bit in full value */
+#define MAXLEN	((LEN)	0x7fffffffffffffff)	/* longest value allowed */
+
+#elif LONG_BITS == 64			/* for 64-bit machines */
 typedef unsigned int HALF;		/* unit of number storage */
 typedef int SHALF;			/* signed HALF */
 typedef unsigned long FULL;		/* double unit of number storage */
@@ -109,11 +114,49 @@ typedef long LEN;			/* unit of length storage */
 #define FULLFMT "l"                     /* printf length specifier for FULL */
 #endif
 
+#define	MAXLONGVAL ((long) (~((unsigned long) 0) >> 1))	/* largest long value */
+#define	TOPLONGVAL (~((unsigned long) MAXLONGVAL))	/* highest bit in long value */
+
 #define	MAXREDC	5			/* number of entries in REDC cache */
+
+/*
+ * Sizes in words where the faster algorithms take over.  The values
+ * measured on the build host by the tune program are in tune.h, and
+ * all of them can be changed at run time through the _tunes_ table.
+ */
+#if !defined(SQ_ALG2)
 #define	SQ_ALG2	20			/* size for alternative squaring */
+#endif
+#if !defined(MUL_ALG2)
 #define	MUL_ALG2 20			/* size for alternative multiply */
+#endif
+#if !defined(SQ_ALG3)
+#define	SQ_ALG3	400			/* size for 3-way Toom-Cook squaring */
+#endif
+#if !defined(MUL_ALG3)
+#define	MUL_ALG3 400			/* size for 3-way Toom-Cook multiply */
+#endif
+#if !defined(SQ_ALG4)
+#define	SQ_ALG4	800			/* size for 4-way Toom-Cook squaring */
+#endif
+#if !defined(MUL_ALG4)
+#define	MUL_ALG4 800			/* size for 4-way Toom-Cook multiply */
+#endif
+#if !defined(SQ_NTT)
+#define	SQ_NTT	5000			/* size for transform squaring */
+#endif
+#if !defined(MUL_NTT)
+#define	MUL_NTT	6000			/* size for transform multiply */
+#endif
+#if !defined(POW_ALG2)
 #define	POW_ALG2 40			/* size for using REDC for powers */
+#endif
+#if !defined(REDC_ALG2)
 #define	REDC_ALG2 50			/* size for using alternative REDC */
+#endif
+#if !defined(DIV_ALG2)
+#define	DIV_ALG2 50			/* size for recursive division */
+#endif
 
 
 typedef union {
@@ -147,6 +190,64 @@ typedef union {
 #endif
 
 
+/*
+ * Links of a doubly linked list with a list head of its own.
+ */
+typedef struct zlink {
+	struct zlink *next;	/* next on the list, or NULL if on none */
+	struct zlink *prev;	/* previous on the list */
+} ZLINK;
+
+#define	zlinkin(head, lp)	((lp)->next = (head)->next, (lp)->prev = (head), \
+				 (head)->next->prev = (lp), (head)->next = (lp))
+#define	zunlink(lp)		((lp)->prev->next = (lp)->next, \
+				 (lp)->next->prev = (lp)->prev, (lp)->next = NULL)
+
+
+/*
+ * Each array of words made by alloc is preceded by a header holding the
+ * number of words it has room for, which is zero for the constants.
+ * The links place a free array in a pool, or an array made while an
+ * expression is evaluated in the scope of the evaluation.
+ */
+typedef struct zhead {
+	ZLINK	link;		/* place in a pool or a scope */
+	LEN	size;		/* number of words of room */
+} ZHEAD;
+
+typedef struct {
+	ZHEAD	head;		/* header with a size of zero */
+	HALF	v[1];		/* value of the constant */
+} ZCONST;
+
+
+/*
+ * The arrays and numbers made while an expression is evaluated and still
+ * held by it, so that they can all be freed at once if the evaluation
+ * is abandoned by an error.  Values which outlive the evaluation are
+ * taken off the lists with zkeep or qkeep.
+ */
+typedef struct zscope {
+	ZLINK	arrays;		/* arrays held in the scope */
+	ZLINK	numbers;	/* numbers held in the scope */
+	struct zscope *outer;	/* scope of the enclosing evaluation */
+} ZSCOPE;
+
+
+/*
+ * Use of the arrays of one size class by a thread, as counted by alloc
+ * and freeh for the statistics.
+ */
+typedef struct {
+	LEN	size;		/* words of room in each array, or 0 for
+				 * arrays too large for a pool */
+	long	allocs;		/* arrays allocated */
+	long	frees;		/* arrays freed */
+	long	words;		/* words of room in the arrays in use */
+	long	pooled;		/* free arrays kept for reuse */
+} ZSTAT;
+
+
 typedef struct {
 	HALF	*v;		/* pointer to array of values */
 	LEN	len;		/* number of values in array */
@@ -154,6 +255,16 @@ typedef struct {
 } ZVALUE;
 
 
+/*
+ * An algorithm size which can be changed at run time.
+ */
+typedef struct {
+	CONST char *name;	/* name of the size, as defined above */
+	LEN	*size;		/* current size */
+	LEN	least;		/* smallest size which the algorithm handles */
+} TUNE;
+
+
 
 /*
  * Function prototypes for integer math routines.
@@ -165,9 +276,16 @@ typedef struct {
 #endif
 
 extern HALF * alloc MATH_PROTO((LEN len));
-#ifdef	ALLOCTEST
-extern void freeh MATH_PROTO((HALF *));
-#endif
+extern HALF * realloch MATH_PROTO((HALF *h, LEN used, LEN len));
+extern void freeh MATH_PROTO((HALF *h));
+extern void keeph MATH_PROTO((HALF *h));
+extern void zbeginscope MATH_PROTO((ZSCOPE *sp));
+extern void zendscope MATH_PROTO((ZSCOPE *sp, BOOL release));
+extern ZSCOPE *zsetscope MATH_PROTO((ZSCOPE *sp));
+extern ZSCOPE *zgetscope MATH_PROTO((void));
+extern BOOL zallocstat MATH_PROTO((int class, ZSTAT *sp));
+extern LEN ztempsize MATH_PROTO((void));
+extern long ztenpowsize MATH_PROTO((void));
 
 
 /*
@@ -192,9 +310,17 @@ extern long zdivi MATH_PROTO((ZVALUE z, long n, ZVALUE *res));
 extern long zmodi MATH_PROTO((ZVALUE z, long n));
 extern void zadd MATH_PROTO((ZVALUE z1, ZVALUE z2, ZVALUE *res));
 extern void zsub MATH_PROTO((ZVALUE z1, ZVALUE z2, ZVALUE *res));
+extern void zaddto MATH_PROTO((ZVALUE *res, ZVALUE z));
+extern void zsubfrom MATH_PROTO((ZVALUE *res, ZVALUE z));
+extern void zmuliby MATH_PROTO((ZVALUE *res, long n));
+extern void zaddmul MATH_PROTO((ZVALUE *res, ZVALUE z, HALF n));
+extern void zshiftby MATH_PROTO((ZVALUE *res, long n));
+extern long zdiviby MATH_PROTO((ZVALUE *res, long n));
 extern void zmul MATH_PROTO((ZVALUE z1, ZVALUE z2, ZVALUE *res));
+extern void zmulhigh MATH_PROTO((ZVALUE z1, ZVALUE z2, LEN skip, ZVALUE *res));
 extern void zdiv MATH_PROTO((ZVALUE z1, ZVALUE z2, ZVALUE *res, ZVALUE *rem));
 extern void zquo MATH_PROTO((ZVALUE z1, ZVALUE z2, ZVALUE *res));
+extern void zdivexact MATH_PROTO((ZVALUE z1, ZVALUE z2, ZVALUE *res));
 extern void zmod MATH_PROTO((ZVALUE z1, ZVALUE z2, ZVALUE *rem));
 extern void zor MATH_PROTO((ZVALUE z1, ZVALUE z2, ZVALUE *res));
 extern void zand MATH_PROTO((ZVALUE z1, ZVALUE z2, ZVALUE *res));
@@ -245,6 +371,16 @@ extern void zshiftr MATH_PROTO((ZVALUE z, long n));
 extern void zshiftl MATH_PROTO((ZVALUE z, long n));
 extern HALF *zalloctemp MATH_PROTO((LEN len));
 extern void initmasks MATH_PROTO((void));
+extern void zvecinit MATH_PROTO((void));
+
+/*
+ * Inner loops over arrays of words, chosen for the processor by zvecinit.
+ */
+extern HALF (*zvadd) MATH_PROTO((HALF *res, HALF *v1, HALF *v2, LEN len));
+extern HALF (*zvsub) MATH_PROTO((HALF *res, HALF *v1, HALF *v2, LEN len));
+extern HALF (*zvmul1) MATH_PROTO((HALF *res, HALF *v, LEN len, HALF mul));
+extern HALF (*zvaddmul1) MATH_PROTO((HALF *res, HALF *v, LEN len, HALF mul));
+extern HALF (*zvsubmul1) MATH_PROTO((HALF *res, HALF *v, LEN len, HALF mul));
 
 
 /*
@@ -284,17 +420,30 @@ extern void zredcpower MATH_PROTO((REDC *rp, ZVALUE z1, ZVALUE z2, ZVALUE *res))
 #define zistwo(z)	((*(z).v == 2) && ((z).len == 1) && !(z).sign)
 #define zisleone(z)	((*(z).v <= 1) && ((z).len == 1))
 #define zistiny(z)	((z).len == 1)
+#if BASEB == 64
+/*
+ * A long is only one word, so any number of two words is big, and
+ * z2tol is never reached for a number which fits in a long.
+ */
+#define zissmall(z)	(((z).len == 1) && (((SHALF)(z).v[0]) >= 0))
+#define zisbig(z)	(((z).len > 1) || (((SHALF)(z).v[0]) < 0))
+
+#define z1tol(z)	((long)((z).v[0]))
+#define z2tol(z)	MAXLONGVAL
+#else
 #define zissmall(z)	(((z).len < 2) || (((z).len == 2) && (((SHALF)(z).v[1]) >= 0)))
 #define zisbig(z)	(((z).len > 2) || (((z).len == 2) && (((SHALF)(z).v[1]) < 0)))
 
 #define z1tol(z)	((long)((z).v[0]))
 #define z2tol(z)	(((long)((z).v[0])) + \
 				(((long)((z).v[1] & MAXHALF)) << BASEB))
+#endif
 #define	zclearval(z)	memset((z).v, 0, (z).len * sizeof(HALF))
 #define	zcopyval(z1,z2)	memcpy((z2).v, (z1).v, (z1).len * sizeof(HALF))
 #define zquicktrim(z)	{if (((z).len > 1) && ((z).v[(z).len-1] == 0)) \
 				(z).len--;}
 #define	zfree(z)	freeh((z).v)
+#define	zkeep(z)	keeph((z).v)
 
 
 /*
@@ -344,9 +493,19 @@ extern void math_error MATH_PROTO((char *, ...));
 /*
  * constants used often by the arithmetic routines
  */
-extern HALF _zeroval_[], _oneval_[], _twoval_[], _tenval_[];
+extern ZCONST _zconst_[];
+#define	_zeroval_	(_zconst_[0].v)
+#define	_oneval_	(_zconst_[1].v)
+#define	_twoval_	(_zconst_[2].v)
+#define	_tenval_	(_zconst_[3].v)
 extern ZVALUE _zero_, _one_, _ten_;
 
+/*
+ * algorithm sizes which can be changed, ending with a NULL name
+ */
+extern TUNE _tunes_[];
+extern LEN _pow2_, _redc2_, _div2_;
+
 /* Note the shared use of a global _tenpowers_ array by all threads creates
    the possibility of overlapping initialization of it by mulitple threads.
    As the initialization is constructed, this does not appear to be able to
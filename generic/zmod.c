@@ -20,8 +20,8 @@
 #define	POWNUMS	(1<<POWBITS)	/* number of powers needed in table */
 
 
-static CONST LEN _pow2_ = POW_ALG2;	/* modulo size to use REDC for powers */
-static CONST LEN _redc2_ = REDC_ALG2;	/* modulo size to use second REDC algorithm */
+LEN _pow2_ = POW_ALG2;		/* modulo size to use REDC for powers */
+LEN _redc2_ = REDC_ALG2;	/* modulo size to use second REDC algorithm */
 
 /*
  * Compute the result of raising one number to a power modulo another number.
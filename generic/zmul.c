@@ -9,13 +9,63 @@
  * instead of O(N^2).  The usual multiplication and (almost usual) squaring
  * algorithms are used for small numbers.  On a 386 with its compiler, the
  * two algorithms are equal in speed at about 100 decimal digits.
+ * Larger numbers are split into three or four pieces instead of two and
+ * handled by the Toom-Cook method, which is of speed O(N^1.465) for three
+ * pieces and O(N^1.404) for four.  Huge numbers are multiplied by number
+ * theoretic transforms in time O(N log N).
  */
 
 #include "mpexpr.h"
 
 
-static CONST LEN _mul2_ = MUL_ALG2;	/* size of number to use multiply algorithm 2 */
-static CONST LEN _sq2_ = SQ_ALG2;	/* size of number to use square algorithm 2 */
+#define	SHORTGUARD	2	/* extra low columns kept by zmulhigh */
+
+static LEN _mul2_ = MUL_ALG2;	/* size of number to use multiply algorithm 2 */
+static LEN _sq2_ = SQ_ALG2;	/* size of number to use square algorithm 2 */
+static LEN _mul3_ = MUL_ALG3;	/* size of number to use multiply algorithm 3 */
+static LEN _sq3_ = SQ_ALG3;	/* size of number to use square algorithm 3 */
+static LEN _mul4_ = MUL_ALG4;	/* size of number to use multiply algorithm 4 */
+static LEN _sq4_ = SQ_ALG4;	/* size of number to use square algorithm 4 */
+
+#if BASEB == 32
+static LEN _mulntt_ = MUL_NTT;	/* size of number to use transform multiply */
+static LEN _sqntt_ = SQ_NTT;	/* size of number to use transform square */
+#define	NTT_MAXLEN	((LEN) 1 << 25)	/* largest transform length */
+
+/*
+ * Primes for the number theoretic transforms, with a primitive root of each.
+ * Each prime minus one has a large power of two as a factor, and the first
+ * prime is the largest one.
+ */
+static CONST struct {
+	HALF prime;
+	HALF root;
+} nttprimes[3] = {
+	{2113929217, 5},	/* 63 * 2^25 + 1 */
+	{2013265921, 31},	/* 15 * 2^27 + 1 */
+	{1811939329, 13}	/* 27 * 2^26 + 1 */
+};
+#endif
+
+/*
+ * The algorithm sizes which can be changed at run time.
+ */
+TUNE _tunes_[] = {
+	{"MUL_ALG2", &_mul2_, 2},
+	{"SQ_ALG2", &_sq2_, 2},
+	{"MUL_ALG3", &_mul3_, 3},
+	{"SQ_ALG3", &_sq3_, 3},
+	{"MUL_ALG4", &_mul4_, 4},
+	{"SQ_ALG4", &_sq4_, 4},
+#if BASEB == 32
+	{"MUL_NTT", &_mulntt_, 1},
+	{"SQ_NTT", &_sqntt_, 1},
+#endif
+	{"POW_ALG2", &_pow2_, 1},
+	{"REDC_ALG2", &_redc2_, 1},
+	{"DIV_ALG2", &_div2_, 2},
+	{NULL, NULL, 0}
+};
 
 
 static Tcl_ThreadDataKey bufKey = NULL;
@@ -27,6 +77,38 @@ typedef struct {
 
 static LEN domul MATH_PROTO((HALF *v1, LEN size1, HALF *v2, LEN size2, HALF *ans));
 static LEN dosquare MATH_PROTO((HALF *vp, LEN size, HALF *ans));
+static LEN dounbal MATH_PROTO((HALF *v1, LEN size1, HALF *v2, LEN size2,
+	HALF *ans));
+static LEN dotoom MATH_PROTO((HALF *v1, LEN size1, HALF *v2, LEN size2,
+	HALF *ans, int ways));
+static void tcsplit MATH_PROTO((HALF *v, LEN size, LEN k, int ways,
+	ZVALUE *pieces));
+static void tceval MATH_PROTO((ZVALUE *pieces, int ways, int point,
+	ZVALUE *res));
+static void tcmul MATH_PROTO((ZVALUE z1, ZVALUE z2, ZVALUE *res,
+	BOOL square));
+static void tcadd MATH_PROTO((ZVALUE z1, ZVALUE z2, ZVALUE *res));
+static void tcsub MATH_PROTO((ZVALUE z1, ZVALUE z2, ZVALUE *res));
+static void tcsubmul MATH_PROTO((ZVALUE *z, ZVALUE z1, HALF mul,
+	HALF *scratch));
+static void tcmulsmall MATH_PROTO((ZVALUE *z, HALF mul));
+static void tcdivsmall MATH_PROTO((ZVALUE *z, HALF div));
+static void tcaddat MATH_PROTO((HALF *ans, ZVALUE z, LEN pos));
+#if BASEB == 32
+static LEN dontt MATH_PROTO((HALF *v1, LEN size1, HALF *v2, LEN size2,
+	HALF *ans));
+static void nttload MATH_PROTO((HALF *x, LEN n, HALF *v, LEN size, HALF p));
+static void nttforward MATH_PROTO((HALF *x, LEN n, HALF *roots, HALF p,
+	HALF pinv));
+static void nttbackward MATH_PROTO((HALF *x, LEN n, HALF *roots, HALF p,
+	HALF pinv));
+static void nttroots MATH_PROTO((HALF p, HALF pinv, HALF root, LEN n,
+	HALF *roots, HALF *invroots));
+static HALF nttmul MATH_PROTO((HALF a, HALF b, HALF p, HALF pinv));
+static HALF nttmontinv MATH_PROTO((HALF p));
+static HALF nttmont MATH_PROTO((HALF a, HALF p));
+static HALF nttpower MATH_PROTO((HALF a, HALF power, HALF p));
+#endif
 
 
 /*
@@ -41,6 +123,7 @@ zmul(z1, z2, res)
 	ZVALUE *res;		/* result of multiplication */
 {
 	LEN len;		/* size of array */
+	LEN minlen;		/* size of smaller number */
 
 	if (ziszero(z1) || ziszero(z2)) {
 		*res = _zero_;
@@ -66,11 +149,18 @@ zmul(z1, z2, res)
 	 * the previous level.  The sum of the infinite series is 2.
 	 * Add some extra words because of rounding when dividing by 2
 	 * and also because of the extra word that each multiply needs.
+	 * The Toom-Cook levels keep all of their point values around at
+	 * once, which needs under 8 times the size of the smaller number.
 	 */
 	len = z1.len;
-	if (len < z2.len)
+	minlen = z2.len;
+	if (len < minlen) {
 		len = z2.len;
+		minlen = z1.len;
+	}
 	len = 2 * len + 64;
+	if ((minlen >= _mul3_) || (minlen >= _mul4_))
+		len += 8 * minlen + 2048;
 	(void) zalloctemp(len);
 
 	res->sign = (z1.sign != z2.sign);
@@ -79,6 +169,68 @@ zmul(z1, z2, res)
 }
 
 
+/*
+ * Multiply two numbers and drop the given number of low words of the
+ * product, computing only the words which are needed.  The partial
+ * products of the lowest columns are left out, apart from SHORTGUARD
+ * columns which catch most of their carries.  The result is therefore
+ * either the exact product shifted down, or one less than that.  Once
+ * the numbers are large enough for the recursive algorithms, the full
+ * product is cheaper and is used instead, giving the exact result.
+ */
+void
+zmulhigh(z1, z2, skip, res)
+	ZVALUE z1, z2;		/* numbers to multiply */
+	LEN skip;		/* number of low words to drop */
+	ZVALUE *res;		/* result of multiplication */
+{
+	ZVALUE ans;
+	HALF *hd;
+	LEN base;		/* first column computed */
+	LEN i, j;
+
+	if (z1.len < z2.len) {
+		ans = z1;
+		z1 = z2;
+		z2 = ans;
+	}
+	if ((skip <= SHORTGUARD) || (z2.len >= _mul2_) ||
+		ziszero(z1) || ziszero(z2)) {
+		zmul(z1, z2, &ans);
+		zshift(ans, -skip * BASEB, res);
+		zfree(ans);
+		return;
+	}
+	if (skip >= z1.len + z2.len) {
+		*res = _zero_;
+		return;
+	}
+	base = skip - SHORTGUARD;
+	ans.len = z1.len + z2.len - base;
+	ans.v = alloc(ans.len);
+	memset(ans.v, 0, ans.len * sizeof(HALF));
+	for (j = 0; j < z2.len; j++) {
+		i = base - j;
+		if (i < 0)
+			i = 0;
+		if (i >= z1.len)
+			continue;
+		hd = ans.v + i + j - base;
+		hd[z1.len - i] = zvaddmul1(hd, z1.v + i, z1.len - i, z2.v[j]);
+	}
+	res->len = ans.len - SHORTGUARD;
+	res->v = alloc(res->len);
+	res->sign = (z1.sign != z2.sign);
+	memcpy(res->v, ans.v + SHORTGUARD, res->len * sizeof(HALF));
+	zfree(ans);
+	ztrim(res);
+	if (ziszero(*res)) {
+		zfree(*res);
+		*res = _zero_;
+	}
+}
+
+
 /*
  * Recursive routine to multiply two numbers by splitting them up into
  * two numbers of half the size, and using the results of multiplying the
@@ -169,85 +321,22 @@ domul(v1, size1, v2, size2, ans)
 	 */
 	if (size2 < _mul2_) {
 		/*
-		 * First clear the top part of the result, and then multiply
-		 * by the lowest digit to get the first partial sum.  Later
-		 * products will then add into this result.
+		 * Multiply by the lowest digit to get the first partial sum,
+		 * and then multiply by the remaining digits of the second
+		 * number, adding each product into the result.  Each product
+		 * ends one word further on, where its carry is stored.
 		 */
-		hd = &ans[size1];
-		len = size2;
-		while (len--)
-			*hd++ = 0;
-
-		digit = *v2++;
-		h1 = v1;
+		ans[size1] = zvmul1(ans, v1, size1, *v2++);
 		hd = ans;
-		carry = 0;
-		len = size1;
-		while (len >= 4) {	/* expand the loop some */
-			len -= 4;
-			sival.ivalue = ((FULL) *h1++) * digit + carry;
-			*hd++ = sival.silow;
-			carry = sival.sihigh;
-			sival.ivalue = ((FULL) *h1++) * digit + carry;
-			*hd++ = sival.silow;
-			carry = sival.sihigh;
-			sival.ivalue = ((FULL) *h1++) * digit + carry;
-			*hd++ = sival.silow;
-			carry = sival.sihigh;
-			sival.ivalue = ((FULL) *h1++) * digit + carry;
-			*hd++ = sival.silow;
-			carry = sival.sihigh;
-		}
-		while (len--) {
-			sival.ivalue = ((FULL) *h1++) * digit + carry;
-			*hd++ = sival.silow;
-			carry = sival.sihigh;
-		}
-		*hd = (HALF)carry;
-
-		/*
-		 * Now multiply by the remaining digits of the second number,
-		 * adding each product into the final result.
-		 */
-		h2 = ans;
-		while (--size2 > 0) {
+		len = size2;
+		while (--len > 0) {
+			hd++;
 			digit = *v2++;
-			h1 = v1;
-			hd = ++h2;
-			if (digit == 0)
+			if (digit == 0) {
+				hd[size1] = 0;
 				continue;
-			carry = 0;
-			len = size1;
-			while (len >= 4) {	/* expand the loop some */
-				len -= 4;
-				sival.ivalue = ((FULL) *h1++) * digit
-					+ ((FULL) *hd) + carry;
-				*hd++ = sival.silow;
-				carry = sival.sihigh;
-				sival.ivalue = ((FULL) *h1++) * digit
-					+ ((FULL) *hd) + carry;
-				*hd++ = sival.silow;
-				carry = sival.sihigh;
-				sival.ivalue = ((FULL) *h1++) * digit
-					+ ((FULL) *hd) + carry;
-				*hd++ = sival.silow;
-				carry = sival.sihigh;
-				sival.ivalue = ((FULL) *h1++) * digit
-					+ ((FULL) *hd) + carry;
-				*hd++ = sival.silow;
-				carry = sival.sihigh;
-			}
-			while (len--) {
-				sival.ivalue = ((FULL) *h1++) * digit
-					+ ((FULL) *hd) + carry;
-				*hd++ = sival.silow;
-				carry = sival.sihigh;
-			}
-			while (carry) {
-				sival.ivalue = ((FULL) *hd) + carry;
-				*hd++ = sival.silow;
-				carry = sival.sihigh;
 			}
+			hd[size1] = zvaddmul1(hd, v1, size1, (HALF) digit);
 		}
 
 		/*
@@ -262,6 +351,30 @@ domul(v1, size1, v2, size2, ans)
 		return len;
 	}
 
+	/*
+	 * If both numbers are huge, then multiply them by transforms.
+	 * If both numbers are large and of about the same size, then
+	 * split them into three or four pieces rather than two.  When
+	 * the smaller number would not reach the top piece, splitting
+	 * in half works better since that case needs only two products.
+	 */
+#if BASEB == 32
+	if ((size2 >= _mulntt_) && (size1 + size2 <= NTT_MAXLEN))
+		return dontt(v1, size1, v2, size2, ans);
+#endif
+
+	/*
+	 * If the first number is at least twice as long as the second,
+	 * then multiply the second number by pieces of the first number
+	 * of its own size, so that each product is a balanced one.
+	 */
+	if (size1 >= 2 * size2)
+		return dounbal(v1, size1, v2, size2, ans);
+	if ((size2 >= _mul4_) && (size2 > 3 * ((size1 + 3) / 4)))
+		return dotoom(v1, size1, v2, size2, ans, 4);
+	if ((size2 >= _mul3_) && (size2 > 2 * ((size1 + 2) / 3)))
+		return dotoom(v1, size1, v2, size2, ans, 3);
+
 	/*
 	 * Need to multiply by a large number.
 	 * Allocate temporary space for calculations, and calculate the
@@ -658,6 +771,75 @@ domul(v1, size1, v2, size2, ans)
 }
 
 
+/*
+ * Multiply a number by one at most half its size.  The first number is
+ * cut into pieces the size of the second number starting from the bottom,
+ * with a shorter last piece, and the product of each piece with the second
+ * number is added into the result at the position of the piece.  This uses
+ * twice the size of the second number from the temporary array, plus what
+ * domul needs for one piece, which is less than for the whole number.
+ */
+static LEN
+dounbal(v1, size1, v2, size2, ans)
+	HALF *v1;		/* first number */
+	LEN size1;		/* size of first number */
+	HALF *v2;		/* second (smaller) number */
+	LEN size2;		/* size of second number */
+	HALF *ans;		/* location for result */
+{
+	LEN pos;		/* position of the piece */
+	LEN piece;		/* size of the piece */
+	LEN sizetotal;		/* total size of product */
+	LEN len;		/* temporary length */
+	HALF *temp;		/* product of one piece */
+	FULL carry;		/* carry from additions */
+	register HALF *hd, *h1;	/* for inner loops */
+	SIUNION sival;		/* for addition of digits */
+
+	Store *store = Tcl_GetThreadData(&bufKey, sizeof(Store));
+
+	temp = store->temp;
+	store->temp += (2 * size2) + 1;
+	sizetotal = size1 + size2;
+	hd = ans;
+	len = sizetotal;
+	while (len--)
+		*hd++ = 0;
+
+	for (pos = 0; pos < size1; pos += size2) {
+		piece = size1 - pos;
+		if (piece > size2)
+			piece = size2;
+		len = domul(v1 + pos, piece, v2, size2, temp);
+		h1 = temp;
+		hd = ans + pos;
+		carry = 0;
+		while (len--) {
+			sival.ivalue = ((FULL) *h1++) + ((FULL) *hd) + carry;
+			*hd++ = sival.silow;
+			carry = sival.sihigh;
+		}
+		while (carry) {
+			sival.ivalue = ((FULL) *hd) + carry;
+			*hd++ = sival.silow;
+			carry = sival.sihigh;
+		}
+	}
+
+	/*
+	 * Determine the final size of the number and return it.
+	 */
+	len = sizetotal;
+	hd = &ans[len - 1];
+	while ((*hd == 0) && (len > 1)) {
+		hd--;
+		len--;
+	}
+	store->temp = temp;
+	return len;
+}
+
+
 /*
  * Square a number by using the following formula recursively:
  *	(A*S+B)^2 = (S^2+S)*A^2 + (S+1)*B^2 - S*(A-B)^2
@@ -686,9 +868,13 @@ zsquare(z, res)
 	 * size of the original number, since each recursion level uses 3/2
 	 * of the size of its given number, and whose size is 1/2 the size
 	 * of the previous level.  The sum of the infinite series is 3.
-	 * Allocate some extra words for rounding up the sizes.
+	 * Allocate some extra words for rounding up the sizes.  The
+	 * Toom-Cook levels need under 8 times the size of the number.
 	 */
-	len = 3 * z.len + 32;
+	if ((z.len < _sq3_) && (z.len < _sq4_))
+		len = 3 * z.len + 32;
+	else
+		len = 8 * z.len + 2048;
 	(void) zalloctemp(len);
 
 	res->sign = 0;
@@ -724,7 +910,6 @@ dosquare(vp, size, ans)
 	LEN sumsize;		/* size of sum */
 	LEN sizetotal;		/* total size of square */
 	LEN len;		/* temporary length */
-	LEN len1;		/* another temporary length */
 	FULL carry;		/* carry digit for small multiplications */
 	FULL digit;		/* single digit multiplying by */
 	HALF *temp;		/* base for temporary calculations */
@@ -770,37 +955,7 @@ dosquare(vp, size, ans)
 			digit = (FULL) *h2++;
 			if (digit == 0)
 				continue;
-			h3 = h2;
-			h1 = hd;
-			carry = 0;
-			len1 = len;
-			while (len1 >= 4) {	/* expand the loop some */
-				len1 -= 4;
-				sival.ivalue = (digit * ((FULL) *h3++))
-					+ ((FULL) *h1) + carry;
-				*h1++ = sival.silow;
-				sival.ivalue = (digit * ((FULL) *h3++))
-					+ ((FULL) *h1) + ((FULL) sival.sihigh);
-				*h1++ = sival.silow;
-				sival.ivalue = (digit * ((FULL) *h3++))
-					+ ((FULL) *h1) + ((FULL) sival.sihigh);
-				*h1++ = sival.silow;
-				sival.ivalue = (digit * ((FULL) *h3++))
-					+ ((FULL) *h1) + ((FULL) sival.sihigh);
-				*h1++ = sival.silow;
-				carry = sival.sihigh;
-			}
-			while (len1--) {
-				sival.ivalue = (digit * ((FULL) *h3++))
-					+ ((FULL) *h1) + carry;
-				*h1++ = sival.silow;
-				carry = sival.sihigh;
-			}
-			while (carry) {
-				sival.ivalue = ((FULL) *h1) + carry;
-				*h1++ = sival.silow;
-				carry = sival.sihigh;
-			}
+			hd[len] = zvaddmul1(hd, h2, len, (HALF) digit);
 		}
 
 		/*
@@ -808,15 +963,7 @@ dosquare(vp, size, ans)
 		 * There is no final carry to worry about because we
 		 * handle all digits of the result which must fit.
 		 */
-		carry = 0;
-		hd = ans;
-		len = sizetotal;
-		while (len--) {
-			digit = ((FULL) *hd);
-			sival.ivalue = digit + digit + carry;
-			*hd++ = sival.silow;
-			carry = sival.sihigh;
-		}
+		(void) zvadd(ans, ans, ans, sizetotal);
 
 		/*
 		 * Now add in the squares of each halfword.
@@ -852,6 +999,20 @@ dosquare(vp, size, ans)
 		return len;
 	}
 
+	/*
+	 * Huge numbers are squared by transforms, and very large numbers
+	 * are split into three or four pieces as long as the top piece
+	 * is not empty, which only matters for small algorithm sizes.
+	 */
+#if BASEB == 32
+	if ((size >= _sqntt_) && (size * 2 <= NTT_MAXLEN))
+		return dontt(vp, size, (HALF *) NULL, size, ans);
+#endif
+	if ((size >= _sq4_) && (size > 3 * ((size + 3) / 4)))
+		return dotoom(vp, size, (HALF *) NULL, size, ans, 4);
+	if ((size >= _sq3_) && (size > 2 * ((size + 2) / 3)))
+		return dotoom(vp, size, (HALF *) NULL, size, ans, 3);
+
 	/*
 	 * The number to be squared is large.
 	 * Allocate temporary space and determine the sizes and
@@ -1074,6 +1235,893 @@ dosquare(vp, size, ans)
 }
 
 
+/*
+ * Multiply or square numbers by the Toom-Cook method.  Each number is split
+ * into the given number of pieces of K words each, which makes it into a
+ * polynomial in S = BASE^K of one degree less than the number of pieces.
+ * The polynomials are evaluated at a few small points, the values at each
+ * point are multiplied recursively, and the coefficients of the product
+ * polynomial are then recovered from those values by exact divisions:
+ *	3 pieces:	0, 1, -1, 2, and infinity
+ *	4 pieces:	0, 1, -1, 2, -2, 1/2, and infinity
+ * The point 1/2 is evaluated as 8*A(1/2) so that it stays integral.
+ * The values at 0 and infinity are the products of the lowest and highest
+ * pieces, and these are formed directly in their final places in the result.
+ * The other values can be negative, and so are kept as ZVALUEs whose digits
+ * live in the temporary array.  The second number is NULL when squaring.
+ * The result array and the returned size are as for domul.
+ */
+static LEN
+dotoom(v1, size1, v2, size2, ans, ways)
+	HALF *v1;		/* first number */
+	LEN size1;		/* size of first number */
+	HALF *v2;		/* second number, or NULL to square first */
+	LEN size2;		/* size of second number */
+	HALF *ans;		/* location for result */
+	int ways;		/* number of pieces to split numbers into */
+{
+	static CONST int points3[] = {1, -1, 2};
+	static CONST int points4[] = {1, -1, 2, -2, 0};
+	static CONST int coeffs3[] = {2, 1, 3};
+	static CONST int coeffs4[] = {2, 1, 5, 3, 4};
+	CONST int *points;	/* evaluation points (0 meaning 1/2) */
+	CONST int *coeffs;	/* values holding each middle coefficient */
+	ZVALUE a[4];		/* pieces of first number */
+	ZVALUE b[4];		/* pieces of second number */
+	ZVALUE ea[5];		/* values of first number at the points */
+	ZVALUE eb[5];		/* values of second number at the points */
+	ZVALUE w[7];		/* values of product, then its coefficients */
+	ZVALUE *bp, *ebp;	/* pieces and values for second number */
+	HALF *scratch;		/* room for one scaled coefficient */
+	HALF *temp;		/* base for temporary calculations */
+	HALF *hd;		/* for zeroing the result */
+	LEN k;			/* size of the pieces */
+	LEN sizetotal;		/* total size of product */
+	LEN len;		/* temporary length */
+	int npoints;		/* number of points other than 0 and infinity */
+	int last;		/* degree of the product polynomial */
+	int i;
+	BOOL square;		/* TRUE if squaring */
+
+	Store *store = Tcl_GetThreadData(&bufKey, sizeof(Store));
+
+	square = (v2 == NULL);
+	sizetotal = size1 + size2;
+	k = (size1 + ways - 1) / ways;
+	npoints = 2 * ways - 3;
+	last = 2 * ways - 2;
+	if (ways == 3) {
+		points = points3;
+		coeffs = coeffs3;
+	} else {
+		points = points4;
+		coeffs = coeffs4;
+	}
+
+	/*
+	 * Split the numbers and evaluate them at each point.  The values
+	 * are less than 16*S and so fit in one word more than the pieces.
+	 * The products of the values need one more word for domul to use.
+	 */
+	temp = store->temp;
+	tcsplit(v1, size1, k, ways, a);
+	bp = a;
+	ebp = ea;
+	if (!square) {
+		tcsplit(v2, size2, k, ways, b);
+		bp = b;
+		ebp = eb;
+	}
+	for (i = 0; i < npoints; i++) {
+		ea[i].v = store->temp;
+		store->temp += k + 3;
+		tceval(a, ways, points[i], &ea[i]);
+		if (square)
+			continue;
+		eb[i].v = store->temp;
+		store->temp += k + 3;
+		tceval(b, ways, points[i], &eb[i]);
+	}
+	for (i = 1; i <= npoints; i++) {
+		w[i].v = store->temp;
+		store->temp += 2 * k + 6;
+	}
+	scratch = store->temp;
+	store->temp += 2 * k + 6;
+
+	/*
+	 * Form the products at 0 and infinity in place, clearing the words
+	 * around them, and then the products at the other points.
+	 */
+	w[0].v = ans;
+	tcmul(a[0], bp[0], &w[0], square);
+	w[last].v = ans + last * k;
+	tcmul(a[ways - 1], bp[ways - 1], &w[last], square);
+	hd = ans + w[0].len;
+	len = last * k - w[0].len;
+	while (len--)
+		*hd++ = 0;
+	hd = w[last].v + w[last].len;
+	len = sizetotal - last * k - w[last].len;
+	while (len-- > 0)
+		*hd++ = 0;
+	for (i = 1; i <= npoints; i++)
+		tcmul(ea[i - 1], ebp[i - 1], &w[i], square);
+
+	/*
+	 * Interpolate to find the middle coefficients c1 to c(last-1).
+	 * With 3 pieces, where w4 is the value at infinity:
+	 *	w2 = (w1 - w2) / 2			= c1 + c3
+	 *	w1 = w1 - w2 - w0 - w4			= c2
+	 *	w3 = ((w3 - w0 - 4*w1 - 16*w4) / 2 - w2) / 3	= c3
+	 *	w2 = w2 - w3				= c1
+	 */
+	if (ways == 3) {
+		tcsub(w[1], w[2], &w[2]);
+		tcdivsmall(&w[2], 2);
+		tcsub(w[1], w[2], &w[1]);
+		tcsub(w[1], w[0], &w[1]);
+		tcsub(w[1], w[4], &w[1]);
+		tcsub(w[3], w[0], &w[3]);
+		tcsubmul(&w[3], w[1], 4, scratch);
+		tcsubmul(&w[3], w[4], 16, scratch);
+		tcdivsmall(&w[3], 2);
+		tcsub(w[3], w[2], &w[3]);
+		tcdivsmall(&w[3], 3);
+		tcsub(w[2], w[3], &w[2]);
+	} else {
+		/*
+		 * With 4 pieces, where w5 is the value at 1/2 scaled by 64
+		 * and w6 is the value at infinity, first separate the odd
+		 * and even parts of the values at 1, -1, 2 and -2:
+		 *	w2 = (w1 - w2) / 2		= c1 + c3 + c5
+		 *	w1 = w1 - w2 - w0 - w6		= c2 + c4
+		 *	w4 = (w3 - w4) / 4		= c1 + 4*c3 + 16*c5
+		 *	w3 = w3 - 2*w4 - w0 - 64*w6	= 4*c2 + 16*c4
+		 */
+		tcsub(w[1], w[2], &w[2]);
+		tcdivsmall(&w[2], 2);
+		tcsub(w[1], w[2], &w[1]);
+		tcsub(w[3], w[4], &w[4]);
+		tcdivsmall(&w[4], 4);
+		tcsubmul(&w[3], w[4], 2, scratch);
+		tcsub(w[1], w[0], &w[1]);
+		tcsub(w[1], w[6], &w[1]);
+		tcsub(w[3], w[0], &w[3]);
+		tcsubmul(&w[3], w[6], 64, scratch);
+
+		/*
+		 * Then solve for the even coefficients:
+		 *	w3 = (w3 - 4*w1) / 12		= c4
+		 *	w1 = w1 - w3			= c2
+		 */
+		tcsubmul(&w[3], w[1], 4, scratch);
+		tcdivsmall(&w[3], 12);
+		tcsub(w[1], w[3], &w[1]);
+
+		/*
+		 * Finally solve for the odd coefficients using the value
+		 * at 1/2, which is 64*c0 + 32*c1 + 16*c2 + ... + c6:
+		 *	w5 = (w5 - 64*w0 - 16*w1 - 4*w3 - w6) / 2
+		 *					= 16*c1 + 4*c3 + c5
+		 *	w4 = (w4 - w2) / 3		= c3 + 5*c5
+		 *	w5 = (16*w2 - w5) / 3		= 4*c3 + 5*c5
+		 *	w5 = (w5 - w4) / 3		= c3
+		 *	w4 = (w4 - w5) / 5		= c5
+		 *	w2 = w2 - w5 - w4		= c1
+		 */
+		tcsubmul(&w[5], w[0], 64, scratch);
+		tcsubmul(&w[5], w[1], 16, scratch);
+		tcsubmul(&w[5], w[3], 4, scratch);
+		tcsub(w[5], w[6], &w[5]);
+		tcdivsmall(&w[5], 2);
+		tcsub(w[4], w[2], &w[4]);
+		tcdivsmall(&w[4], 3);
+		tcsubmul(&w[5], w[2], 16, scratch);
+		if (!ziszero(w[5]))
+			w[5].sign = !w[5].sign;
+		tcdivsmall(&w[5], 3);
+		tcsub(w[5], w[4], &w[5]);
+		tcdivsmall(&w[5], 3);
+		tcsub(w[4], w[5], &w[4]);
+		tcdivsmall(&w[4], 5);
+		tcsub(w[2], w[5], &w[2]);
+		tcsub(w[2], w[4], &w[2]);
+	}
+
+	/*
+	 * Add the middle coefficients into the result at their positions.
+	 * They are all nonnegative since the pieces were, and the sums
+	 * never exceed the final product, so the carries stay within it.
+	 */
+	for (i = 1; i < last; i++)
+		tcaddat(ans, w[coeffs[i - 1]], i * k);
+
+	/*
+	 * Return the true size of the result.
+	 */
+	len = sizetotal;
+	hd = &ans[len - 1];
+	while ((*hd == 0) && (len > 1)) {
+		hd--;
+		len--;
+	}
+	store->temp = temp;
+	return len;
+}
+
+
+/*
+ * Split a number into pieces of the given size for the Toom-Cook method.
+ * The pieces share the digits of the number, and the last piece gets
+ * whatever is left over.
+ */
+static void
+tcsplit(v, size, k, ways, pieces)
+	HALF *v;		/* number to split */
+	LEN size;		/* size of number */
+	LEN k;			/* size of each piece */
+	int ways;		/* number of pieces */
+	ZVALUE *pieces;		/* returned pieces */
+{
+	int i;
+
+	for (i = 0; i < ways; i++) {
+		pieces[i].v = v + i * k;
+		pieces[i].len = (i < ways - 1) ? k : size - i * k;
+		pieces[i].sign = 0;
+		ztrim(&pieces[i]);
+	}
+}
+
+
+/*
+ * Evaluate the polynomial given by the pieces of a number at a small point
+ * using Horner's rule.  A point of 0 means 1/2, for which the value scaled
+ * by 2^(ways-1) is found by running through the pieces in reverse order.
+ * The digits of the result must already be allocated.
+ */
+static void
+tceval(pieces, ways, point, res)
+	ZVALUE *pieces;		/* pieces of number */
+	int ways;		/* number of pieces */
+	int point;		/* point to evaluate at */
+	ZVALUE *res;		/* returned value */
+{
+	int i, first, step;
+	HALF mul;
+
+	if (point) {
+		first = ways - 1;
+		step = -1;
+	} else {
+		first = 0;
+		step = 1;
+		point = 2;
+	}
+	mul = (HALF) ((point < 0) ? -point : point);
+	res->len = pieces[first].len;
+	res->sign = 0;
+	zcopyval(pieces[first], *res);
+	for (i = 1; i < ways; i++) {
+		if (mul != 1)
+			tcmulsmall(res, mul);
+		if ((point < 0) && !ziszero(*res))
+			res->sign = !res->sign;
+		tcadd(*res, pieces[first + i * step], res);
+	}
+}
+
+
+/*
+ * Multiply or square two signed values for the Toom-Cook method.
+ * The digits of the result must already be allocated.
+ */
+static void
+tcmul(z1, z2, res, square)
+	ZVALUE z1, z2;		/* numbers to multiply */
+	ZVALUE *res;		/* returned product */
+	BOOL square;		/* TRUE if squaring first number */
+{
+	if (square) {
+		res->len = dosquare(z1.v, z1.len, res->v);
+		res->sign = 0;
+		return;
+	}
+	res->len = domul(z1.v, z1.len, z2.v, z2.len, res->v);
+	res->sign = (z1.sign != z2.sign);
+	if (ziszero(*res))
+		res->sign = 0;
+}
+
+
+/*
+ * Add two signed values for the Toom-Cook method.  The digits of the result
+ * must already be allocated with room for one word more than the larger
+ * value, and can be the same as the digits of either value.
+ */
+static void
+tcadd(z1, z2, res)
+	ZVALUE z1, z2;		/* numbers to add */
+	ZVALUE *res;		/* returned sum */
+{
+	ZVALUE t;		/* for exchanging values */
+	register HALF *h1, *h2, *hd;
+	LEN len, copysize;
+	FULL carry;
+	SIUNION sival;
+	BOOL sign;
+
+	if (z1.len < z2.len) {
+		t = z1;
+		z1 = z2;
+		z2 = t;
+	}
+	h1 = z1.v;
+	h2 = z2.v;
+	hd = res->v;
+	len = z2.len;
+	copysize = z1.len - z2.len;
+	carry = 0;
+	if (z1.sign == z2.sign) {
+		while (len--) {
+			sival.ivalue = ((FULL) *h1++) + ((FULL) *h2++) + carry;
+			*hd++ = sival.silow;
+			carry = sival.sihigh;
+		}
+		while (copysize--) {
+			sival.ivalue = ((FULL) *h1++) + carry;
+			*hd++ = sival.silow;
+			carry = sival.sihigh;
+		}
+		*hd = (HALF) carry;
+		res->len = z1.len + (carry != 0);
+		res->sign = z1.sign;
+		return;
+	}
+
+	/*
+	 * The signs differ, so subtract the smaller magnitude from the
+	 * larger one, and give the result the sign of the larger one.
+	 */
+	sign = z1.sign;
+	z1.sign = 0;
+	z2.sign = 0;
+	if (zrel(z1, z2) < 0) {
+		sign = !sign;
+		h1 = z2.v;
+		h2 = z1.v;
+	}
+	while (len--) {
+		sival.ivalue = BASE1 - ((FULL) *h1++) + ((FULL) *h2++) + carry;
+		*hd++ = BASE1 - sival.silow;
+		carry = sival.sihigh;
+	}
+	while (copysize--) {
+		sival.ivalue = (BASE1 - ((FULL) *h1++)) + carry;
+		*hd++ = BASE1 - sival.silow;
+		carry = sival.sihigh;
+	}
+	res->len = z1.len;
+	ztrim(res);
+	res->sign = ziszero(*res) ? 0 : sign;
+}
+
+
+/*
+ * Subtract two signed values for the Toom-Cook method.
+ * This has the same requirements as tcadd.
+ */
+static void
+tcsub(z1, z2, res)
+	ZVALUE z1, z2;		/* numbers to subtract */
+	ZVALUE *res;		/* returned difference */
+{
+	z2.sign = !z2.sign;
+	tcadd(z1, z2, res);
+}
+
+
+/*
+ * Subtract a small multiple of a signed value from another one in place
+ * for the Toom-Cook method.  The scratch array must have room for one
+ * word more than the value being multiplied.
+ */
+static void
+tcsubmul(z, z1, mul, scratch)
+	ZVALUE *z;		/* number to subtract from */
+	ZVALUE z1;		/* number to multiply and subtract */
+	HALF mul;		/* multiplier */
+	HALF *scratch;		/* room for the multiple */
+{
+	ZVALUE t;
+
+	t.v = scratch;
+	t.len = z1.len;
+	t.sign = z1.sign;
+	zcopyval(z1, t);
+	tcmulsmall(&t, mul);
+	tcsub(*z, t, z);
+}
+
+
+/*
+ * Multiply a signed value by a small number in place for the Toom-Cook
+ * method.  The digits must have room for one more word.
+ */
+static void
+tcmulsmall(z, mul)
+	ZVALUE *z;		/* number to multiply */
+	HALF mul;		/* multiplier */
+{
+	register HALF *hd;
+	LEN len;
+	FULL carry;
+	SIUNION sival;
+
+	hd = z->v;
+	len = z->len;
+	carry = 0;
+	while (len--) {
+		sival.ivalue = ((FULL) *hd) * mul + carry;
+		*hd++ = sival.silow;
+		carry = sival.sihigh;
+	}
+	if (carry) {
+		*hd = (HALF) carry;
+		z->len++;
+	}
+	if (ziszero(*z))
+		z->sign = 0;
+}
+
+
+/*
+ * Divide a signed value by a small number in place for the Toom-Cook method.
+ * The division is known to be exact, so the factors of two are shifted out
+ * and the rest is done by multiplying by the inverse of the odd part modulo
+ * BASE, working up from the lowest word, which avoids any true divisions.
+ */
+static void
+tcdivsmall(z, div)
+	ZVALUE *z;		/* number to divide */
+	HALF div;		/* divisor */
+{
+	register HALF *hd;
+	LEN len;
+	FULL borrow;		/* amount to subtract from next word */
+	HALF inverse;		/* inverse of divisor modulo BASE */
+	HALF digit;
+	int shift;		/* number of factors of two in divisor */
+	int i;
+
+	shift = 0;
+	while ((div & 1) == 0) {
+		div >>= 1;
+		shift++;
+	}
+	if (shift) {
+		hd = z->v;
+		len = z->len;
+		while (--len > 0) {
+			*hd = (HALF) ((*hd >> shift) |
+				(((FULL) hd[1]) << (BASEB - shift)));
+			hd++;
+		}
+		*hd >>= shift;
+	}
+	if (div > 1) {
+		/*
+		 * Each step of Newton's iteration doubles the number of
+		 * correct low order bits of the inverse, and the divisor
+		 * is its own inverse to three bits.
+		 */
+		inverse = div;
+		for (i = 0; i < 5; i++)
+			inverse = (HALF) (((FULL) inverse) *
+				(2 - ((FULL) div) * inverse));
+		hd = z->v;
+		len = z->len;
+		borrow = 0;
+		while (len--) {
+			digit = *hd;
+			*hd = (HALF) ((digit - borrow) * inverse);
+			borrow = ((((FULL) *hd) * div) >> BASEB) + (digit < borrow);
+			hd++;
+		}
+	}
+	ztrim(z);
+	if (ziszero(*z))
+		z->sign = 0;
+}
+
+
+/*
+ * Add a nonnegative value into a result at the given word position,
+ * propagating the carry as far as it goes.
+ */
+static void
+tcaddat(ans, z, pos)
+	HALF *ans;		/* result to add into */
+	ZVALUE z;		/* number to add */
+	LEN pos;		/* position to add it at */
+{
+	register HALF *h1, *hd;
+	LEN len;
+	FULL carry;
+	SIUNION sival;
+
+	h1 = z.v;
+	hd = ans + pos;
+	len = z.len;
+	carry = 0;
+	while (len--) {
+		sival.ivalue = ((FULL) *h1++) + ((FULL) *hd) + carry;
+		*hd++ = sival.silow;
+		carry = sival.sihigh;
+	}
+	while (carry) {
+		sival.ivalue = ((FULL) *hd) + carry;
+		*hd++ = sival.silow;
+		carry = sival.sihigh;
+	}
+}
+
+
+#if BASEB == 32
+/*
+ * Multiply or square numbers by number theoretic transforms.  The words
+ * of the numbers are taken as the coefficients of two polynomials, whose
+ * product is found by a cyclic convolution modulo each of three primes
+ * below 2^31, using fast transforms of a power of two length.  Since each
+ * coefficient of the product is less than the number of words times BASE^2,
+ * which is well below the product of the three primes, the coefficients are
+ * then recovered exactly by the Chinese remainder theorem and their carries
+ * are propagated into the result.  The arithmetic modulo the primes is done
+ * in Montgomery form with R = BASE, so that no divisions are needed.
+ * This needs the full words to be 32 bits, and works for numbers of up to
+ * 2^24 words, beyond which the primes do not have the needed roots of unity.
+ * The second number is NULL when squaring.  The result array and the
+ * returned size are as for domul.
+ */
+static LEN
+dontt(v1, size1, v2, size2, ans)
+	HALF *v1;		/* first number */
+	LEN size1;		/* size of first number */
+	HALF *v2;		/* second number, or NULL to square first */
+	LEN size2;		/* size of second number */
+	HALF *ans;		/* location for result */
+{
+	HALF *res;		/* convolutions modulo each prime */
+	HALF *work;		/* transform of second number */
+	HALF *roots;		/* roots of unity for forward transform */
+	HALF *invroots;		/* roots of unity for inverse transform */
+	HALF *x;		/* convolution being worked on */
+	HALF p1, p2, p3;	/* the primes */
+	HALF p, pinv;		/* current prime and its Montgomery inverse */
+	HALF pinv2, pinv3;	/* Montgomery inverses of last two primes */
+	HALF scale;		/* inverse of transform length, times R^2 */
+	HALF m1, m2, m3;	/* Garner constants in Montgomery form */
+	HALF r1, r2, r3;	/* residues of one coefficient */
+	HALF x2, x3;		/* mixed radix digits of one coefficient */
+	HALF *hd;
+	FULL t;
+	FULL carry;		/* carry into next word of result */
+	FULL p12;		/* product of first two primes */
+	FULL prod2;		/* x2 * p1 */
+	FULL prod3lo;		/* x3 * low word of p1*p2 */
+	FULL prod3hi;		/* x3 * high word of p1*p2 */
+	LEN n;			/* transform length */
+	LEN sizetotal;		/* total size of product */
+	LEN len;
+	LEN i;
+	int k;
+
+	sizetotal = size1 + size2;
+	n = 1;
+	while (n < sizetotal - 1)
+		n *= 2;
+	res = (HALF *) ckalloc(3 * n * sizeof(HALF));
+	roots = (HALF *) ckalloc(n * sizeof(HALF));
+	invroots = (HALF *) ckalloc(n * sizeof(HALF));
+	work = NULL;
+	if (v2)
+		work = (HALF *) ckalloc(n * sizeof(HALF));
+
+	/*
+	 * Find the convolution modulo each prime in turn.  Multiplying
+	 * the transforms in Montgomery form divides them by R, and so the
+	 * scale for the inverse transform includes R^2 to make up for that
+	 * and for the multiply by the scale itself.
+	 */
+	for (k = 0; k < 3; k++) {
+		p = nttprimes[k].prime;
+		pinv = nttmontinv(p);
+		nttroots(p, pinv, nttprimes[k].root, n, roots, invroots);
+		scale = nttmont(nttmont(nttpower((HALF) (n % p), p - 2, p),
+			p), p);
+
+		x = res + k * n;
+		nttload(x, n, v1, size1, p);
+		nttforward(x, n, roots, p, pinv);
+		if (work) {
+			nttload(work, n, v2, size2, p);
+			nttforward(work, n, roots, p, pinv);
+			for (i = 0; i < n; i++) {
+				x[i] = nttmul(nttmul(x[i], work[i], p, pinv),
+					scale, p, pinv);
+			}
+		} else {
+			for (i = 0; i < n; i++) {
+				x[i] = nttmul(nttmul(x[i], x[i], p, pinv),
+					scale, p, pinv);
+			}
+		}
+		nttbackward(x, n, invroots, p, pinv);
+	}
+
+	/*
+	 * Combine the residues into the coefficients by Garner's method,
+	 * which finds the digits of each coefficient c in mixed radix:
+	 *	c = r1 + x2*p1 + x3*p1*p2
+	 *	x2 = (r2 - r1) / p1			modulo p2
+	 *	x3 = (r3 - r1 - x2*p1) / (p1*p2)	modulo p3
+	 * The first prime is the largest, and all of them are above 2^30,
+	 * so that a residue for one prime needs at most one subtraction to
+	 * be reduced for another.  Each coefficient is added into the result
+	 * along with the carry from the lower ones, which stays below 2^62.
+	 */
+	p1 = nttprimes[0].prime;
+	p2 = nttprimes[1].prime;
+	p3 = nttprimes[2].prime;
+	pinv2 = nttmontinv(p2);
+	pinv3 = nttmontinv(p3);
+	p12 = ((FULL) p1) * p2;
+	m1 = nttmont(nttpower(p1 - p2, p2 - 2, p2), p2);
+	m2 = nttmont(p1 - p3, p3);
+	m3 = nttmont(nttpower((HALF) (p12 % p3), p3 - 2, p3), p3);
+	hd = ans;
+	carry = 0;
+	for (i = 0; i < sizetotal - 1; i++) {
+		r1 = res[i];
+		r2 = res[n + i];
+		r3 = res[2 * n + i];
+
+		x2 = (r1 >= p2) ? r1 - p2 : r1;
+		x2 = (r2 >= x2) ? r2 - x2 : r2 + (p2 - x2);
+		x2 = nttmul(x2, m1, p2, pinv2);
+
+		x3 = (r1 >= p3) ? r1 - p3 : r1;
+		x3 += nttmul(x2, m2, p3, pinv3);
+		if (x3 >= p3)
+			x3 -= p3;
+		x3 = (r3 >= x3) ? r3 - x3 : r3 + (p3 - x3);
+		x3 = nttmul(x3, m3, p3, pinv3);
+
+		prod2 = ((FULL) x2) * p1;
+		prod3lo = ((FULL) x3) * ((HALF) p12);
+		prod3hi = ((FULL) x3) * ((HALF) (p12 >> BASEB));
+		t = ((FULL) r1) + (prod2 & BASE1) + (prod3lo & BASE1) +
+			(carry & BASE1);
+		*hd++ = (HALF) t;
+		carry = (t >> BASEB) + (prod2 >> BASEB) +
+			(prod3lo >> BASEB) + (carry >> BASEB) + prod3hi;
+	}
+	*hd = (HALF) carry;
+	ckfree((char *) res);
+	ckfree((char *) roots);
+	ckfree((char *) invroots);
+	if (work)
+		ckfree((char *) work);
+
+	len = sizetotal;
+	hd = &ans[len - 1];
+	while ((*hd == 0) && (len > 1)) {
+		hd--;
+		len--;
+	}
+	return len;
+}
+
+
+/*
+ * Load a number into an array for transforming, reducing its words
+ * modulo the prime and padding it with zeroes to the transform length.
+ */
+static void
+nttload(x, n, v, size, p)
+	HALF *x;		/* array to load */
+	LEN n;			/* transform length */
+	HALF *v;		/* number to load */
+	LEN size;		/* size of number */
+	HALF p;			/* prime */
+{
+	LEN i;
+
+	for (i = 0; i < size; i++)
+		x[i] = v[i] % p;
+	for (; i < n; i++)
+		x[i] = 0;
+}
+
+
+/*
+ * Transform an array in place, leaving the result in bit reversed order.
+ * The transform is done by the decimation in frequency method, where the
+ * stage combining values H apart uses the powers of a primitive 2H-th
+ * root of unity, which are stored at positions H through 2H-1 of the roots.
+ */
+static void
+nttforward(x, n, roots, p, pinv)
+	HALF *x;		/* array to transform */
+	LEN n;			/* transform length */
+	HALF *roots;		/* roots of unity in Montgomery form */
+	HALF p, pinv;		/* prime and its Montgomery inverse */
+{
+	register HALF *h1, *h2, *w;
+	HALF u, v;
+	LEN half, start, j;
+
+	for (half = n / 2; half > 0; half /= 2) {
+		for (start = 0; start < n; start += 2 * half) {
+			h1 = x + start;
+			h2 = h1 + half;
+			w = roots + half;
+			for (j = 0; j < half; j++) {
+				u = *h1;
+				v = *h2;
+				*h1++ = (u + v >= p) ? u + v - p : u + v;
+				*h2++ = nttmul(u + p - v, *w++, p, pinv);
+			}
+		}
+	}
+}
+
+
+/*
+ * Inverse transform an array in place, taking the values in bit reversed
+ * order and leaving the result in the normal order but multiplied by the
+ * transform length.  The transform is done by the decimation in time method
+ * using the inverse roots of unity in the same layout as for nttforward.
+ */
+static void
+nttbackward(x, n, roots, p, pinv)
+	HALF *x;		/* array to transform */
+	LEN n;			/* transform length */
+	HALF *roots;		/* inverse roots of unity in Montgomery form */
+	HALF p, pinv;		/* prime and its Montgomery inverse */
+{
+	register HALF *h1, *h2, *w;
+	HALF u, v;
+	LEN half, start, j;
+
+	for (half = 1; half < n; half *= 2) {
+		for (start = 0; start < n; start += 2 * half) {
+			h1 = x + start;
+			h2 = h1 + half;
+			w = roots + half;
+			for (j = 0; j < half; j++) {
+				u = *h1;
+				v = nttmul(*h2, *w++, p, pinv);
+				*h1++ = (u + v >= p) ? u + v - p : u + v;
+				*h2++ = (u >= v) ? u - v : u + (p - v);
+			}
+		}
+	}
+}
+
+
+/*
+ * Build the tables of roots of unity in Montgomery form for transforms
+ * of the given length.  Positions H through 2H-1 of each table hold the
+ * powers of a primitive 2H-th root of unity or of its inverse.
+ */
+static void
+nttroots(p, pinv, root, n, roots, invroots)
+	HALF p, pinv;		/* prime and its Montgomery inverse */
+	HALF root;		/* primitive root of prime */
+	LEN n;			/* transform length */
+	HALF *roots;		/* returned roots of unity */
+	HALF *invroots;		/* returned inverse roots of unity */
+{
+	HALF w, winv;		/* primitive roots of unity */
+	HALF one;		/* one in Montgomery form */
+	LEN half, j;
+
+	one = nttmont(1, p);
+	for (half = 1; half < n; half *= 2) {
+		w = nttpower(root, (p - 1) / (2 * half), p);
+		winv = nttmont(nttpower(w, p - 2, p), p);
+		w = nttmont(w, p);
+		roots[half] = one;
+		invroots[half] = one;
+		for (j = 1; j < half; j++) {
+			roots[half + j] = nttmul(roots[half + j - 1], w,
+				p, pinv);
+			invroots[half + j] = nttmul(invroots[half + j - 1],
+				winv, p, pinv);
+		}
+	}
+}
+
+
+/*
+ * Multiply two values modulo a prime in Montgomery form, returning
+ * their product divided by R.  The product of the values must be less
+ * than R times the prime, as it is when either one is reduced.
+ */
+static HALF
+nttmul(a, b, p, pinv)
+	HALF a, b;		/* values to multiply */
+	HALF p, pinv;		/* prime and its Montgomery inverse */
+{
+	FULL t;
+	HALF m;
+
+	t = ((FULL) a) * b;
+	m = ((HALF) t) * pinv;
+	t = (t + ((FULL) m) * p) >> BASEB;
+	return (HALF) ((t >= p) ? t - p : t);
+}
+
+
+/*
+ * Return the Montgomery inverse of a prime, which is minus its inverse
+ * modulo R.  Each step of Newton's iteration doubles the number of
+ * correct low order bits, and an odd number is its own inverse to
+ * three bits.
+ */
+static HALF
+nttmontinv(p)
+	HALF p;			/* prime */
+{
+	HALF inv;
+	int i;
+
+	inv = p;
+	for (i = 0; i < 4; i++)
+		inv *= 2 - p * inv;
+	return -inv;
+}
+
+
+/*
+ * Convert a reduced value modulo a prime into Montgomery form.
+ */
+static HALF
+nttmont(a, p)
+	HALF a;			/* value to convert */
+	HALF p;			/* prime */
+{
+	return (HALF) ((((FULL) a) << BASEB) % p);
+}
+
+
+/*
+ * Raise a value to a power modulo a prime, without Montgomery form.
+ * This is only used for setting up constants, and so can divide.
+ */
+static HALF
+nttpower(a, power, p)
+	HALF a;			/* value to raise */
+	HALF power;		/* power to raise it to */
+	HALF p;			/* prime */
+{
+	FULL result, base;
+
+	result = 1;
+	base = a % p;
+	while (power) {
+		if (power & 1)
+			result = (result * base) % p;
+		base = (base * base) % p;
+		power >>= 1;
+	}
+	return (HALF) result;
+}
+#endif
+
+
 /*
  * Return a pointer to a buffer to be used for holding a temporary number.
  * The buffer will be at least as large as the specified number of HALFs,
@@ -1114,4 +2162,17 @@ zalloctemp(len)
 	return hp;
 }
 
+
+/*
+ * Return the number of words in the temporary buffer of the current
+ * thread.  The buffer only ever grows, so this is the most it has held.
+ */
+LEN
+ztempsize()
+{
+	Store *store = Tcl_GetThreadData(&bufKey, sizeof(Store));
+
+	return store->length;
+}
+
 /* END CODE */
@@ -0,0 +1,542 @@
+/*
+ * zvec - Inner loops of the integer arithmetic
+ *
+ * These routines add, subtract and multiply arrays of words, and are
+ * where most of the time goes for large numbers.  Each is reached
+ * through a pointer which starts out at the portable version, and
+ * zvecinit points them at faster versions when the processor has the
+ * instructions for them.
+ *
+ * On x86-64 with the BMI2 and ADX extensions, the multiplies use mulx,
+ * which leaves the flags alone, so that adcx and adox can keep two
+ * carry chains going at once.  The words are handled 64 bits at a time
+ * even when HALF is 32 bits, since on a little endian machine two
+ * adjacent words form one 64 bit word with the same carries.
+ */
+
+#include "zmath.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && ((BASEB == 32) || (BASEB == 64))
+#define	ZVEC_X86_64
+#include <cpuid.h>
+#endif
+
+
+static HALF cadd MATH_PROTO((HALF *res, HALF *v1, HALF *v2, LEN len));
+static HALF csub MATH_PROTO((HALF *res, HALF *v1, HALF *v2, LEN len));
+static HALF cmul1 MATH_PROTO((HALF *res, HALF *v, LEN len, HALF mul));
+static HALF caddmul1 MATH_PROTO((HALF *res, HALF *v, LEN len, HALF mul));
+static HALF csubmul1 MATH_PROTO((HALF *res, HALF *v, LEN len, HALF mul));
+
+#ifdef ZVEC_X86_64
+typedef unsigned long long LIMB;	/* 64 bit word used by the kernels */
+
+#define	LIMBHALVES	(64 / BASEB)	/* words of HALF in a LIMB */
+
+static LIMB xadd MATH_PROTO((LIMB *res, LIMB *v1, LIMB *v2, long n));
+static LIMB xsub MATH_PROTO((LIMB *res, LIMB *v1, LIMB *v2, long n));
+static LIMB xmul1 MATH_PROTO((LIMB *res, LIMB *v, long n, LIMB mul));
+static LIMB xaddmul1 MATH_PROTO((LIMB *res, LIMB *v, long n, LIMB mul));
+static LIMB xsubmul1 MATH_PROTO((LIMB *res, LIMB *v, long n, LIMB mul));
+static HALF adxadd MATH_PROTO((HALF *res, HALF *v1, HALF *v2, LEN len));
+static HALF adxsub MATH_PROTO((HALF *res, HALF *v1, HALF *v2, LEN len));
+static HALF adxmul1 MATH_PROTO((HALF *res, HALF *v, LEN len, HALF mul));
+static HALF adxaddmul1 MATH_PROTO((HALF *res, HALF *v, LEN len, HALF mul));
+static HALF adxsubmul1 MATH_PROTO((HALF *res, HALF *v, LEN len, HALF mul));
+#endif
+
+HALF (*zvadd) MATH_PROTO((HALF *res, HALF *v1, HALF *v2, LEN len)) = cadd;
+HALF (*zvsub) MATH_PROTO((HALF *res, HALF *v1, HALF *v2, LEN len)) = csub;
+HALF (*zvmul1) MATH_PROTO((HALF *res, HALF *v, LEN len, HALF mul)) = cmul1;
+HALF (*zvaddmul1) MATH_PROTO((HALF *res, HALF *v, LEN len, HALF mul)) =
+	caddmul1;
+HALF (*zvsubmul1) MATH_PROTO((HALF *res, HALF *v, LEN len, HALF mul)) =
+	csubmul1;
+
+
+/*
+ * Choose the versions of the routines for this processor.  This is
+ * called once by initmasks, and does nothing when the portable versions
+ * are the only ones.
+ */
+void
+zvecinit()
+{
+#ifdef ZVEC_X86_64
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		return;
+	if (!(ebx & bit_BMI2) || !(ebx & bit_ADX))
+		return;
+	zvadd = adxadd;
+	zvsub = adxsub;
+	zvmul1 = adxmul1;
+	zvaddmul1 = adxaddmul1;
+	zvsubmul1 = adxsubmul1;
+#endif
+}
+
+
+/*
+ * Add two arrays of words of the same length, returning the carry.
+ * The result can be the same as either array.
+ */
+static HALF
+cadd(res, v1, v2, len)
+	HALF *res;		/* result */
+	HALF *v1, *v2;		/* words to add */
+	LEN len;		/* number of words */
+{
+	FULL carry;
+	SIUNION sival;
+
+	carry = 0;
+	while (len >= 4) {	/* expand the loop some */
+		len -= 4;
+		sival.ivalue = ((FULL) *v1++) + ((FULL) *v2++) + carry;
+		*res++ = sival.silow;
+		sival.ivalue = ((FULL) *v1++) + ((FULL) *v2++) +
+			((FULL) sival.sihigh);
+		*res++ = sival.silow;
+		sival.ivalue = ((FULL) *v1++) + ((FULL) *v2++) +
+			((FULL) sival.sihigh);
+		*res++ = sival.silow;
+		sival.ivalue = ((FULL) *v1++) + ((FULL) *v2++) +
+			((FULL) sival.sihigh);
+		*res++ = sival.silow;
+		carry = sival.sihigh;
+	}
+	while (len-- > 0) {
+		sival.ivalue = ((FULL) *v1++) + ((FULL) *v2++) + carry;
+		*res++ = sival.silow;
+		carry = sival.sihigh;
+	}
+	return (HALF) carry;
+}
+
+
+/*
+ * Subtract one array of words from another of the same length, returning
+ * the borrow.  The result can be the same as either array.
+ */
+static HALF
+csub(res, v1, v2, len)
+	HALF *res;		/* result */
+	HALF *v1, *v2;		/* words to subtract second from first */
+	LEN len;		/* number of words */
+{
+	FULL carry;
+	SIUNION sival;
+
+	carry = 0;
+	while (len-- > 0) {
+		sival.ivalue = (BASE1 - ((FULL) *v1++)) + *v2++ + carry;
+		*res++ = BASE1 - sival.silow;
+		carry = sival.sihigh;
+	}
+	return (HALF) carry;
+}
+
+
+/*
+ * Multiply an array of words by a word, returning the carry word.
+ * The result can be the same as the array.
+ */
+static HALF
+cmul1(res, v, len, mul)
+	HALF *res;		/* result */
+	HALF *v;		/* words to multiply */
+	LEN len;		/* number of words */
+	HALF mul;		/* word to multiply by */
+{
+	FULL digit;
+	SIUNION sival;
+
+	digit = (FULL) mul;
+	sival.sihigh = 0;
+	while (len >= 4) {	/* expand the loop some */
+		len -= 4;
+		sival.ivalue = digit * ((FULL) *v++) + ((FULL) sival.sihigh);
+		*res++ = sival.silow;
+		sival.ivalue = digit * ((FULL) *v++) + ((FULL) sival.sihigh);
+		*res++ = sival.silow;
+		sival.ivalue = digit * ((FULL) *v++) + ((FULL) sival.sihigh);
+		*res++ = sival.silow;
+		sival.ivalue = digit * ((FULL) *v++) + ((FULL) sival.sihigh);
+		*res++ = sival.silow;
+	}
+	while (len-- > 0) {
+		sival.ivalue = digit * ((FULL) *v++) + ((FULL) sival.sihigh);
+		*res++ = sival.silow;
+	}
+	return sival.sihigh;
+}
+
+
+/*
+ * Multiply an array of words by a word and add the product into the
+ * result, returning the carry word.
+ */
+static HALF
+caddmul1(res, v, len, mul)
+	HALF *res;		/* result to add into */
+	HALF *v;		/* words to multiply */
+	LEN len;		/* number of words */
+	HALF mul;		/* word to multiply by */
+{
+	FULL digit;
+	SIUNION sival;
+
+	digit = (FULL) mul;
+	sival.sihigh = 0;
+	while (len >= 4) {	/* expand the loop some */
+		len -= 4;
+		sival.ivalue = digit * ((FULL) *v++) + ((FULL) *res) +
+			((FULL) sival.sihigh);
+		*res++ = sival.silow;
+		sival.ivalue = digit * ((FULL) *v++) + ((FULL) *res) +
+			((FULL) sival.sihigh);
+		*res++ = sival.silow;
+		sival.ivalue = digit * ((FULL) *v++) + ((FULL) *res) +
+			((FULL) sival.sihigh);
+		*res++ = sival.silow;
+		sival.ivalue = digit * ((FULL) *v++) + ((FULL) *res) +
+			((FULL) sival.sihigh);
+		*res++ = sival.silow;
+	}
+	while (len-- > 0) {
+		sival.ivalue = digit * ((FULL) *v++) + ((FULL) *res) +
+			((FULL) sival.sihigh);
+		*res++ = sival.silow;
+	}
+	return sival.sihigh;
+}
+
+
+/*
+ * Multiply an array of words by a word and subtract the product from
+ * the result, returning the borrow word.
+ */
+static HALF
+csubmul1(res, v, len, mul)
+	HALF *res;		/* result to subtract from */
+	HALF *v;		/* words to multiply */
+	LEN len;		/* number of words */
+	HALF mul;		/* word to multiply by */
+{
+	FULL digit;
+	HALF borrow;
+	HALF word;
+	SIUNION sival;
+
+	digit = (FULL) mul;
+	borrow = 0;
+	while (len-- > 0) {
+		sival.ivalue = digit * ((FULL) *v++) + ((FULL) borrow);
+		word = *res;
+		*res++ = word - sival.silow;
+		borrow = sival.sihigh + (word < sival.silow);
+	}
+	return borrow;
+}
+
+
+#ifdef ZVEC_X86_64
+/*
+ * The x86-64 kernels work on 64 bit words, of which there must be at
+ * least one.  The loops do two words at a time after doing one word
+ * first when there is an odd number of them, and count down with lea
+ * and jrcxz, which leave the carry and overflow flags alone.  The flags
+ * are cleared before the first word, after which the given instruction
+ * can set the carry.  The
+ * counter must therefore be in rcx, and the multiplier for mulx in rdx.
+ */
+#define	XLOOP(first, step, body) \
+		"testq	$1, %[n]\n\t" \
+		"jz	1f\n\t" \
+		"xorl	%k[c], %k[c]\n\t" \
+		first \
+		body(0) \
+		"leaq	-1(%[n]), %[n]\n\t" \
+		step(8) \
+		"jrcxz	3f\n\t" \
+		"jmp	2f\n" \
+	"1:\n\t" \
+		"xorl	%k[c], %k[c]\n\t" \
+		first \
+	"2:\n\t" \
+		body(0) \
+		body(8) \
+		"leaq	-2(%[n]), %[n]\n\t" \
+		step(16) \
+		"jrcxz	3f\n\t" \
+		"jmp	2b\n" \
+	"3:\n\t"
+
+#define	XSTEP2(len) \
+		"leaq	" #len "(%[a]), %[a]\n\t" \
+		"leaq	" #len "(%[r]), %[r]\n\t"
+#define	XSTEP3(len) \
+		XSTEP2(len) \
+		"leaq	" #len "(%[b]), %[b]\n\t"
+
+#define	XADD(off) \
+		"movq	" #off "(%[a]), %[lo]\n\t" \
+		"adcq	" #off "(%[b]), %[lo]\n\t" \
+		"movq	%[lo], " #off "(%[r])\n\t"
+#define	XSUB(off) \
+		"movq	" #off "(%[a]), %[lo]\n\t" \
+		"sbbq	" #off "(%[b]), %[lo]\n\t" \
+		"movq	%[lo], " #off "(%[r])\n\t"
+#define	XMUL1(off) \
+		"mulxq	" #off "(%[a]), %[lo], %[hi]\n\t" \
+		"adcq	%[c], %[lo]\n\t" \
+		"movq	%[lo], " #off "(%[r])\n\t" \
+		"movq	%[hi], %[c]\n\t"
+#define	XADDMUL1(off) \
+		"mulxq	" #off "(%[a]), %[lo], %[hi]\n\t" \
+		"adoxq	%[c], %[lo]\n\t" \
+		"adcxq	" #off "(%[r]), %[lo]\n\t" \
+		"movq	%[lo], " #off "(%[r])\n\t" \
+		"movq	%[hi], %[c]\n\t"
+/*
+ * The product is subtracted by adding its complement with the carry
+ * flag set at the start, so that adcx can be used alongside adox.
+ */
+#define	XSUBMUL1(off) \
+		"mulxq	" #off "(%[a]), %[lo], %[hi]\n\t" \
+		"adoxq	%[c], %[lo]\n\t" \
+		"notq	%[lo]\n\t" \
+		"adcxq	" #off "(%[r]), %[lo]\n\t" \
+		"movq	%[lo], " #off "(%[r])\n\t" \
+		"movq	%[hi], %[c]\n\t"
+
+
+static LIMB
+xadd(res, v1, v2, n)
+	LIMB *res;
+	LIMB *v1, *v2;
+	long n;
+{
+	LIMB carry, lo;
+
+	__asm__ __volatile__(
+		XLOOP("", XSTEP3, XADD)
+		"adcq	$0, %[c]\n"
+		: [c] "=&r" (carry), [lo] "=&r" (lo), [r] "+r" (res),
+		  [a] "+r" (v1), [b] "+r" (v2), [n] "+c" (n)
+		:
+		: "cc", "memory");
+	return carry;
+}
+
+
+static LIMB
+xsub(res, v1, v2, n)
+	LIMB *res;
+	LIMB *v1, *v2;
+	long n;
+{
+	LIMB borrow, lo;
+
+	__asm__ __volatile__(
+		XLOOP("", XSTEP3, XSUB)
+		"adcq	$0, %[c]\n"
+		: [c] "=&r" (borrow), [lo] "=&r" (lo), [r] "+r" (res),
+		  [a] "+r" (v1), [b] "+r" (v2), [n] "+c" (n)
+		:
+		: "cc", "memory");
+	return borrow;
+}
+
+
+static LIMB
+xmul1(res, v, n, mul)
+	LIMB *res;
+	LIMB *v;
+	long n;
+	LIMB mul;
+{
+	LIMB carry, lo, hi;
+
+	__asm__ __volatile__(
+		XLOOP("", XSTEP2, XMUL1)
+		"adcq	$0, %[c]\n"
+		: [c] "=&r" (carry), [lo] "=&r" (lo), [hi] "=&r" (hi),
+		  [r] "+r" (res), [a] "+r" (v), [n] "+c" (n)
+		: "d" (mul)
+		: "cc", "memory");
+	return carry;
+}
+
+
+static LIMB
+xaddmul1(res, v, n, mul)
+	LIMB *res;
+	LIMB *v;
+	long n;
+	LIMB mul;
+{
+	LIMB carry, lo, hi;
+
+	__asm__ __volatile__(
+		XLOOP("", XSTEP2, XADDMUL1)
+		"movl	$0, %k[lo]\n\t"
+		"adoxq	%[lo], %[c]\n\t"
+		"adcxq	%[lo], %[c]\n"
+		: [c] "=&r" (carry), [lo] "=&r" (lo), [hi] "=&r" (hi),
+		  [r] "+r" (res), [a] "+r" (v), [n] "+c" (n)
+		: "d" (mul)
+		: "cc", "memory");
+	return carry;
+}
+
+
+static LIMB
+xsubmul1(res, v, n, mul)
+	LIMB *res;
+	LIMB *v;
+	long n;
+	LIMB mul;
+{
+	LIMB borrow, lo, hi;
+
+	__asm__ __volatile__(
+		XLOOP("stc\n\t", XSTEP2, XSUBMUL1)
+		"movl	$0, %k[lo]\n\t"
+		"adoxq	%[lo], %[c]\n\t"
+		"cmc\n\t"
+		"adcxq	%[lo], %[c]\n"
+		: [c] "=&r" (borrow), [lo] "=&r" (lo), [hi] "=&r" (hi),
+		  [r] "+r" (res), [a] "+r" (v), [n] "+c" (n)
+		: "d" (mul)
+		: "cc", "memory");
+	return borrow;
+}
+
+
+/*
+ * Wrappers which run the kernels over the whole 64 bit words and finish
+ * any odd word left over when HALF is 32 bits using the portable code.
+ */
+static HALF
+adxadd(res, v1, v2, len)
+	HALF *res;
+	HALF *v1, *v2;
+	LEN len;
+{
+	LEN n, done;
+	FULL carry;
+
+	n = len / LIMBHALVES;
+	if (n <= 0)
+		return cadd(res, v1, v2, len);
+	carry = xadd((LIMB *) res, (LIMB *) v1, (LIMB *) v2, n);
+	done = n * LIMBHALVES;
+	if (done < len) {
+		carry += ((FULL) v1[done]) + ((FULL) v2[done]);
+		res[done] = (HALF) carry;
+		carry >>= BASEB;
+	}
+	return (HALF) carry;
+}
+
+
+static HALF
+adxsub(res, v1, v2, len)
+	HALF *res;
+	HALF *v1, *v2;
+	LEN len;
+{
+	LEN n, done;
+	HALF borrow, word1, word2;
+
+	n = len / LIMBHALVES;
+	if (n <= 0)
+		return csub(res, v1, v2, len);
+	borrow = (HALF) xsub((LIMB *) res, (LIMB *) v1, (LIMB *) v2, n);
+	done = n * LIMBHALVES;
+	if (done < len) {
+		word1 = v1[done];
+		word2 = v2[done];
+		res[done] = word1 - word2 - borrow;
+		borrow = (word1 < word2) || ((word1 == word2) && borrow);
+	}
+	return borrow;
+}
+
+
+static HALF
+adxmul1(res, v, len, mul)
+	HALF *res;
+	HALF *v;
+	LEN len;
+	HALF mul;
+{
+	LEN n, done;
+	FULL carry;
+
+	n = len / LIMBHALVES;
+	if (n <= 0)
+		return cmul1(res, v, len, mul);
+	carry = xmul1((LIMB *) res, (LIMB *) v, n, (LIMB) mul);
+	done = n * LIMBHALVES;
+	if (done < len) {
+		carry += ((FULL) mul) * ((FULL) v[done]);
+		res[done] = (HALF) carry;
+		carry >>= BASEB;
+	}
+	return (HALF) carry;
+}
+
+
+static HALF
+adxaddmul1(res, v, len, mul)
+	HALF *res;
+	HALF *v;
+	LEN len;
+	HALF mul;
+{
+	LEN n, done;
+	FULL carry;
+
+	n = len / LIMBHALVES;
+	if (n <= 0)
+		return caddmul1(res, v, len, mul);
+	carry = xaddmul1((LIMB *) res, (LIMB *) v, n, (LIMB) mul);
+	done = n * LIMBHALVES;
+	if (done < len) {
+		carry += ((FULL) mul) * ((FULL) v[done]) + ((FULL) res[done]);
+		res[done] = (HALF) carry;
+		carry >>= BASEB;
+	}
+	return (HALF) carry;
+}
+
+
+static HALF
+adxsubmul1(res, v, len, mul)
+	HALF *res;
+	HALF *v;
+	LEN len;
+	HALF mul;
+{
+	LEN n, done;
+	HALF borrow, word;
+	SIUNION sival;
+
+	n = len / LIMBHALVES;
+	if (n <= 0)
+		return csubmul1(res, v, len, mul);
+	borrow = (HALF) xsubmul1((LIMB *) res, (LIMB *) v, n, (LIMB) mul);
+	done = n * LIMBHALVES;
+	if (done < len) {
+		sival.ivalue = ((FULL) mul) * ((FULL) v[done]) + ((FULL) borrow);
+		word = res[done];
+		res[done] = word - sival.silow;
+		borrow = sival.sihigh + (word < sival.silow);
+	}
+	return borrow;
+}
+#endif
@@ -0,0 +1,4 @@
+/*
+ * The empty default used on Windows, where the algorithm sizes are not
+ * measured, so that zmath.h uses its own defaults.
+ */